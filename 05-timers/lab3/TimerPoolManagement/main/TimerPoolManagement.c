@@ -5,6 +5,9 @@
 #include <stdint.h>
 #include <string.h>
 #include <math.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include "sdkconfig.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/timers.h"
@@ -14,6 +17,7 @@
 #include "esp_timer.h"
 #include "esp_system.h"
 #include "esp_random.h"
+#include "esp_heap_caps.h"
 #include "driver/gpio.h"
 
 static const char *TAG = "ADV_TIMERS";
@@ -21,6 +25,7 @@ static const char *TAG = "ADV_TIMERS";
 // =================== EXPERIMENT SWITCH ===================
 #define EXPERIMENT 1
 // 1 = Timer Pool Mgmt, 2 = Performance Analysis, 3 = Stress Testing, 4 = Health Monitoring
+// 5 = Timing Wheel Scale Benchmark
 
 // ================ CONFIGURATION ================
 #define TIMER_POOL_SIZE              20
@@ -28,6 +33,41 @@ static const char *TAG = "ADV_TIMERS";
 #define PERFORMANCE_BUFFER_SIZE      100
 #define HEALTH_CHECK_INTERVAL        1000
 
+// Timer service (daemon) instrumentation — load ใช้ run-time stats ถ้าเปิดไว้ (ดู sdkconfig.defaults)
+#define DAEMON_LAG_WARN_MS           20      // expiry ช้ากว่ากำหนดเกินนี้ = daemon เริ่มอด
+#define DAEMON_LOAD_WARN_PERCENT     50
+
+// Offload executor: callback ที่ mark heavy ถูกส่งไปรันใน worker แทน timer service task
+#define OFFLOAD_WORKER_COUNT         2
+#define OFFLOAD_WORKER_STACK         3072
+#define OFFLOAD_WORKER_PRIORITY      (configTIMER_TASK_PRIORITY > 1 ? configTIMER_TASK_PRIORITY - 1 : 1)
+#define OFFLOAD_QUEUE_SIZE           32      // power of 2, >= TIMER_POOL_SIZE (coalesce ทำให้ไม่มีวันล้น)
+
+// Per-timer accuracy: histogram แบบ log-linear (0..7μs ทีละ 1, ต่อจากนั้น 4 ช่องต่อ power of 2 ถึง ~131ms)
+#define JITTER_HIST_LINEAR           8
+#define JITTER_HIST_SUB_BITS         2
+#define JITTER_HIST_BUCKETS          64
+#define JITTER_HIST_OVERFLOW_BUCKET  JITTER_HIST_BUCKETS   // ≥ ~131ms แยกจาก bucket จริงตัวสุดท้าย
+#define ACCURACY_TOLERANCE_PERCENT   5
+#define UNPOOLED_ACCURACY_SLOTS      (DYNAMIC_TIMER_MAX + 2)   // dynamic + system timers
+
+// Pool timer ID = TAG | generation | slot → lookup ตรง ๆ ไม่ต้อง scan, handle เก่าถูกจับได้
+#define TIMER_POOL_ID_TAG            0x80000000u   // แยกจาก next_timer_id ของ dynamic timers
+#define TIMER_POOL_SLOT_BITS         8
+#define TIMER_POOL_SLOT_MASK         ((1u << TIMER_POOL_SLOT_BITS) - 1)
+#define TIMER_POOL_GEN_MASK          (~TIMER_POOL_ID_TAG >> TIMER_POOL_SLOT_BITS)
+
+// Timing wheel: 4 ชั้น x 64 ช่อง = 2^24 ticks ก่อนต้องพักไว้ชั้นบนสุด
+#define TIMER_WHEEL_LEVELS           4
+#define TIMER_WHEEL_SLOT_BITS        6
+#define TIMER_WHEEL_SLOTS            (1u << TIMER_WHEEL_SLOT_BITS)
+#define TIMER_WHEEL_SLOT_MASK        (TIMER_WHEEL_SLOTS - 1)
+#define TIMER_WHEEL_MAX_DELTA        (1u << (TIMER_WHEEL_SLOT_BITS * TIMER_WHEEL_LEVELS))
+#define TIMER_WHEEL_TICK_PERIOD      1       // ticks ต่อรอบของ wheel
+#define TIMER_POOL_DEFAULT_BACKEND   TIMER_BACKEND_FREERTOS
+#define WHEEL_BENCH_MAX_DELAY        60000   // ticks — กระจายให้ครบทุกชั้น
+#define WHEEL_BENCH_XTIMER_MAX       100     // baseline xTimer วัดเฉพาะ N ที่ไม่เกินนี้
+
 // LEDs for visual feedback
 #define PERFORMANCE_LED     GPIO_NUM_2
 #define HEALTH_LED          GPIO_NUM_4
@@ -36,6 +76,54 @@ static const char *TAG = "ADV_TIMERS";
 
 // ================ DATA STRUCTURES ================
 
+// Timing wheel node — intrusive list ทำให้ start/stop เป็น O(1)
+typedef struct wheel_link {
+    struct wheel_link* next;
+    struct wheel_link* prev;
+} wheel_link_t;
+
+typedef struct wheel_timer wheel_timer_t;
+typedef void (*wheel_callback_t)(wheel_timer_t* timer);
+
+struct wheel_timer {
+    wheel_link_t link;          // ต้องอยู่ตัวแรก (cast link -> timer)
+    TickType_t expires;
+    TickType_t period;
+    wheel_callback_t callback;
+    bool auto_reload;
+};
+
+typedef struct {
+    wheel_link_t slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+    wheel_link_t expired;       // batch ของ tick ปัจจุบัน
+    TickType_t now;             // tick ถัดไปที่ wheel จะประมวลผล
+    portMUX_TYPE lock;
+    uint32_t pending;
+    uint32_t fired_total;
+    uint32_t max_batch;
+    uint32_t cascades;
+} timer_wheel_t;
+
+typedef enum {
+    TIMER_BACKEND_FREERTOS = 0,   // xTimerCreate ต่อ entry
+    TIMER_BACKEND_WHEEL,          // แขวนบน timing wheel ร่วมกัน
+} timer_backend_t;
+
+// Per-timer expiry statistics (timestamp 64-bit ไม่ wrap ใน soak run)
+typedef struct {
+    int64_t first_us;           // expiry อ้างอิงของ ideal timeline (0 = ยังไม่เริ่ม)
+    int64_t last_us;
+    uint32_t start_seq;         // เทียบ start_count → restart แล้วตั้ง baseline ใหม่
+    uint32_t intervals;         // จำนวนช่วงตั้งแต่ baseline
+    uint32_t samples;           // จำนวนช่วงทั้งหมด (สะสมข้าม restart)
+    int64_t interval_total_us;
+    int64_t drift_us;           // actual - (first + intervals * period) ณ expiry ล่าสุด
+    int64_t drift_max_abs_us;
+    uint32_t last_jitter_us;
+    uint32_t jitter_max_us;
+    uint32_t jitter_hist[JITTER_HIST_BUCKETS + 1];   // + overflow
+} timer_accuracy_t;
+
 // Timer Pool Entry
 typedef struct {
     TimerHandle_t handle;
@@ -47,8 +135,17 @@ typedef struct {
     TimerCallbackFunction_t callback;
     void* context;
     uint32_t creation_time;
-    uint32_t start_count;
-    uint32_t callback_count;
+    uint32_t start_count;       // อัปเดตด้วย __atomic
+    uint32_t callback_count;    // อัปเดตด้วย __atomic
+    uint32_t generation;        // เพิ่มทุกครั้งที่คืน slot
+    uint32_t runtime_last_us;
+    uint32_t runtime_max_us;
+    uint32_t lag_max_ticks;     // scheduled → actual expiry
+    bool heavy;                 // ให้ offload executor รันแทน daemon
+    uint32_t offload_pending;   // 1 = อยู่ในคิวหรือกำลังรันใน worker (atomic)
+    timer_accuracy_t accuracy;  // อัปเดตตอน dispatch ใน daemon
+    timer_backend_t backend;
+    wheel_timer_t wheel;
 } timer_pool_entry_t;
 
 // Performance Metrics
@@ -61,6 +158,37 @@ typedef struct {
     bool accuracy_ok;
 } performance_sample_t;
 
+// Timer Service Task Statistics (เขียนจาก daemon เท่านั้น ยกเว้น cmd_*)
+typedef struct {
+    uint32_t cmd_posted;            // คำสั่งที่ส่งเข้า timer queue สำเร็จ (atomic)
+    uint32_t cmd_queue_full;        // ส่งไม่เข้าเพราะคิวเต็ม (atomic)
+    uint32_t cmd_depth_last;        // ค่าประมาณความลึกคิว (upper bound)
+    uint32_t cmd_depth_hwm;
+    uint32_t callbacks;
+    uint64_t callback_busy_us;
+    uint32_t callback_max_us;
+    uint64_t lag_total_ticks;
+    uint32_t lag_max_ticks;
+    uint32_t lag_window_max_ticks;  // reset ทุกรอบ health check
+} timer_daemon_stats_t;
+
+// Offload Executor Statistics
+typedef struct {
+    uint32_t dispatched;
+    uint32_t coalesced;         // expiry ที่ทิ้งเพราะรอบก่อนยังค้างอยู่
+    uint32_t stale;             // entry ถูกคืน pool ก่อน worker หยิบไปรัน
+    uint32_t completed;
+    uint64_t busy_us;
+    uint32_t max_us;            // อัปเดตแบบ CAS-max (มีหลาย worker)
+} offload_stats_t;
+
+// Dispatch jitter ของ timer ปกติ (ไม่ heavy) แยกตามโหมด
+typedef struct {
+    uint32_t samples;
+    uint64_t jitter_total_us;
+    uint32_t jitter_max_us;
+} jitter_stats_t;
+
 // System Health Data
 typedef struct {
     uint32_t total_timers_created;
@@ -81,6 +209,47 @@ typedef struct {
 timer_pool_entry_t timer_pool[TIMER_POOL_SIZE];
 SemaphoreHandle_t pool_mutex;
 uint32_t next_timer_id = 1000;
+uint16_t pool_free_stack[TIMER_POOL_SIZE];   // slot ว่าง (LIFO) — ใช้ภายใต้ pool_mutex
+uint32_t pool_free_top = 0;
+uint32_t pool_used_count = 0;                // อ่านแบบ atomic จาก health monitor
+
+_Static_assert(TIMER_POOL_SIZE <= (1u << TIMER_POOL_SLOT_BITS), "TIMER_POOL_SIZE exceeds slot bits");
+
+// Timing Wheel (ขับด้วย FreeRTOS timer ตัวเดียว)
+timer_wheel_t timer_wheel;
+TimerHandle_t wheel_tick_timer;
+static bool wheel_tick_running = false;  // เขียนใน daemon เท่านั้น (ถือ timer_wheel.lock) — tick เดินเฉพาะตอนมี entry ค้าง
+static __thread timer_pool_entry_t* wheel_dispatch_entry = NULL;  // entry ที่ task นี้กำลัง dispatch (wheel / offload worker)
+
+// Timer Service Instrumentation
+timer_daemon_stats_t daemon_stats = {0};
+
+// Accuracy ของ timer ที่ไม่ได้มาจาก pool (dynamic / system) — ใช้ใน daemon เท่านั้น
+typedef struct {
+    TimerHandle_t handle;
+    char name[16];              // เก็บสำเนาไว้ → รายงานไม่ต้องแตะ handle ที่อาจถูกลบแล้ว
+    TickType_t period;
+    timer_accuracy_t accuracy;
+} unpooled_accuracy_t;
+
+unpooled_accuracy_t unpooled_accuracy[UNPOOLED_ACCURACY_SLOTS];
+
+// Offload Executor
+typedef struct {
+    atomic_uint seq;
+    uint32_t timer_id;
+} offload_cell_t;
+
+offload_cell_t offload_ring[OFFLOAD_QUEUE_SIZE];
+atomic_uint offload_enqueue_pos;
+atomic_uint offload_dequeue_pos;
+SemaphoreHandle_t offload_sem;               // ปลุก worker เท่านั้น, ข้อมูลวิ่งผ่าน ring
+offload_stats_t offload_stats = {0};
+jitter_stats_t dispatch_jitter[2] = {0};     // [0] = heavy รัน inline, [1] = heavy ถูก offload
+volatile bool timer_offload_enabled = true;
+
+_Static_assert((OFFLOAD_QUEUE_SIZE & (OFFLOAD_QUEUE_SIZE - 1)) == 0, "OFFLOAD_QUEUE_SIZE must be a power of 2");
+_Static_assert(OFFLOAD_QUEUE_SIZE >= TIMER_POOL_SIZE, "offload ring must hold one run per pool entry");
 
 // Performance Monitoring
 performance_sample_t perf_buffer[PERFORMANCE_BUFFER_SIZE];
@@ -100,7 +269,511 @@ uint32_t dynamic_timer_count = 0;
 QueueHandle_t test_result_queue;
 TaskHandle_t stress_test_task_handle;
 
+// ================ TIMER ACCURACY STATISTICS ================
+static inline uint32_t jitter_bucket(uint32_t jitter_us) {
+    if (jitter_us < JITTER_HIST_LINEAR) {
+        return jitter_us;
+    }
+
+    uint32_t msb = 31 - __builtin_clz(jitter_us);
+    uint32_t sub = (jitter_us >> (msb - JITTER_HIST_SUB_BITS)) & ((1u << JITTER_HIST_SUB_BITS) - 1);
+    uint32_t bucket = JITTER_HIST_LINEAR + ((msb - 3) << JITTER_HIST_SUB_BITS) + sub;
+    return bucket < JITTER_HIST_BUCKETS ? bucket : JITTER_HIST_OVERFLOW_BUCKET;
+}
+
+// ขอบบนของ bucket (μs) — percentile รายงานเป็นค่านี้
+static uint32_t jitter_bucket_upper_us(uint32_t bucket) {
+    if (bucket < JITTER_HIST_LINEAR) {
+        return bucket;
+    }
+
+    uint32_t msb = 3 + ((bucket - JITTER_HIST_LINEAR) >> JITTER_HIST_SUB_BITS);
+    uint32_t sub = (bucket - JITTER_HIST_LINEAR) & ((1u << JITTER_HIST_SUB_BITS) - 1);
+    uint32_t step = 1u << (msb - JITTER_HIST_SUB_BITS);
+    return (1u << msb) + (sub + 1) * step - 1;
+}
+
+uint32_t timer_accuracy_percentile(const timer_accuracy_t* acc, uint32_t percent) {
+    if (acc->samples == 0) {
+        return 0;
+    }
+
+    uint64_t target = ((uint64_t)acc->samples * percent + 99) / 100;
+    uint64_t seen = 0;
+    for (uint32_t b = 0; b <= JITTER_HIST_OVERFLOW_BUCKET; b++) {
+        seen += acc->jitter_hist[b];
+        if (seen >= target) {
+            if (b == JITTER_HIST_OVERFLOW_BUCKET) return acc->jitter_max_us;  // bucket ล้น ไม่มีขอบบน
+            uint32_t upper = jitter_bucket_upper_us(b);
+            return upper < acc->jitter_max_us ? upper : acc->jitter_max_us;
+        }
+    }
+    return acc->jitter_max_us;
+}
+
+static inline int64_t ticks_to_us(TickType_t ticks) {
+    return (int64_t)ticks * 1000000 / configTICK_RATE_HZ;
+}
+
+// บันทึก expiry หนึ่งครั้ง; คืน jitter (μs) หรือ UINT32_MAX ถ้ายังไม่มีช่วงให้วัด
+uint32_t timer_accuracy_record(timer_accuracy_t* acc, int64_t now_us, TickType_t period,
+                               uint32_t start_seq) {
+    if (acc->first_us == 0 || acc->start_seq != start_seq) {
+        acc->first_us = now_us;
+        acc->last_us = now_us;
+        acc->start_seq = start_seq;
+        acc->intervals = 0;
+        acc->drift_us = 0;
+        return UINT32_MAX;
+    }
+
+    int64_t period_us = ticks_to_us(period);
+    int64_t interval_us = now_us - acc->last_us;
+    int64_t error_us = interval_us - period_us;
+    uint32_t jitter_us = (uint32_t)(error_us < 0 ? -error_us : error_us);
+
+    acc->last_us = now_us;
+    acc->intervals++;
+    acc->samples++;
+    acc->interval_total_us += interval_us;
+
+    // drift เทียบ timeline ในอุดมคติ ไม่ใช่รอบก่อนหน้า → เห็นการสะสมระยะยาว
+    acc->drift_us = now_us - (acc->first_us + (int64_t)acc->intervals * period_us);
+    int64_t drift_abs = acc->drift_us < 0 ? -acc->drift_us : acc->drift_us;
+    if (drift_abs > acc->drift_max_abs_us) acc->drift_max_abs_us = drift_abs;
+
+    acc->last_jitter_us = jitter_us;
+    if (jitter_us > acc->jitter_max_us) acc->jitter_max_us = jitter_us;
+    acc->jitter_hist[jitter_bucket(jitter_us)]++;
+
+    return jitter_us;
+}
+
+static inline bool timer_accuracy_within_tolerance(const timer_accuracy_t* acc, TickType_t period) {
+    return (int64_t)acc->last_jitter_us * 100 <= ticks_to_us(period) * ACCURACY_TOLERANCE_PERCENT;
+}
+
+// slot ของ timer นอก pool (ค้นเชิงเส้นใน UNPOOLED_ACCURACY_SLOTS ช่อง)
+static timer_accuracy_t* unpooled_timer_accuracy(TimerHandle_t timer) {
+    unpooled_accuracy_t* free_slot = NULL;
+    for (int i = 0; i < UNPOOLED_ACCURACY_SLOTS; i++) {
+        if (unpooled_accuracy[i].handle == timer) {
+            return &unpooled_accuracy[i].accuracy;
+        }
+        if (free_slot == NULL && unpooled_accuracy[i].handle == NULL) {
+            free_slot = &unpooled_accuracy[i];
+        }
+    }
+
+    if (free_slot == NULL) {
+        return NULL;
+    }
+    memset(free_slot, 0, sizeof(*free_slot));
+    strncpy(free_slot->name, pcTimerGetName(timer), sizeof(free_slot->name) - 1);
+    free_slot->period = xTimerGetPeriod(timer);
+    free_slot->handle = timer;
+    return &free_slot->accuracy;
+}
+
+static void unpooled_timer_forget(TimerHandle_t timer) {
+    for (int i = 0; i < UNPOOLED_ACCURACY_SLOTS; i++) {
+        if (unpooled_accuracy[i].handle == timer) {
+            unpooled_accuracy[i].handle = NULL;
+        }
+    }
+}
+
+// expiry ของ pool entry: สถิติรายตัว + รวม jitter ของ timer ปกติแยกตามโหมด offload
+static void timer_record_expiry(timer_pool_entry_t* entry, int64_t now_us) {
+    if (!entry->auto_reload) {
+        return;   // one-shot ไม่มีช่วงให้วัด
+    }
+
+    uint32_t jitter_us = timer_accuracy_record(&entry->accuracy, now_us, entry->period,
+                                               __atomic_load_n(&entry->start_count, __ATOMIC_RELAXED));
+    if (entry->heavy || jitter_us == UINT32_MAX) {
+        return;
+    }
+
+    jitter_stats_t* js = &dispatch_jitter[timer_offload_enabled ? 1 : 0];
+    js->samples++;
+    js->jitter_total_us += jitter_us;
+    if (jitter_us > js->jitter_max_us) js->jitter_max_us = jitter_us;
+}
+
+// ================ TIMER SERVICE INSTRUMENTATION ================
+// FreeRTOS ไม่เปิด handle ของ timer command queue จึงนับคำสั่งเอง
+// ทุก xTimerStart/Stop/Reset/Delete ใน lab นี้ต้องส่งผ่านตัวนี้ ไม่งั้น depth ที่ประเมินจะต่ำเกินจริง
+static inline BaseType_t timer_cmd_account(BaseType_t result) {
+    if (result == pdPASS) {
+        __atomic_fetch_add(&daemon_stats.cmd_posted, 1, __ATOMIC_RELAXED);
+    } else {
+        __atomic_fetch_add(&daemon_stats.cmd_queue_full, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&health_data.command_failures, 1, __ATOMIC_RELAXED);
+    }
+    return result;
+}
+
+// เรียกจาก callback ที่รันใน daemon (pool dispatch ทั้งสอง backend + health monitor ที่เดินตลอด)
+// daemon drain คิวก่อนรัน callback ถัดไปเสมอ → คำสั่งที่ส่งก่อน sample ที่แล้วถูกประมวลผลไปแล้ว
+// ดังนั้นคำสั่งที่ยังค้างได้ ≤ จำนวนที่ส่งหลัง sample ที่แล้ว
+static void timer_daemon_sample_queue(void) {
+    static uint32_t posted_at_last_sample = 0;
+
+    uint32_t posted = __atomic_load_n(&daemon_stats.cmd_posted, __ATOMIC_RELAXED);
+    uint32_t depth = posted - posted_at_last_sample;
+    posted_at_last_sample = posted;
+
+    if (depth > configTIMER_QUEUE_LENGTH) {
+        depth = configTIMER_QUEUE_LENGTH;
+    }
+    daemon_stats.cmd_depth_last = depth;
+    if (depth > daemon_stats.cmd_depth_hwm) {
+        daemon_stats.cmd_depth_hwm = depth;
+    }
+}
+
+static bool timer_offload_submit(timer_pool_entry_t* entry);
+
+// runtime ของ callback หนึ่งรอบ (daemon หรือ worker)
+static void timer_record_runtime(timer_pool_entry_t* entry, uint32_t runtime_us) {
+    entry->runtime_last_us = runtime_us;
+    if (runtime_us > entry->runtime_max_us) entry->runtime_max_us = runtime_us;
+}
+
+// รัน callback ของ pool entry พร้อมจับเวลา runtime และ lag (ใช้ทั้งสอง backend)
+// entry ที่ heavy จะถูกส่งไป offload executor แทน → daemon จ่ายแค่ค่า enqueue
+static void timer_daemon_run(timer_pool_entry_t* entry, TimerHandle_t handle, TickType_t scheduled) {
+    timer_daemon_sample_queue();
+
+    uint32_t lag = (uint32_t)(xTaskGetTickCount() - scheduled);
+    if ((int32_t)lag < 0) lag = 0;
+
+    int64_t start = esp_timer_get_time();
+    timer_record_expiry(entry, start);
+
+    if (entry->heavy && timer_offload_enabled) {
+        timer_offload_submit(entry);
+    } else {
+        entry->callback(handle);
+        timer_record_runtime(entry, (uint32_t)(esp_timer_get_time() - start));
+    }
+    uint32_t runtime_us = (uint32_t)(esp_timer_get_time() - start);
+
+    if (lag > entry->lag_max_ticks) entry->lag_max_ticks = lag;
+
+    daemon_stats.callbacks++;
+    daemon_stats.callback_busy_us += runtime_us;
+    daemon_stats.lag_total_ticks += lag;
+    if (runtime_us > daemon_stats.callback_max_us) daemon_stats.callback_max_us = runtime_us;
+    if (lag > daemon_stats.lag_max_ticks) daemon_stats.lag_max_ticks = lag;
+    if (lag > daemon_stats.lag_window_max_ticks) daemon_stats.lag_window_max_ticks = lag;
+}
+
+// สัดส่วน CPU ของ timer service task ตั้งแต่ครั้งก่อนที่เรียก (%, ของหนึ่ง core)
+static uint32_t timer_daemon_load_percent(void) {
+    static int64_t last_wall_us = 0;
+    static uint64_t last_busy_us = 0;
+
+    int64_t wall_us = esp_timer_get_time();
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    uint64_t busy_us = ulTaskGetRunTimeCounter(xTimerGetTimerDaemonTaskHandle());
+#else
+    // fallback: นับเฉพาะเวลาใน pool callbacks ที่วัดได้
+    uint64_t busy_us = daemon_stats.callback_busy_us;
+#endif
+
+    uint32_t load = 0;
+    if (last_wall_us != 0 && wall_us > last_wall_us) {
+        uint64_t busy_delta = (busy_us - last_busy_us) & (uint64_t)UINT32_MAX;
+        load = (uint32_t)(busy_delta * 100 / (uint64_t)(wall_us - last_wall_us));
+        if (load > 100) load = 100;
+    }
+
+    last_wall_us = wall_us;
+    last_busy_us = busy_us;
+    return load;
+}
+
+// ================ HIERARCHICAL TIMING WHEEL ================
+// ชั้น 0 ละเอียด 1 tick, ชั้นบนหยาบขึ้นทีละ 64 เท่า
+// start/stop/restart แค่ต่อ/ตัด list = O(1); ชั้นบนจะ cascade ลงมาเมื่อชั้นล่างวนครบรอบ
+
+static inline void wheel_link_init(wheel_link_t* head) {
+    head->next = head;
+    head->prev = head;
+}
+
+static inline void wheel_link_insert_tail(wheel_link_t* head, wheel_link_t* node) {
+    node->prev = head->prev;
+    node->next = head;
+    head->prev->next = node;
+    head->prev = node;
+}
+
+static inline void wheel_link_remove(wheel_link_t* node) {
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->next = NULL;
+    node->prev = NULL;
+}
+
+// ย้ายทั้ง list จาก from ไปต่อท้าย to
+static inline void wheel_link_splice(wheel_link_t* from, wheel_link_t* to) {
+    if (from->next == from) return;
+    from->next->prev = to->prev;
+    to->prev->next = from->next;
+    from->prev->next = to;
+    to->prev = from->prev;
+    wheel_link_init(from);
+}
+
+void timer_wheel_init(timer_wheel_t* w) {
+    for (int level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+        for (int slot = 0; slot < TIMER_WHEEL_SLOTS; slot++) {
+            wheel_link_init(&w->slots[level][slot]);
+        }
+    }
+    wheel_link_init(&w->expired);
+    w->now = xTaskGetTickCount();
+    portMUX_INITIALIZE(&w->lock);
+    w->pending = 0;
+    w->fired_total = 0;
+    w->max_batch = 0;
+    w->cascades = 0;
+}
+
+void wheel_timer_init(wheel_timer_t* t, TickType_t period, bool auto_reload,
+                      wheel_callback_t callback) {
+    t->link.next = NULL;
+    t->link.prev = NULL;
+    t->expires = 0;
+    t->period = period;
+    t->callback = callback;
+    t->auto_reload = auto_reload;
+}
+
+static inline bool wheel_timer_pending(const wheel_timer_t* t) {
+    return t->link.next != NULL;
+}
+
+// เลือกช่องจากระยะห่างถึง expiry (ต้องถือ lock)
+static void wheel_insert_locked(timer_wheel_t* w, wheel_timer_t* t) {
+    TickType_t delta = t->expires - w->now;
+    wheel_link_t* slot;
+
+    if ((int32_t)delta < 0) {
+        // เลยกำหนดแล้ว → ยิงใน tick ถัดไปที่ wheel ประมวลผล
+        slot = &w->slots[0][w->now & TIMER_WHEEL_SLOT_MASK];
+    } else {
+        // ไกลเกินชั้นบนสุด: พักไว้ที่ขอบ แล้วค่อยคำนวณใหม่ตอน cascade (expires ไม่เปลี่ยน)
+        TickType_t when = t->expires;
+        if (delta >= TIMER_WHEEL_MAX_DELTA) {
+            delta = TIMER_WHEEL_MAX_DELTA - 1;
+            when = w->now + delta;
+        }
+
+        int level = 0;
+        while (level < TIMER_WHEEL_LEVELS - 1 &&
+               delta >= (1u << (TIMER_WHEEL_SLOT_BITS * (level + 1)))) {
+            level++;
+        }
+        slot = &w->slots[level][(when >> (TIMER_WHEEL_SLOT_BITS * level)) & TIMER_WHEEL_SLOT_MASK];
+    }
+
+    wheel_link_insert_tail(slot, &t->link);
+}
+
+// start = restart: ถ้ายังค้างอยู่ก็ถอดออกก่อน
+void wheel_timer_start(timer_wheel_t* w, wheel_timer_t* t, TickType_t delay) {
+    TickType_t now = xTaskGetTickCount();
+
+    taskENTER_CRITICAL(&w->lock);
+    if (wheel_timer_pending(t)) {
+        wheel_link_remove(&t->link);
+    } else {
+        // wheel ว่าง (tick อาจหยุดไปนาน) → เลื่อน now ให้ทัน ไม่ต้องไล่ tick ว่างทีละช่องตอน advance
+        if (w->pending == 0 && (int32_t)(now - w->now) > 0) {
+            w->now = now;
+        }
+        w->pending++;
+    }
+    t->expires = now + delay;
+    wheel_insert_locked(w, t);
+    taskEXIT_CRITICAL(&w->lock);
+}
+
+void wheel_timer_restart(timer_wheel_t* w, wheel_timer_t* t) {
+    wheel_timer_start(w, t, t->period);
+}
+
+bool wheel_timer_stop(timer_wheel_t* w, wheel_timer_t* t) {
+    bool was_pending = false;
+
+    taskENTER_CRITICAL(&w->lock);
+    if (wheel_timer_pending(t)) {
+        wheel_link_remove(&t->link);
+        w->pending--;
+        was_pending = true;
+    }
+    taskEXIT_CRITICAL(&w->lock);
+
+    return was_pending;
+}
+
+// กระจายทั้งช่องของชั้นบนลงชั้นล่าง (ต้องถือ lock)
+static void wheel_cascade_locked(timer_wheel_t* w, int level, uint32_t index) {
+    wheel_link_t* head = &w->slots[level][index];
+    wheel_link_t* node = head->next;
+    wheel_link_init(head);
+
+    while (node != head) {
+        wheel_link_t* next = node->next;
+        wheel_insert_locked(w, (wheel_timer_t*)node);
+        node = next;
+    }
+    w->cascades++;
+}
+
+// เดิน wheel ให้ทันเวลา now; callback ของแต่ละ tick ถูกรวบเป็น batch เดียว
+// callback รันนอก critical section เพื่อให้ start/stop จาก task อื่นไม่ต้องรอ
+uint32_t timer_wheel_advance(timer_wheel_t* w, TickType_t now) {
+    uint32_t fired = 0;
+
+    while ((int32_t)(now - w->now) >= 0) {
+        uint32_t batch = 0;
+
+        taskENTER_CRITICAL(&w->lock);
+        uint32_t slot = w->now & TIMER_WHEEL_SLOT_MASK;
+        uint32_t carry = slot;
+        for (int level = 1; level < TIMER_WHEEL_LEVELS && carry == 0; level++) {
+            carry = (w->now >> (TIMER_WHEEL_SLOT_BITS * level)) & TIMER_WHEEL_SLOT_MASK;
+            wheel_cascade_locked(w, level, carry);
+        }
+        wheel_link_splice(&w->slots[0][slot], &w->expired);
+        w->now++;
+        taskEXIT_CRITICAL(&w->lock);
+
+        while (1) {
+            taskENTER_CRITICAL(&w->lock);
+            wheel_link_t* node = w->expired.next;
+            if (node == &w->expired) {
+                taskEXIT_CRITICAL(&w->lock);
+                break;
+            }
+            wheel_timer_t* t = (wheel_timer_t*)node;
+            wheel_link_remove(node);
+            if (t->auto_reload && t->period > 0) {
+                t->expires += t->period;   // อิง expiry เดิม → ไม่สะสม drift
+                wheel_insert_locked(w, t);
+            } else {
+                w->pending--;
+            }
+            taskEXIT_CRITICAL(&w->lock);
+
+            t->callback(t);
+            batch++;
+        }
+
+        fired += batch;
+        if (batch > w->max_batch) {
+            w->max_batch = batch;
+        }
+    }
+
+    w->fired_total += fired;
+    return fired;
+}
+
+// wheel ว่างแล้ว → หยุด tick ไม่ให้ daemon ตื่นทุก tick เปล่า ๆ
+static void wheel_tick_callback(TimerHandle_t timer) {
+    timer_wheel_advance(&timer_wheel, xTaskGetTickCount());
+
+    bool idle = false;
+    taskENTER_CRITICAL(&timer_wheel.lock);
+    if (timer_wheel.pending == 0) {
+        wheel_tick_running = false;
+        idle = true;
+    }
+    taskEXIT_CRITICAL(&timer_wheel.lock);
+
+    if (idle) {
+        timer_cmd_account(xTimerStop(wheel_tick_timer, 0));
+    }
+}
+
+// รันใน daemon เหมือน wheel_tick_callback → การตัดสินใจ start/stop เรียงตามคิวเดียวกัน ไม่มีคำสั่งสลับลำดับ
+static void wheel_tick_resume(void* arg, uint32_t unused) {
+    bool start = false;
+    taskENTER_CRITICAL(&timer_wheel.lock);
+    if (!wheel_tick_running && timer_wheel.pending > 0) {
+        wheel_tick_running = true;
+        start = true;
+    }
+    taskEXIT_CRITICAL(&timer_wheel.lock);
+
+    if (start && timer_cmd_account(xTimerStart(wheel_tick_timer, 0)) != pdPASS) {
+        taskENTER_CRITICAL(&timer_wheel.lock);
+        wheel_tick_running = false;
+        taskEXIT_CRITICAL(&timer_wheel.lock);
+    }
+}
+
+// เรียกหลัง start entry บน timer_wheel: ถ้า tick หยุดอยู่ ขอให้ daemon ปลุกขึ้นมา
+// (pending++ เกิดก่อนอ่าน flag → ถ้า tick callback ยังเห็น pending > 0 ก็จะไม่หยุด)
+static BaseType_t wheel_tick_kick(void) {
+    taskENTER_CRITICAL(&timer_wheel.lock);
+    bool running = wheel_tick_running;
+    taskEXIT_CRITICAL(&timer_wheel.lock);
+
+    if (running) return pdPASS;
+    return timer_cmd_account(xTimerPendFunctionCall(wheel_tick_resume, NULL, 0, 0));
+}
+
 // ================ TIMER POOL MANAGEMENT ================
+// entry ที่มาจาก wheel ส่ง wheel_tick_timer เป็น handle ให้ callback เดิม (handle ร่วม ดู allocate_wheel_from_pool)
+static void wheel_pool_dispatch(wheel_timer_t* t) {
+    timer_pool_entry_t* entry =
+        (timer_pool_entry_t*)((char*)t - offsetof(timer_pool_entry_t, wheel));
+
+    TickType_t scheduled = t->auto_reload ? t->expires - t->period : t->expires;
+
+    wheel_dispatch_entry = entry;
+    timer_daemon_run(entry, wheel_tick_timer, scheduled);
+    wheel_dispatch_entry = NULL;
+}
+
+// callback เรียกแทน pvTimerGetTimerID / xTimerGetPeriod ให้ใช้ได้ทั้งสอง backend
+// ระหว่าง dispatch จาก wheel หรือ offload worker อ่านจาก entry เสมอ ไม่แตะ xTimer handle
+static inline uint32_t pool_timer_id(TimerHandle_t timer) {
+    if (wheel_dispatch_entry != NULL) {
+        return wheel_dispatch_entry->id;
+    }
+    return (uint32_t)pvTimerGetTimerID(timer);
+}
+
+static inline TickType_t pool_timer_period(TimerHandle_t timer) {
+    if (wheel_dispatch_entry != NULL) {
+        return wheel_dispatch_entry->period;
+    }
+    return xTimerGetPeriod(timer);
+}
+
+void init_timer_wheel(void) {
+    timer_wheel_init(&timer_wheel);
+
+    // สร้างไว้เฉย ๆ — tick เริ่มเมื่อมี wheel entry ตัวแรก (wheel_tick_kick) และหยุดเองเมื่อ wheel ว่าง
+    wheel_tick_timer = xTimerCreate("WheelTick", TIMER_WHEEL_TICK_PERIOD, pdTRUE,
+                                    (void*)0, wheel_tick_callback);
+    if (wheel_tick_timer == NULL) {
+        ESP_LOGE(TAG, "Failed to create timing wheel tick");
+        return;
+    }
+
+    ESP_LOGI(TAG, "Timing wheel ready: %d levels x %u slots (%lu bytes)",
+             TIMER_WHEEL_LEVELS, TIMER_WHEEL_SLOTS, (uint32_t)sizeof(timer_wheel));
+}
+
 void init_timer_pool(void) {
     pool_mutex = xSemaphoreCreateMutex();
 
@@ -112,14 +785,59 @@ void init_timer_pool(void) {
         timer_pool[i].creation_time = 0;
         timer_pool[i].start_count = 0;
         timer_pool[i].callback_count = 0;
+        timer_pool[i].generation = 0;
+        timer_pool[i].backend = TIMER_BACKEND_FREERTOS;
+        wheel_timer_init(&timer_pool[i].wheel, 0, false, wheel_pool_dispatch);
+
+        // slot 0 อยู่บนสุดของ stack → แจกตามลำดับเหมือนเดิม
+        pool_free_stack[i] = TIMER_POOL_SIZE - 1 - i;
     }
+    pool_free_top = TIMER_POOL_SIZE;
+    pool_used_count = 0;
+
+    init_timer_wheel();
 
     ESP_LOGI(TAG, "Timer pool initialized with %d slots", TIMER_POOL_SIZE);
 }
 
-timer_pool_entry_t* allocate_from_pool(const char* name, TickType_t period,
-                                      bool auto_reload, TimerCallbackFunction_t callback,
-                                      void* context) {
+static inline uint32_t pool_make_id(uint32_t slot, uint32_t generation) {
+    return TIMER_POOL_ID_TAG | ((generation & TIMER_POOL_GEN_MASK) << TIMER_POOL_SLOT_BITS) | slot;
+}
+
+// O(1): ถอด slot จาก ID แล้วเทียบ ID เต็ม (รวม generation) — ไม่ต้องถือ mutex
+timer_pool_entry_t* pool_entry_from_id(uint32_t timer_id) {
+    if ((timer_id & TIMER_POOL_ID_TAG) == 0) {
+        return NULL;   // ไม่ใช่ timer จาก pool
+    }
+
+    uint32_t slot = timer_id & TIMER_POOL_SLOT_MASK;
+    if (slot >= TIMER_POOL_SIZE) {
+        return NULL;
+    }
+
+    timer_pool_entry_t* entry = &timer_pool[slot];
+    if (__atomic_load_n(&entry->id, __ATOMIC_ACQUIRE) != timer_id) {
+        return NULL;   // slot ถูกคืน/แจกใหม่แล้ว (stale handle)
+    }
+    return entry;
+}
+
+// xTimer backend: daemon เรียก trampoline → วัดผลแล้วค่อยเรียก callback จริง
+static void pool_timer_trampoline(TimerHandle_t timer) {
+    timer_pool_entry_t* entry = pool_entry_from_id((uint32_t)pvTimerGetTimerID(timer));
+    if (entry == NULL) {
+        return;
+    }
+
+    // auto-reload ถูกตั้ง expiry รอบถัดไปก่อนเรียก callback แล้ว
+    TickType_t expiry = xTimerGetExpiryTime(timer);
+    TickType_t scheduled = entry->auto_reload ? expiry - entry->period : expiry;
+    timer_daemon_run(entry, timer, scheduled);
+}
+
+static timer_pool_entry_t* allocate_from_pool_backend(const char* name, TickType_t period,
+                                                      bool auto_reload, TimerCallbackFunction_t callback,
+                                                      void* context, timer_backend_t backend) {
     if (xSemaphoreTake(pool_mutex, pdMS_TO_TICKS(100)) != pdTRUE) {
         ESP_LOGW(TAG, "Failed to acquire pool mutex");
         return NULL;
@@ -127,63 +845,300 @@ timer_pool_entry_t* allocate_from_pool(const char* name, TickType_t period,
 
     timer_pool_entry_t* entry = NULL;
 
-    // Find free slot
-    for (int i = 0; i < TIMER_POOL_SIZE; i++) {
-        if (!timer_pool[i].in_use) {
-            entry = &timer_pool[i];
-            entry->in_use = true;
-            entry->id = next_timer_id++;
-            strncpy(entry->name, name, sizeof(entry->name) - 1);
-            entry->period = period;
-            entry->auto_reload = auto_reload;
-            entry->callback = callback;
-            entry->context = context;
-            entry->creation_time = xTaskGetTickCount();
-            entry->start_count = 0;
-            entry->callback_count = 0;
-
+    // Pop free slot
+    if (pool_free_top > 0) {
+        uint32_t slot = pool_free_stack[--pool_free_top];
+        entry = &timer_pool[slot];
+        entry->in_use = true;
+        strncpy(entry->name, name, sizeof(entry->name) - 1);
+        entry->period = period;
+        entry->auto_reload = auto_reload;
+        entry->callback = callback;
+        entry->context = context;
+        entry->creation_time = xTaskGetTickCount();
+        __atomic_store_n(&entry->start_count, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&entry->callback_count, 0, __ATOMIC_RELAXED);
+        entry->runtime_last_us = 0;
+        entry->runtime_max_us = 0;
+        entry->lag_max_ticks = 0;
+        entry->heavy = false;
+        // offload_pending ไม่ reset ที่นี่: worker อาจยังรัน callback ของเจ้าของเก่าอยู่ worker เป็นคนเคลียร์
+        memset(&entry->accuracy, 0, sizeof(entry->accuracy));
+        entry->backend = backend;
+
+        uint32_t id = pool_make_id(slot, entry->generation);
+
+        if (backend == TIMER_BACKEND_WHEEL) {
+            // ไม่มี xTimerCreate / command queue ต่อ entry
+            entry->handle = NULL;
+            wheel_timer_init(&entry->wheel, period, auto_reload, wheel_pool_dispatch);
+        } else {
             // Create actual timer
-            entry->handle = xTimerCreate(name, period, auto_reload,
-                                       (void*)entry->id, callback);
+            entry->handle = xTimerCreate(name, period, auto_reload, (void*)id, pool_timer_trampoline);
+        }
 
-            if (entry->handle == NULL) {
-                entry->in_use = false;
-                entry = NULL;
-                health_data.failed_creations++;
-            } else {
-                health_data.total_timers_created++;
-            }
-            break;
+        if (backend != TIMER_BACKEND_WHEEL && entry->handle == NULL) {
+            entry->in_use = false;
+            pool_free_stack[pool_free_top++] = slot;
+            entry = NULL;
+            __atomic_fetch_add(&health_data.failed_creations, 1, __ATOMIC_RELAXED);
+        } else {
+            // publish ID หลังกรอก entry ครบ → callback ที่ lookup เจอจะเห็นข้อมูลสมบูรณ์
+            __atomic_store_n(&entry->id, id, __ATOMIC_RELEASE);
+            __atomic_fetch_add(&pool_used_count, 1, __ATOMIC_RELAXED);
+            __atomic_fetch_add(&health_data.total_timers_created, 1, __ATOMIC_RELAXED);
         }
     }
 
     if (entry == NULL) {
         ESP_LOGW(TAG, "Timer pool exhausted");
-        health_data.failed_creations++;
+        __atomic_fetch_add(&health_data.failed_creations, 1, __ATOMIC_RELAXED);
     }
 
     xSemaphoreGive(pool_mutex);
     return entry;
 }
 
+timer_pool_entry_t* allocate_from_pool(const char* name, TickType_t period,
+                                      bool auto_reload, TimerCallbackFunction_t callback,
+                                      void* context) {
+    return allocate_from_pool_backend(name, period, auto_reload, callback, context,
+                                      TIMER_POOL_DEFAULT_BACKEND);
+}
+
+// ⚠️ callback ของ wheel entry ได้ wheel_tick_timer เป็น handle — timer ตัวเดียวที่ขับ wheel ทั้งวง
+// ห้ามเรียก xTimerStop/Reset/ChangePeriod/Delete กับ handle นี้ ไม่งั้น wheel timer ทุกตัวหยุดตาม
+// ใน callback ใช้ pool_timer_id/pool_timer_period อ่านค่า และ timer_pool_stop/restart(entry) ควบคุมแทน
+timer_pool_entry_t* allocate_wheel_from_pool(const char* name, TickType_t period,
+                                            bool auto_reload, TimerCallbackFunction_t callback,
+                                            void* context) {
+    return allocate_from_pool_backend(name, period, auto_reload, callback, context,
+                                      TIMER_BACKEND_WHEEL);
+}
+
+// start/stop/restart แบบไม่สน backend
+BaseType_t timer_pool_start(timer_pool_entry_t* entry) {
+    __atomic_fetch_add(&entry->start_count, 1, __ATOMIC_RELAXED);
+    if (entry->backend == TIMER_BACKEND_WHEEL) {
+        wheel_timer_start(&timer_wheel, &entry->wheel, entry->period);
+        return wheel_tick_kick();
+    }
+
+    BaseType_t result = xTimerStart(entry->handle, 0);
+    timer_cmd_account(result);
+    return result;
+}
+
+BaseType_t timer_pool_stop(timer_pool_entry_t* entry) {
+    if (entry->backend == TIMER_BACKEND_WHEEL) {
+        wheel_timer_stop(&timer_wheel, &entry->wheel);
+        return pdPASS;
+    }
+
+    BaseType_t result = xTimerStop(entry->handle, pdMS_TO_TICKS(100));
+    timer_cmd_account(result);
+    return result;
+}
+
+BaseType_t timer_pool_restart(timer_pool_entry_t* entry) {
+    __atomic_fetch_add(&entry->start_count, 1, __ATOMIC_RELAXED);
+    if (entry->backend == TIMER_BACKEND_WHEEL) {
+        wheel_timer_restart(&timer_wheel, &entry->wheel);
+        return wheel_tick_kick();
+    }
+
+    BaseType_t result = xTimerReset(entry->handle, 0);
+    timer_cmd_account(result);
+    return result;
+}
+
+// heavy = ให้ offload executor รัน callback แทน timer service task
+void timer_pool_set_heavy(timer_pool_entry_t* entry, bool heavy) {
+    entry->heavy = heavy;
+}
+
+bool timer_pool_is_active(timer_pool_entry_t* entry) {
+    if (entry->backend == TIMER_BACKEND_WHEEL) {
+        return wheel_timer_pending(&entry->wheel);
+    }
+    return entry->handle != NULL && xTimerIsTimerActive(entry->handle);
+}
+
 void release_to_pool(uint32_t timer_id) {
     if (xSemaphoreTake(pool_mutex, pdMS_TO_TICKS(100)) != pdTRUE) {
         return;
     }
 
-    for (int i = 0; i < TIMER_POOL_SIZE; i++) {
-        if (timer_pool[i].in_use && timer_pool[i].id == timer_id) {
-            if (timer_pool[i].handle) {
-                xTimerDelete(timer_pool[i].handle, 0);
+    timer_pool_entry_t* entry = pool_entry_from_id(timer_id);
+    if (entry == NULL || entry == wheel_dispatch_entry) {
+        xSemaphoreGive(pool_mutex);
+        ESP_LOGW(TAG, "Release of %s timer 0x%08lx ignored",
+                 entry ? "running (own callback)" : "stale/unknown", (unsigned long)timer_id);
+        return;
+    }
+
+    if (entry->backend == TIMER_BACKEND_WHEEL) {
+        wheel_timer_stop(&timer_wheel, &entry->wheel);
+    }
+
+    // ปิด ID ก่อน → trampoline/daemon ส่งเข้า offload ไม่ได้อีก และ item ที่ค้างใน ring กลายเป็น stale
+    __atomic_store_n(&entry->id, 0, __ATOMIC_SEQ_CST);
+
+    // รอ worker ที่ยังรัน callback (หรือยังไม่หยิบ item เก่า) ให้เสร็จก่อนลบ handle / แจก slot ใหม่
+    while (__atomic_load_n(&entry->offload_pending, __ATOMIC_SEQ_CST) != 0) {
+        vTaskDelay(1);
+    }
+
+    if (entry->backend != TIMER_BACKEND_WHEEL && entry->handle) {
+        timer_cmd_account(xTimerDelete(entry->handle, 0));
+    }
+
+    // เปลี่ยน generation ก่อนคืน slot → ID เดิมใช้ไม่ได้อีก
+    entry->generation = (entry->generation + 1) & TIMER_POOL_GEN_MASK;
+    entry->in_use = false;
+    entry->handle = NULL;
+
+    uint32_t slot = (uint32_t)(entry - timer_pool);
+    pool_free_stack[pool_free_top++] = slot;
+    __atomic_fetch_sub(&pool_used_count, 1, __ATOMIC_RELAXED);
+
+    xSemaphoreGive(pool_mutex);
+    ESP_LOGI(TAG, "Released timer 0x%08lx (slot %lu) from pool", (unsigned long)timer_id, (unsigned long)slot);
+}
+
+// ================ CALLBACK OFFLOAD EXECUTOR ================
+// Bounded MPMC ring (Vyukov): เก็บ timer ID ไม่ใช่ pointer → worker ตรวจ generation ก่อนรันได้
+static void offload_ring_init(void) {
+    for (uint32_t i = 0; i < OFFLOAD_QUEUE_SIZE; i++) {
+        atomic_store_explicit(&offload_ring[i].seq, i, memory_order_relaxed);
+    }
+    atomic_store(&offload_enqueue_pos, 0);
+    atomic_store(&offload_dequeue_pos, 0);
+}
+
+static bool offload_ring_push(uint32_t timer_id) {
+    uint32_t pos = atomic_load_explicit(&offload_enqueue_pos, memory_order_relaxed);
+
+    while (1) {
+        offload_cell_t* cell = &offload_ring[pos & (OFFLOAD_QUEUE_SIZE - 1)];
+        uint32_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        int32_t diff = (int32_t)(seq - pos);
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&offload_enqueue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                cell->timer_id = timer_id;
+                atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+                return true;
             }
-            timer_pool[i].in_use = false;
-            timer_pool[i].handle = NULL;
-            ESP_LOGI(TAG, "Released timer %lu from pool", timer_id);
-            break;
+        } else if (diff < 0) {
+            return false;   // เต็ม
+        } else {
+            pos = atomic_load_explicit(&offload_enqueue_pos, memory_order_relaxed);
         }
     }
+}
 
-    xSemaphoreGive(pool_mutex);
+static bool offload_ring_pop(uint32_t* timer_id) {
+    uint32_t pos = atomic_load_explicit(&offload_dequeue_pos, memory_order_relaxed);
+
+    while (1) {
+        offload_cell_t* cell = &offload_ring[pos & (OFFLOAD_QUEUE_SIZE - 1)];
+        uint32_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        int32_t diff = (int32_t)(seq - (pos + 1));
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&offload_dequeue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                *timer_id = cell->timer_id;
+                atomic_store_explicit(&cell->seq, pos + OFFLOAD_QUEUE_SIZE, memory_order_release);
+                return true;
+            }
+        } else if (diff < 0) {
+            return false;   // ว่าง
+        } else {
+            pos = atomic_load_explicit(&offload_dequeue_pos, memory_order_relaxed);
+        }
+    }
+}
+
+// เรียกจาก daemon: ถ้ารอบก่อนยังค้าง (อยู่ในคิวหรือกำลังรัน) ให้ coalesce ทิ้ง
+static bool timer_offload_submit(timer_pool_entry_t* entry) {
+    if (__atomic_exchange_n(&entry->offload_pending, 1, __ATOMIC_SEQ_CST) != 0) {
+        __atomic_fetch_add(&offload_stats.coalesced, 1, __ATOMIC_RELAXED);
+        return false;
+    }
+
+    // ตั้ง pending ก่อนอ่าน ID (คู่กับ release_to_pool ที่ปิด ID ก่อนรอ pending) → ไม่มีทางหลุดไปหลัง release
+    uint32_t id = __atomic_load_n(&entry->id, __ATOMIC_SEQ_CST);
+    if (id == 0) {
+        __atomic_store_n(&entry->offload_pending, 0, __ATOMIC_RELEASE);
+        return false;   // กำลังถูกคืน pool
+    }
+
+    if (!offload_ring_push(id)) {
+        __atomic_store_n(&entry->offload_pending, 0, __ATOMIC_RELEASE);
+        __atomic_fetch_add(&offload_stats.coalesced, 1, __ATOMIC_RELAXED);
+        return false;
+    }
+
+    __atomic_fetch_add(&offload_stats.dispatched, 1, __ATOMIC_RELAXED);
+    xSemaphoreGive(offload_sem);
+    return true;
+}
+
+static void timer_offload_worker(void* parameter) {
+    while (1) {
+        xSemaphoreTake(offload_sem, portMAX_DELAY);
+
+        uint32_t timer_id;
+        if (!offload_ring_pop(&timer_id)) {
+            continue;
+        }
+
+        timer_pool_entry_t* entry = pool_entry_from_id(timer_id);
+        if (entry == NULL) {
+            // slot ถูกแจกใหม่ระหว่างรอคิว: ปลด pending ให้เจ้าของใหม่ (ระหว่างนี้ submit ของเขาถูก coalesce)
+            __atomic_store_n(&timer_pool[timer_id & TIMER_POOL_SLOT_MASK].offload_pending, 0, __ATOMIC_RELEASE);
+            __atomic_fetch_add(&offload_stats.stale, 1, __ATOMIC_RELAXED);
+            continue;
+        }
+
+        // release_to_pool รอ offload_pending ก่อนลบ handle จึงยัง valid; ID/period อ่านผ่าน wheel_dispatch_entry
+        TimerHandle_t handle = (entry->backend == TIMER_BACKEND_WHEEL) ? wheel_tick_timer : entry->handle;
+
+        int64_t start = esp_timer_get_time();
+        wheel_dispatch_entry = entry;
+        entry->callback(handle);
+        wheel_dispatch_entry = NULL;
+        uint32_t runtime_us = (uint32_t)(esp_timer_get_time() - start);
+
+        timer_record_runtime(entry, runtime_us);
+        __atomic_store_n(&entry->offload_pending, 0, __ATOMIC_RELEASE);
+
+        __atomic_fetch_add(&offload_stats.completed, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&offload_stats.busy_us, runtime_us, __ATOMIC_RELAXED);
+        uint32_t seen_max = __atomic_load_n(&offload_stats.max_us, __ATOMIC_RELAXED);
+        while (runtime_us > seen_max &&
+               !__atomic_compare_exchange_n(&offload_stats.max_us, &seen_max, runtime_us, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        }
+    }
+}
+
+void init_timer_offload(void) {
+    offload_ring_init();
+    offload_sem = xSemaphoreCreateCounting(OFFLOAD_QUEUE_SIZE, 0);
+
+    for (int i = 0; i < OFFLOAD_WORKER_COUNT; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "TmrOffload%d", i);
+        xTaskCreate(timer_offload_worker, name, OFFLOAD_WORKER_STACK, NULL,
+                    OFFLOAD_WORKER_PRIORITY, NULL);
+    }
+
+    ESP_LOGI(TAG, "Offload executor: %d workers @ prio %d, ring %d",
+             OFFLOAD_WORKER_COUNT, OFFLOAD_WORKER_PRIORITY, OFFLOAD_QUEUE_SIZE);
 }
 
 // ================ PERFORMANCE MONITORING ================
@@ -196,7 +1151,7 @@ void record_performance_sample(uint32_t timer_id, uint32_t duration_us, bool acc
         sample->accuracy_ok = accuracy_ok;
         sample->callback_start_time = esp_timer_get_time() / 1000; // Convert to ms
         sample->service_task_priority = uxTaskPriorityGet(NULL);
-        sample->queue_length = 0; // Would need special access to get this
+        sample->queue_length = daemon_stats.cmd_depth_last;
 
         perf_buffer_index = (perf_buffer_index + 1) % PERFORMANCE_BUFFER_SIZE;
 
@@ -208,6 +1163,18 @@ void record_performance_sample(uint32_t timer_id, uint32_t duration_us, bool acc
     }
 }
 
+static void print_timer_accuracy(const char* name, const timer_accuracy_t* acc, TickType_t period) {
+    if (acc->samples == 0) {
+        return;
+    }
+
+    ESP_LOGI(TAG, "    %-10s period=%lldμs actual=%lldμs drift=%+lldμs (max %lld) jitter p50=%luμs p99=%luμs max=%luμs n=%lu",
+             name, ticks_to_us(period), acc->interval_total_us / acc->samples,
+             acc->drift_us, acc->drift_max_abs_us,
+             timer_accuracy_percentile(acc, 50), timer_accuracy_percentile(acc, 99),
+             acc->jitter_max_us, acc->samples);
+}
+
 void analyze_performance(void) {
     if (xSemaphoreTake(perf_mutex, pdMS_TO_TICKS(100)) != pdTRUE) {
         return;
@@ -259,12 +1226,56 @@ void analyze_performance(void) {
     }
 
     xSemaphoreGive(perf_mutex);
+
+    // Timer service task: callback ที่กิน daemon นานจะดัน lag ของ timer อื่นขึ้นตาม
+    uint32_t callbacks = daemon_stats.callbacks;
+    if (callbacks > 0) {
+        ESP_LOGI(TAG, "  Timer Service: load=%lu%% callbacks=%lu avg=%luμs max=%luμs",
+                 health_data.service_task_load_percent, callbacks,
+                 (uint32_t)(daemon_stats.callback_busy_us / callbacks), daemon_stats.callback_max_us);
+        ESP_LOGI(TAG, "  Expiry Lag: avg=%lums max=%lums",
+                 (uint32_t)pdTICKS_TO_MS(daemon_stats.lag_total_ticks / callbacks),
+                 (uint32_t)pdTICKS_TO_MS(daemon_stats.lag_max_ticks));
+    }
+    // jitter ของ timer ปกติ: heavy รันใน daemon vs ถูก offload
+    for (int mode = 0; mode < 2; mode++) {
+        jitter_stats_t* js = &dispatch_jitter[mode];
+        if (js->samples > 0) {
+            ESP_LOGI(TAG, "  Jitter (heavy %s): avg=%luμs max=%luμs n=%lu",
+                     mode ? "offloaded" : "inline",
+                     (uint32_t)(js->jitter_total_us / js->samples), js->jitter_max_us, js->samples);
+        }
+    }
+    ESP_LOGI(TAG, "  Offload: dispatched=%lu done=%lu coalesced=%lu stale=%lu max=%luμs",
+             offload_stats.dispatched, offload_stats.completed, offload_stats.coalesced,
+             offload_stats.stale, offload_stats.max_us);
+    ESP_LOGI(TAG, "  Command Queue: depth≤%lu hwm≤%lu/%d posted=%lu full=%lu",
+             daemon_stats.cmd_depth_last, daemon_stats.cmd_depth_hwm, configTIMER_QUEUE_LENGTH,
+             __atomic_load_n(&daemon_stats.cmd_posted, __ATOMIC_RELAXED),
+             __atomic_load_n(&daemon_stats.cmd_queue_full, __ATOMIC_RELAXED));
+
+    for (int i = 0; i < TIMER_POOL_SIZE; i++) {
+        timer_pool_entry_t* entry = &timer_pool[i];
+        if (entry->in_use) {
+            ESP_LOGI(TAG, "    %-10s last=%luμs max=%luμs lag_max=%lums",
+                     entry->name, entry->runtime_last_us, entry->runtime_max_us,
+                     (uint32_t)pdTICKS_TO_MS(entry->lag_max_ticks));
+            print_timer_accuracy(entry->name, &entry->accuracy, entry->period);
+        }
+    }
+
+    for (int i = 0; i < UNPOOLED_ACCURACY_SLOTS; i++) {
+        if (unpooled_accuracy[i].handle != NULL) {
+            print_timer_accuracy(unpooled_accuracy[i].name, &unpooled_accuracy[i].accuracy,
+                                 unpooled_accuracy[i].period);
+        }
+    }
 }
 
 // ================ TIMER CALLBACKS ================
 void performance_test_callback(TimerHandle_t timer) {
-    uint32_t start_time = esp_timer_get_time();
-    uint32_t timer_id = (uint32_t)pvTimerGetTimerID(timer);
+    int64_t start_time = esp_timer_get_time();
+    uint32_t timer_id = pool_timer_id(timer);
 
     // Simulate variable processing time
     volatile uint32_t iterations = 100 + (esp_random() % 500);
@@ -273,30 +1284,33 @@ void performance_test_callback(TimerHandle_t timer) {
         __asm__ __volatile__("nop");
     }
 
-    uint32_t end_time = esp_timer_get_time();
-    uint32_t duration_us = end_time - start_time;
+    int64_t end_time = esp_timer_get_time();
+    uint32_t duration_us = (uint32_t)(end_time - start_time);
 
-    // Check accuracy (simplified)
-    static uint32_t last_callback_time = 0;
-    uint32_t expected_interval = pdTICKS_TO_MS(xTimerGetPeriod(timer)) * 1000; // μs
-    uint32_t actual_interval = start_time - last_callback_time;
-    bool accuracy_ok = true;
+    // Check accuracy ต่อ timer: pool entry ถูกบันทึกตอน dispatch แล้ว, timer นอก pool บันทึกที่นี่
+    timer_pool_entry_t* entry = pool_entry_from_id(timer_id);
+    TickType_t period = pool_timer_period(timer);
+    timer_accuracy_t* accuracy = NULL;
 
-    if (last_callback_time > 0) {
-        uint32_t accuracy_percent = (actual_interval * 100) / expected_interval;
-        accuracy_ok = (accuracy_percent >= 95 && accuracy_percent <= 105);
+    if (entry != NULL) {
+        accuracy = &entry->accuracy;
+    } else {
+        accuracy = unpooled_timer_accuracy(timer);
+        if (accuracy != NULL) {
+            timer_accuracy_record(accuracy, start_time, period, 0);
+        }
     }
 
-    last_callback_time = start_time;
+    bool accuracy_ok = true;
+    if (accuracy != NULL && accuracy->intervals > 0) {
+        accuracy_ok = timer_accuracy_within_tolerance(accuracy, period);
+    }
 
     record_performance_sample(timer_id, duration_us, accuracy_ok);
 
-    // Update timer stats
-    for (int i = 0; i < TIMER_POOL_SIZE; i++) {
-        if (timer_pool[i].in_use && timer_pool[i].id == timer_id) {
-            timer_pool[i].callback_count++;
-            break;
-        }
+    // Update timer stats (O(1) lookup จาก ID)
+    if (entry != NULL) {
+        __atomic_fetch_add(&entry->callback_count, 1, __ATOMIC_RELAXED);
     }
 }
 
@@ -312,19 +1326,18 @@ void stress_test_callback(TimerHandle_t timer) {
 }
 
 void health_monitor_callback(TimerHandle_t timer) {
+    timer_daemon_sample_queue();
+
     // Update health metrics
     health_data.free_heap_bytes = esp_get_free_heap_size();
 
     uint32_t active_count = 0;
-    uint32_t pool_used = 0;
+    uint32_t pool_used = __atomic_load_n(&pool_used_count, __ATOMIC_RELAXED);
 
     if (xSemaphoreTake(pool_mutex, pdMS_TO_TICKS(10)) == pdTRUE) {
         for (int i = 0; i < TIMER_POOL_SIZE; i++) {
-            if (timer_pool[i].in_use) {
-                pool_used++;
-                if (xTimerIsTimerActive(timer_pool[i].handle)) {
-                    active_count++;
-                }
+            if (timer_pool[i].in_use && timer_pool_is_active(&timer_pool[i])) {
+                active_count++;
             }
         }
         xSemaphoreGive(pool_mutex);
@@ -333,9 +1346,16 @@ void health_monitor_callback(TimerHandle_t timer) {
     health_data.active_timers = active_count;
     health_data.pool_utilization = (pool_used * 100) / TIMER_POOL_SIZE;
     health_data.dynamic_timers = dynamic_timer_count;
+    health_data.service_task_load_percent = timer_daemon_load_percent();
+
+    // lag ในรอบนี้ (reset ทุก interval) — callback ที่ช้าจะทำให้ timer อื่นยิงช้าตาม
+    uint32_t lag_ms = pdTICKS_TO_MS(daemon_stats.lag_window_max_ticks);
+    daemon_stats.lag_window_max_ticks = 0;
+    bool daemon_starving = lag_ms > DAEMON_LAG_WARN_MS ||
+                           health_data.service_task_load_percent > DAEMON_LOAD_WARN_PERCENT;
 
     // Health status LED
-    if (health_data.pool_utilization > 80 || health_data.callback_overruns > 10) {
+    if (health_data.pool_utilization > 80 || health_data.callback_overruns > 10 || daemon_starving) {
         gpio_set_level(HEALTH_LED, 1); // Warning
     } else {
         gpio_set_level(HEALTH_LED, 0);
@@ -347,6 +1367,15 @@ void health_monitor_callback(TimerHandle_t timer) {
     ESP_LOGI(TAG, "  Dynamic Timers: %lu/%d", health_data.dynamic_timers, DYNAMIC_TIMER_MAX);
     ESP_LOGI(TAG, "  Free Heap: %lu bytes", health_data.free_heap_bytes);
     ESP_LOGI(TAG, "  Failed Creations: %lu", health_data.failed_creations);
+    ESP_LOGI(TAG, "  Timing Wheel: pending=%lu fired=%lu max_batch=%lu cascades=%lu",
+             timer_wheel.pending, timer_wheel.fired_total,
+             timer_wheel.max_batch, timer_wheel.cascades);
+    ESP_LOGI(TAG, "  Timer Service: load=%lu%% lag_max=%lums queue≤%lu (hwm %lu)",
+             health_data.service_task_load_percent, lag_ms,
+             daemon_stats.cmd_depth_last, daemon_stats.cmd_depth_hwm);
+    if (daemon_starving) {
+        ESP_LOGW(TAG, "⚠️ Timer service starving: callbacks delay other timers by up to %lums", lag_ms);
+    }
 }
 
 // ==== (เพิ่มเพื่อ Exp4 เท่านั้น) Heavy callback เพื่อกระตุ้น overrun ====
@@ -361,7 +1390,7 @@ void heavy_overrun_callback(TimerHandle_t timer) {
     uint32_t duration_us = end_time - start_time;
 
     // นับ overrun ผ่าน record_performance_sample เพื่อคงรูปแบบเดิม
-    uint32_t id = (uint32_t)pvTimerGetTimerID(timer);
+    uint32_t id = pool_timer_id(timer);
     record_performance_sample(id, duration_us, true /* ไม่เช็ค accuracy ใน heavy test */);
 }
 
@@ -388,7 +1417,8 @@ TimerHandle_t create_dynamic_timer(const char* name, uint32_t period_ms,
 void cleanup_dynamic_timers(void) {
     for (uint32_t i = 0; i < dynamic_timer_count; i++) {
         if (dynamic_timers[i] != NULL) {
-            xTimerDelete(dynamic_timers[i], pdMS_TO_TICKS(100));
+            unpooled_timer_forget(dynamic_timers[i]);
+            timer_cmd_account(xTimerDelete(dynamic_timers[i], pdMS_TO_TICKS(100)));
             dynamic_timers[i] = NULL;
         }
     }
@@ -412,22 +1442,49 @@ void stress_test_task(void *parameter) {
                                             true, stress_test_callback, NULL);
 
         if (stress_timers[i] != NULL) {
-            xTimerStart(stress_timers[i]->handle, 0);
+            timer_pool_start(stress_timers[i]);
         }
 
         vTaskDelay(pdMS_TO_TICKS(100)); // Stagger creation
     }
 
     // Run stress test for 30 seconds
-    vTaskDelay(pdMS_TO_TICKS(30000));
+    // Heavy timers: 15s แรกรันใน daemon (inline), 15s หลัง offload → เทียบ jitter ของ stress timers
+    timer_offload_enabled = false;
+    memset(dispatch_jitter, 0, sizeof(dispatch_jitter));
+
+    timer_pool_entry_t* heavy_timers[2];
+    for (int i = 0; i < 2; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "Heavy%d", i);
+        heavy_timers[i] = allocate_from_pool(name, pdMS_TO_TICKS(250), true, heavy_overrun_callback, NULL);
+        if (heavy_timers[i] != NULL) {
+            timer_pool_set_heavy(heavy_timers[i], true);
+            timer_pool_start(heavy_timers[i]);
+        }
+    }
+
+    vTaskDelay(pdMS_TO_TICKS(15000));
+    analyze_performance();
+
+    ESP_LOGI(TAG, "🔀 Switching heavy callbacks to offload executor");
+    timer_offload_enabled = true;
+    vTaskDelay(pdMS_TO_TICKS(15000));
+    analyze_performance();
 
     // Clean up stress timers
     for (int i = 0; i < 10; i++) {
         if (stress_timers[i] != NULL) {
-            xTimerStop(stress_timers[i]->handle, pdMS_TO_TICKS(100));
+            timer_pool_stop(stress_timers[i]);
             release_to_pool(stress_timers[i]->id);
         }
     }
+    for (int i = 0; i < 2; i++) {
+        if (heavy_timers[i] != NULL) {
+            timer_pool_stop(heavy_timers[i]);
+            release_to_pool(heavy_timers[i]->id);
+        }
+    }
 
     ESP_LOGI(TAG, "Stress test completed");
 
@@ -439,7 +1496,7 @@ void stress_test_task(void *parameter) {
         TimerHandle_t dt = create_dynamic_timer(name, 200 + (i * 100),
                                               true, performance_test_callback);
         if (dt != NULL) {
-            xTimerStart(dt, 0);
+            timer_cmd_account(xTimerStart(dt, 0));
         }
     }
 
@@ -475,6 +1532,118 @@ void performance_analysis_task(void *parameter) {
     }
 }
 
+// ================ TIMING WHEEL BENCHMARK ================
+static volatile uint32_t wheel_bench_fired = 0;
+
+static void wheel_bench_callback(wheel_timer_t* t) {
+    wheel_bench_fired++;
+}
+
+static void wheel_bench_noop_callback(TimerHandle_t timer) {
+}
+
+// delay กระจาย 1..WHEEL_BENCH_MAX_DELAY แบบกำหนดได้ (ไม่เรียก esp_random ในช่วงจับเวลา)
+static inline TickType_t wheel_bench_delay(uint32_t i) {
+    return 1 + ((i * 2654435761u) >> 8) % WHEEL_BENCH_MAX_DELAY;
+}
+
+static void benchmark_xtimer_baseline(uint32_t n) {
+    TimerHandle_t* handles = heap_caps_calloc(n, sizeof(TimerHandle_t), MALLOC_CAP_8BIT);
+    if (handles == NULL) return;
+
+    uint32_t created = 0;
+    for (; created < n; created++) {
+        handles[created] = xTimerCreate("Bench", wheel_bench_delay(created), pdFALSE,
+                                        (void*)created, wheel_bench_noop_callback);
+        if (handles[created] == NULL) break;
+    }
+
+    // ทุกคำสั่งต้องผ่าน command queue ของ timer service task
+    int64_t t0 = esp_timer_get_time();
+    for (uint32_t i = 0; i < created; i++) {
+        timer_cmd_account(xTimerStart(handles[i], pdMS_TO_TICKS(100)));
+    }
+    int64_t t1 = esp_timer_get_time();
+    for (uint32_t i = 0; i < created; i++) {
+        timer_cmd_account(xTimerStop(handles[i], pdMS_TO_TICKS(100)));
+    }
+    int64_t t2 = esp_timer_get_time();
+
+    for (uint32_t i = 0; i < created; i++) {
+        timer_cmd_account(xTimerDelete(handles[i], pdMS_TO_TICKS(100)));
+    }
+    heap_caps_free(handles);
+
+    if (created > 0) {
+        ESP_LOGI(TAG, "  xTimer N=%6lu  start=%6lu ns/op  stop=%6lu ns/op", created,
+                 (uint32_t)((t1 - t0) * 1000 / created), (uint32_t)((t2 - t1) * 1000 / created));
+    }
+}
+
+void benchmark_timer_wheel(void) {
+    static const uint32_t counts[] = {100, 10000, 100000};
+
+    ESP_LOGI(TAG, "⏱️ Timing wheel start/stop benchmark (node=%lu bytes)",
+             (uint32_t)sizeof(wheel_timer_t));
+
+    // wheel แยกสำหรับวัด ไม่ถูก tick → วัดเฉพาะต้นทุน start/restart/stop
+    timer_wheel_t* w = heap_caps_malloc(sizeof(timer_wheel_t), MALLOC_CAP_8BIT);
+    if (w == NULL) {
+        ESP_LOGE(TAG, "No memory for benchmark wheel");
+        return;
+    }
+
+    for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+        uint32_t n = counts[c];
+
+        // 100k nodes ~2.4MB → ใช้ PSRAM ถ้ามี
+        wheel_timer_t* nodes = heap_caps_calloc(n, sizeof(wheel_timer_t), MALLOC_CAP_SPIRAM);
+        if (nodes == NULL) {
+            nodes = heap_caps_calloc(n, sizeof(wheel_timer_t), MALLOC_CAP_8BIT);
+        }
+        if (nodes == NULL) {
+            ESP_LOGW(TAG, "  wheel  N=%6lu  skipped (need %lu bytes)", n,
+                     (uint32_t)(n * sizeof(wheel_timer_t)));
+            continue;
+        }
+
+        timer_wheel_init(w);
+        for (uint32_t i = 0; i < n; i++) {
+            wheel_timer_init(&nodes[i], wheel_bench_delay(i), false, wheel_bench_callback);
+        }
+
+        int64_t t0 = esp_timer_get_time();
+        for (uint32_t i = 0; i < n; i++) {
+            wheel_timer_start(w, &nodes[i], nodes[i].period);
+        }
+        int64_t t1 = esp_timer_get_time();
+        for (uint32_t i = 0; i < n; i++) {
+            wheel_timer_restart(w, &nodes[i]);
+        }
+        int64_t t2 = esp_timer_get_time();
+        for (uint32_t i = 0; i < n; i++) {
+            wheel_timer_stop(w, &nodes[i]);
+        }
+        int64_t t3 = esp_timer_get_time();
+
+        ESP_LOGI(TAG, "  wheel  N=%6lu  start=%6lu ns/op  restart=%6lu ns/op  stop=%6lu ns/op",
+                 n, (uint32_t)((t1 - t0) * 1000 / n), (uint32_t)((t2 - t1) * 1000 / n),
+                 (uint32_t)((t3 - t2) * 1000 / n));
+
+        if (w->pending != 0) {
+            ESP_LOGE(TAG, "  wheel left %lu timers pending", w->pending);
+        }
+
+        if (n <= WHEEL_BENCH_XTIMER_MAX) {
+            benchmark_xtimer_baseline(n);
+        }
+
+        heap_caps_free(nodes);
+    }
+
+    heap_caps_free(w);
+}
+
 // ================ INITIALIZATION ================
 static void init_hardware(void) {
     gpio_set_direction(PERFORMANCE_LED, GPIO_MODE_OUTPUT);
@@ -514,8 +1683,8 @@ void create_system_timers(void) {
                                     performance_test_callback);
 
     if (health_monitor_timer && performance_timer) {
-        xTimerStart(health_monitor_timer, 0);
-        xTimerStart(performance_timer, 0);
+        timer_cmd_account(xTimerStart(health_monitor_timer, 0));
+        timer_cmd_account(xTimerStart(performance_timer, 0));
         ESP_LOGI(TAG, "System timers started");
     } else {
         ESP_LOGE(TAG, "Failed to create system timers");
@@ -528,12 +1697,13 @@ void app_main(void) {
     init_hardware();
     init_timer_pool();
     init_monitoring();
+    init_timer_offload();
 
     // สำหรับทุกโหมด: เปิด health monitor เสมอ
     health_monitor_timer = xTimerCreate("HealthMonitor",
                                        pdMS_TO_TICKS(HEALTH_CHECK_INTERVAL),
                                        pdTRUE, (void*)1, health_monitor_callback);
-    if (health_monitor_timer) xTimerStart(health_monitor_timer, 0);
+    if (health_monitor_timer) timer_cmd_account(xTimerStart(health_monitor_timer, 0));
 
 #if (EXPERIMENT == 1)
     // ── Experiment 1: Timer Pool Management ──
@@ -543,15 +1713,19 @@ void app_main(void) {
     timer_pool_entry_t* a = allocate_from_pool("PoolA", pdMS_TO_TICKS(200), true, performance_test_callback, NULL);
     timer_pool_entry_t* b = allocate_from_pool("PoolB", pdMS_TO_TICKS(300), true, performance_test_callback, NULL);
     timer_pool_entry_t* c = allocate_from_pool("PoolC", pdMS_TO_TICKS(500), true, performance_test_callback, NULL);
-    if (a) xTimerStart(a->handle, 0);
-    if (b) xTimerStart(b->handle, 0);
-    if (c) xTimerStart(c->handle, 0);
+    if (a) timer_pool_start(a);
+    if (b) timer_pool_start(b);
+    if (c) timer_pool_start(c);
+
+    // entry เดียวกันแต่แขวนบน timing wheel (ไม่มี xTimer ต่อ entry)
+    timer_pool_entry_t* w = allocate_wheel_from_pool("WheelD", pdMS_TO_TICKS(350), true, performance_test_callback, NULL);
+    if (w) timer_pool_start(w);
 
     // ทดสอบ dynamic timers
     TimerHandle_t d1 = create_dynamic_timer("Dyn1", 250, true, performance_test_callback);
     TimerHandle_t d2 = create_dynamic_timer("Dyn2", 400, true, performance_test_callback);
-    if (d1) xTimerStart(d1, 0);
-    if (d2) xTimerStart(d2, 0);
+    if (d1) timer_cmd_account(xTimerStart(d1, 0));
+    if (d2) timer_cmd_account(xTimerStart(d2, 0));
 
     // วิเคราะห์เป็นระยะ
     xTaskCreate(performance_analysis_task, "PerfAnalysis", 3072, NULL, 8, NULL);
@@ -565,7 +1739,7 @@ void app_main(void) {
                                     pdMS_TO_TICKS(500),
                                     pdTRUE, (void*)2,
                                     performance_test_callback);
-    if (performance_timer) xTimerStart(performance_timer, 0);
+    if (performance_timer) timer_cmd_account(xTimerStart(performance_timer, 0));
 
     xTaskCreate(performance_analysis_task, "PerfAnalysis", 3072, NULL, 8, NULL);
 
@@ -583,14 +1757,14 @@ void app_main(void) {
     // 1) เปิดชุดปกติ
     timer_pool_entry_t* n1 = allocate_from_pool("N1", pdMS_TO_TICKS(200), true, performance_test_callback, NULL);
     timer_pool_entry_t* n2 = allocate_from_pool("N2", pdMS_TO_TICKS(300), true, performance_test_callback, NULL);
-    if (n1) xTimerStart(n1->handle, 0);
-    if (n2) xTimerStart(n2->handle, 0);
+    if (n1) timer_pool_start(n1);
+    if (n2) timer_pool_start(n2);
 
     // 2) Inject heavy timers ให้เกิด overrun / warning
     TimerHandle_t h1 = xTimerCreate("Heavy1", pdMS_TO_TICKS(250), pdTRUE, (void*)next_timer_id++, heavy_overrun_callback);
     TimerHandle_t h2 = xTimerCreate("Heavy2", pdMS_TO_TICKS(250), pdTRUE, (void*)next_timer_id++, heavy_overrun_callback);
-    if (h1) xTimerStart(h1, 0);
-    if (h2) xTimerStart(h2, 0);
+    if (h1) timer_cmd_account(xTimerStart(h1, 0));
+    if (h2) timer_cmd_account(xTimerStart(h2, 0));
 
     // 3) เปิด analysis task เพื่อติดตามรายงาน
     xTaskCreate(performance_analysis_task, "PerfAnalysis", 3072, NULL, 8, NULL);
@@ -600,15 +1774,15 @@ void app_main(void) {
         [](void*){
             vTaskDelay(pdMS_TO_TICKS(8000));
             ESP_LOGW(TAG, "[EXP4] Recovery: stopping heavy timers...");
-            if (h1) xTimerStop(h1, 0), xTimerDelete(h1, 0);
-            if (h2) xTimerStop(h2, 0), xTimerDelete(h2, 0);
+            if (h1) timer_cmd_account(xTimerStop(h1, 0)), timer_cmd_account(xTimerDelete(h1, 0));
+            if (h2) timer_cmd_account(xTimerStop(h2, 0)), timer_cmd_account(xTimerDelete(h2, 0));
 
             // Reset ตัวชี้วัดบางส่วน (แค่ตัวช่วยอ่านค่า)
             health_data.callback_overruns = 0;
 
             // สร้างชุดปกติใหม่
             timer_pool_entry_t* r1 = allocate_from_pool("R1", pdMS_TO_TICKS(300), true, performance_test_callback, NULL);
-            if (r1) xTimerStart(r1->handle, 0);
+            if (r1) timer_pool_start(r1);
 
             ESP_LOGI(TAG, "[EXP4] Recovery done.");
             vTaskDelete(NULL);
@@ -616,8 +1790,25 @@ void app_main(void) {
         "Recovery", 3072, NULL, 6, NULL
     );
 
+#elif (EXPERIMENT == 5)
+    // ── Experiment 5: Timing Wheel Scale Benchmark ──
+    ESP_LOGI(TAG, "[EXP5] Timing Wheel vs xTimer");
+
+    benchmark_timer_wheel();
+
+    // เติม pool ด้วย wheel entries แล้วดู batch ต่อ tick ใน health monitor
+    for (int i = 0; i < TIMER_POOL_SIZE; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "Wheel%d", i);
+        timer_pool_entry_t* e = allocate_wheel_from_pool(name, pdMS_TO_TICKS(100 + (i % 4) * 50),
+                                                         true, stress_test_callback, NULL);
+        if (e) timer_pool_start(e);
+    }
+
+    xTaskCreate(performance_analysis_task, "PerfAnalysis", 3072, NULL, 8, NULL);
+
 #else
-    #error "Set EXPERIMENT to 1..4"
+    #error "Set EXPERIMENT to 1..5"
 #endif
 
     ESP_LOGI(TAG, "🚀 Advanced Timer Management System Running (EXP=%d)", EXPERIMENT);
@@ -2,6 +2,8 @@
 #include <stdint.h>
 #include <string.h>
 #include <math.h>
+#include <stdatomic.h>
+#include "sdkconfig.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
@@ -10,9 +12,23 @@
 #include "esp_heap_caps.h"
 #include "esp_timer.h"
 #include "esp_system.h"
-#include "driver/gpio.h"
 #include "esp_random.h"
 
+#if CONFIG_IDF_TARGET_LINUX
+#include <malloc.h>   // malloc_info: free-chunk bins ของ glibc แทน heap_caps_walk
+// Host build (idf.py --preview set-target linux): ไม่มี GPIO ให้ LED เป็น no-op
+typedef int gpio_num_t;
+#define GPIO_NUM_2   2
+#define GPIO_NUM_4   4
+#define GPIO_NUM_5   5
+#define GPIO_NUM_18  18
+#define GPIO_NUM_19  19
+#define gpio_set_direction(pin, mode)  ((void)(pin))
+#define gpio_set_level(pin, level)     ((void)(pin), (void)(level))
+#else
+#include "driver/gpio.h"
+#endif
+
 static const char *TAG = "HEAP_MGMT";
 
 // GPIO สำหรับแสดงสถานะ
@@ -26,7 +42,85 @@ static const char *TAG = "HEAP_MGMT";
 #define LOW_MEMORY_THRESHOLD    50000    // 50KB
 #define CRITICAL_MEMORY_THRESHOLD 20000  // 20KB
 #define FRAGMENTATION_THRESHOLD 0.3      // 30% fragmentation
-#define MAX_ALLOCATIONS         100
+
+// Allocation tracking: hash index (open addressing, linear probing) keyed ด้วย pointer
+// ขนาด index เป็น 2 เท่าของจำนวน record → load factor <= 0.5, probe สั้นเสมอ
+#if CONFIG_IDF_TARGET_LINUX
+#define ALLOC_INDEX_BITS        16       // 32768 live allocations (host)
+#else
+#define ALLOC_INDEX_BITS        10       // 512 live allocations (~20KB DRAM)
+#endif
+#define ALLOC_INDEX_SIZE        (1U << ALLOC_INDEX_BITS)
+#define ALLOC_INDEX_EMPTY       (-1)
+#define MAX_ALLOCATIONS         (ALLOC_INDEX_SIZE / 2)
+#define MAX_PRINTED_ALLOCATIONS 20       // summary แสดงรายการ active แค่นี้
+
+// Call-site profiler: รวมสถิติต่อ site แทนการ log ทุก allocation
+#define PROFILE_KEY_BY_CALLER   1        // 1 = key ด้วย return address ของผู้เรียก, 0 = key ด้วย tag (description)
+#define PROFILE_SITE_BITS       6
+#define MAX_ALLOC_SITES         (1 << PROFILE_SITE_BITS)   // + 1 site "(other)" เมื่อ table เต็ม
+#define PROFILE_LABEL_LEN       16
+#define PROFILE_TOP_SITES       10       // แสดงใน summary
+#define PROFILE_SNAPSHOT_EVERY  6        // dump binary snapshot ทุก N รอบของ monitor (~60 s)
+#define PROFILE_HEX_PER_LINE    64       // bytes ต่อบรรทัดตอน dump เป็น hex
+#define PROFILE_SNAPSHOT_MAGIC  0x31535048U  // "HPS1" (little-endian)
+#define PROFILE_SNAPSHOT_VERSION 1
+
+// Allocation event log: tracked_malloc/free ใส่ event ลง ring แบบ lock-free (นอก memory_mutex)
+// แล้ว logger task ความสำคัญต่ำเป็นคนพิมพ์ — hot path ไม่ต้องรอ UART
+#define EVENT_RING_SIZE         256      // power of 2
+#define EVENT_SAMPLE_EVERY      16       // เก็บ 1 ใน N events (1 = ทุก event, 0 = ปิด) ปรับตอน runtime ได้
+#define EVENT_LOGGER_PERIOD_MS  100
+#define EVENT_LOGGER_BATCH      32       // events ที่พิมพ์ต่อรอบสูงสุด (ไม่ยึด UART นาน)
+#define EVENT_LOGGER_PRIORITY   2        // ต่ำกว่า test tasks ทุกตัว
+#define EVENT_BENCH_PAIRS       5000
+
+// Fragmentation analyzer: เดิน heap ทีละ region (ถือ heap lock แค่ region เดียวต่อครั้ง)
+// สร้าง histogram ขนาด free block ต่อ capability เก็บย้อนหลังไว้ดูแนวโน้ม/ทำนาย allocation failure
+#define FRAG_HIST_BUCKETS       16       // bucket b = [16 << b, 32 << b) bytes, bucket 0 รวม block < 16 B, bucket สุดท้ายรวมที่เหลือ
+#define FRAG_MIN_BLOCK_SHIFT    4
+#define FRAG_STEP_MS            20       // พักระหว่าง region
+#define FRAG_CYCLE_MS           5000     // วิเคราะห์ครบทุก caps แล้วพัก
+#define FRAG_MAX_BLOCKS_PER_STEP 2048    // กัน region ใหญ่ถือ lock นาน (เกินแล้วหยุด นับเป็น truncated)
+#define FRAG_TREND_DEPTH        12       // ~1 นาทีย้อนหลัง
+#define FRAG_PREDICT_SIZE       16384    // ขนาดที่ report ทำนายให้
+#define FRAG_PREDICT_HORIZON_S  60
+#define FRAG_ANALYZER_PRIORITY  1
+
+// Leak detector (generational): record เก็บ epoch ที่ถูกใช้ล่าสุด (alloc หรือ heap_touch)
+// detect_memory_leaks หนึ่งรอบ = หนึ่ง epoch, ไม่ถูกแตะครบ LEAK_SUSPECT_EPOCHS รอบ = สงสัยว่า leak
+#define LEAK_SUSPECT_EPOCHS     3        // ~30 s เมื่อ monitor รันทุก 10 s
+#define LEAK_SCAN_SLICE         32       // records ต่อการถือ mutex หนึ่งครั้ง (pause ไม่กี่ µs)
+
+// Tracking overhead benchmark (รันครั้งเดียวตอนเริ่ม)
+#define TRACKING_BENCH_ENABLED  1
+#define TRACKING_BENCH_PAIRS    2000     // malloc/free pairs ต่อการวัด
+
+// Fragmentation snapshot ของหนึ่ง capability
+typedef struct {
+    uint64_t timestamp;
+    uint32_t free_blocks[FRAG_HIST_BUCKETS];
+    uint32_t used_blocks;
+    size_t total_free;
+    size_t largest_free;
+    uint16_t regions;
+    bool truncated;
+} frag_snapshot_t;
+
+typedef struct {
+    const char* name;
+    uint32_t caps;
+    frag_snapshot_t trend[FRAG_TREND_DEPTH];   // ring, trend_next = ช่องถัดไป
+    int trend_count;
+    int trend_next;
+} frag_cap_state_t;
+
+typedef struct {
+    uint32_t fits_now;                   // allocation ขนาดนี้ที่ใส่ได้ตอนนี้ (ประมาณแบบ conservative)
+    float fits_per_min;                  // แนวโน้มจาก linear regression ของ trend
+    int32_t seconds_to_failure;          // -1 = ไม่มีแนวโน้มลดลง
+    bool ok_within_horizon;
+} frag_prediction_t;
 
 // Memory allocation tracking
 typedef struct {
@@ -35,9 +129,74 @@ typedef struct {
     uint32_t caps;
     const char* description;
     uint64_t timestamp;
+    uint16_t touch_epoch;                // leak_epoch ตอน alloc / heap_touch ครั้งล่าสุด
+    uint8_t site;                        // index ใน alloc_sites[]
     bool is_active;
 } memory_allocation_t;
 
+// Allocation event (ring buffer entry)
+typedef enum {
+    ALLOC_EVENT_ALLOC,
+    ALLOC_EVENT_FREE,
+    ALLOC_EVENT_FAIL,
+} alloc_event_type_t;
+
+typedef struct {
+    uint64_t timestamp;
+    void* ptr;
+    uint32_t size;
+    int16_t slot;
+    uint8_t site;                        // label อ่านจาก alloc_sites[] (ไม่เก็บ description ที่อาจอยู่บน stack)
+    uint8_t type;
+} alloc_event_t;
+
+typedef struct {
+    atomic_uint seq;                     // ลำดับของ cell (bounded MPMC queue แบบ Vyukov)
+    alloc_event_t event;
+} event_cell_t;
+
+// Per call-site aggregate
+typedef struct {
+    uint32_t key;                        // caller PC หรือ hash ของ tag (0 = ช่องว่าง)
+    char label[PROFILE_LABEL_LEN];       // tag แรกที่เห็น (copy เพราะ description อาจอยู่บน stack)
+    uint32_t live_bytes;
+    uint32_t live_count;
+    uint32_t peak_live_bytes;
+    uint32_t total_allocs;
+    uint32_t total_frees;
+    uint32_t ops_at_sample;              // allocs + frees ตอนคำนวณ churn ครั้งก่อน
+    float churn_per_sec;
+} alloc_site_t;
+
+// Binary snapshot (packed, little-endian) — host diff ด้วย tools/heap_profile_diff.py
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t site_count;
+    uint64_t timestamp_us;
+    uint32_t current_allocations;
+    uint32_t tracking_overflows;
+} profile_snapshot_header_t;
+
+typedef struct __attribute__((packed)) {
+    uint32_t key;
+    char label[PROFILE_LABEL_LEN];
+    uint32_t live_bytes;
+    uint32_t live_count;
+    uint32_t peak_live_bytes;
+    uint32_t total_allocs;
+    uint32_t total_frees;
+    float churn_per_sec;
+} profile_snapshot_site_t;
+
+// Suspected leaks รวมต่อ site (สะสมระหว่าง sweep)
+typedef struct {
+    uint32_t count;
+    uint32_t bytes;
+    uint16_t max_idle_epochs;
+    void* example;                       // record ที่ idle นานที่สุด
+} leak_site_summary_t;
+
 // Memory statistics
 typedef struct {
     uint32_t total_allocations;
@@ -49,47 +208,284 @@ typedef struct {
     uint32_t allocation_failures;
     uint32_t fragmentation_events;
     uint32_t low_memory_events;
+    uint32_t tracking_overflows;         // allocation ที่ไม่ได้ track เพราะ table เต็ม
+    uint32_t stale_records;              // record ค้าง (free ตอน mutex timeout) ถูกทับด้วย pointer ซ้ำ
+    uint32_t untracked_frees;            // free pointer ที่ไม่มี record
 } memory_stats_t;
 
 // Global variables
 static memory_allocation_t allocations[MAX_ALLOCATIONS];
+static int32_t alloc_index[ALLOC_INDEX_SIZE];        // ptr hash -> slot ใน allocations[]
+static int32_t free_slots[MAX_ALLOCATIONS];          // stack ของ slot ว่าง
+static int32_t free_slot_count;
+static alloc_site_t alloc_sites[MAX_ALLOC_SITES + 1];   // [MAX_ALLOC_SITES] = "(other)"
+static uint64_t profile_sample_us;
+static uint16_t leak_epoch;                          // เพิ่มทุก sweep ของ leak detector (แก้ภายใต้ memory_mutex)
+static uint32_t leak_max_pause_us;                   // mutex hold นานสุดของ sweep ล่าสุด
+
+// Event ring: หลาย producer (ทุก task ที่ allocate), consumer เดียว (logger task)
+static event_cell_t event_ring[EVENT_RING_SIZE];
+static atomic_uint event_head;
+static uint32_t event_tail;
+static atomic_uint event_sample_every = EVENT_SAMPLE_EVERY;
+static atomic_uint event_sample_counter;
+static atomic_uint events_recorded;
+static atomic_uint events_dropped;
 static memory_stats_t stats = {0};
 static SemaphoreHandle_t memory_mutex;
 static bool memory_monitoring_enabled = true;
 
-// Memory monitoring functions
-int find_free_allocation_slot(void) {
+// Tracking setup (app_main และ benchmark harness ของ lab4 เรียกใช้)
+bool heap_tracking_init(void) {
+    if (!memory_mutex) {
+        memory_mutex = xSemaphoreCreateMutex();
+        if (!memory_mutex) return false;
+    }
+    memset(allocations, 0, sizeof(allocations));
+    memset(alloc_index, 0xFF, sizeof(alloc_index));  // ALLOC_INDEX_EMPTY ทุกช่อง
+    // slot ต่ำสุดอยู่บนสุดของ stack: ลำดับเหมือน table เดิม
     for (int i = 0; i < MAX_ALLOCATIONS; i++) {
-        if (!allocations[i].is_active) {
-            return i;
+        free_slots[i] = MAX_ALLOCATIONS - 1 - i;
+    }
+    free_slot_count = MAX_ALLOCATIONS;
+    memset(alloc_sites, 0, sizeof(alloc_sites));
+    strcpy(alloc_sites[MAX_ALLOC_SITES].label, "(other)");
+    profile_sample_us = esp_timer_get_time();
+    for (int i = 0; i < EVENT_RING_SIZE; i++) {
+        atomic_init(&event_ring[i].seq, i);
+    }
+    atomic_store(&event_head, 0);
+    event_tail = 0;
+    return true;
+}
+
+// ====== Allocation event ring (lock-free) ======
+static bool event_push(const alloc_event_t* event) {
+    uint32_t pos = atomic_load_explicit(&event_head, memory_order_relaxed);
+    event_cell_t* cell;
+    for (;;) {
+        cell = &event_ring[pos & (EVENT_RING_SIZE - 1)];
+        uint32_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        int32_t diff = (int32_t)(seq - pos);
+        if (diff == 0) {
+            // จอง cell ด้วย CAS — แพ้ก็ได้ pos ใหม่กลับมาลองต่อ
+            if (atomic_compare_exchange_weak_explicit(&event_head, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            atomic_fetch_add_explicit(&events_dropped, 1, memory_order_relaxed);  // ring เต็ม: ทิ้ง ไม่รอ
+            return false;
+        } else {
+            pos = atomic_load_explicit(&event_head, memory_order_relaxed);
         }
     }
-    return -1;
+    cell->event = *event;
+    atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+    atomic_fetch_add_explicit(&events_recorded, 1, memory_order_relaxed);
+    return true;
 }
 
-int find_allocation_by_ptr(void* ptr) {
-    for (int i = 0; i < MAX_ALLOCATIONS; i++) {
-        if (allocations[i].is_active && allocations[i].ptr == ptr) {
-            return i;
+// consumer เดียวเท่านั้น (logger task หรือ benchmark ก่อน logger เริ่ม)
+static bool event_pop(alloc_event_t* event) {
+    event_cell_t* cell = &event_ring[event_tail & (EVENT_RING_SIZE - 1)];
+    uint32_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+    if ((int32_t)(seq - (event_tail + 1)) < 0) return false;
+    *event = cell->event;
+    atomic_store_explicit(&cell->seq, event_tail + EVENT_RING_SIZE, memory_order_release);
+    event_tail++;
+    return true;
+}
+
+static void event_record(alloc_event_type_t type, void* ptr, uint32_t size, int slot, int site) {
+    if (type != ALLOC_EVENT_FAIL) {
+        // sampling: failure เก็บทุกครั้ง, alloc/free เก็บ 1 ใน N
+        uint32_t every = atomic_load_explicit(&event_sample_every, memory_order_relaxed);
+        if (every == 0) return;
+        if (every > 1 &&
+            atomic_fetch_add_explicit(&event_sample_counter, 1, memory_order_relaxed) % every != 0) {
+            return;
+        }
+    }
+    alloc_event_t event = {
+        .timestamp = esp_timer_get_time(),
+        .ptr = ptr,
+        .size = size,
+        .slot = slot,
+        .site = site,
+        .type = type,
+    };
+    event_push(&event);
+}
+
+void heap_event_set_sampling(uint32_t every_n) {
+    atomic_store_explicit(&event_sample_every, every_n, memory_order_relaxed);
+}
+
+// ทิ้ง event ค้าง (benchmark ตอนเริ่ม ก่อนมี logger task เท่านั้น)
+static void event_discard_all(void) {
+    alloc_event_t event;
+    while (event_pop(&event)) {
+    }
+}
+
+// ====== Allocation index (caller must hold memory_mutex) ======
+static inline uint32_t alloc_hash(const void* ptr) {
+    // Fibonacci hashing: บิตล่างของ heap pointer เป็น 0 เสมอ (align 8) จึงตัดทิ้งก่อนคูณ
+    uint64_t key = (uint64_t)(uintptr_t)ptr >> 3;
+    return ((uint32_t)(key ^ (key >> 32)) * 2654435769U) >> (32 - ALLOC_INDEX_BITS);
+}
+
+// คืนตำแหน่งใน alloc_index ที่เก็บ ptr หรือ -1
+static int index_lookup(const void* ptr) {
+    for (uint32_t pos = alloc_hash(ptr);; pos = (pos + 1) & (ALLOC_INDEX_SIZE - 1)) {
+        int32_t slot = alloc_index[pos];
+        if (slot == ALLOC_INDEX_EMPTY) return -1;
+        if (allocations[slot].ptr == ptr) return (int)pos;
+    }
+}
+
+static void index_insert(const void* ptr, int slot) {
+    uint32_t pos = alloc_hash(ptr);
+    while (alloc_index[pos] != ALLOC_INDEX_EMPTY) {
+        pos = (pos + 1) & (ALLOC_INDEX_SIZE - 1);
+    }
+    alloc_index[pos] = slot;
+}
+
+// ลบแบบ backward shift: ไม่มี tombstone, probe chain ไม่ยาวขึ้นเรื่อย ๆ
+static void index_remove(uint32_t pos) {
+    uint32_t hole = pos;
+    for (uint32_t next = (pos + 1) & (ALLOC_INDEX_SIZE - 1);
+         alloc_index[next] != ALLOC_INDEX_EMPTY;
+         next = (next + 1) & (ALLOC_INDEX_SIZE - 1)) {
+        uint32_t home = alloc_hash(allocations[alloc_index[next]].ptr);
+        // ย้ายได้ถ้า home ของ entry ไม่อยู่ในช่วง (hole, next] แบบวนรอบ
+        if (((next - home) & (ALLOC_INDEX_SIZE - 1)) >= ((next - hole) & (ALLOC_INDEX_SIZE - 1))) {
+            alloc_index[hole] = alloc_index[next];
+            hole = next;
         }
     }
-    return -1;
+    alloc_index[hole] = ALLOC_INDEX_EMPTY;
 }
 
+static void release_allocation_slot(int slot) {
+    allocations[slot].is_active = false;
+    free_slots[free_slot_count++] = slot;
+}
+
+// ====== Call-site profiler (caller must hold memory_mutex) ======
+#if !PROFILE_KEY_BY_CALLER
+static uint32_t tag_hash(const char* tag) {
+    // FNV-1a: tag เดียวกันได้ key เดียวกันแม้ string อยู่คนละ address
+    uint32_t h = 2166136261U;
+    while (tag && *tag) {
+        h = (h ^ (uint8_t)*tag++) * 16777619U;
+    }
+    return h;
+}
+#endif
+
+static int site_lookup(uint32_t key, const char* description) {
+    if (key == 0) key = 1;
+    uint32_t pos = (key * 2654435769U) >> (32 - PROFILE_SITE_BITS);
+    for (int probes = 0; probes < MAX_ALLOC_SITES; probes++) {
+        alloc_site_t* site = &alloc_sites[pos];
+        if (site->key == key) return pos;
+        if (site->key == 0) {
+            site->key = key;
+            strncpy(site->label, description ? description : "?", PROFILE_LABEL_LEN - 1);
+            return pos;
+        }
+        pos = (pos + 1) & (MAX_ALLOC_SITES - 1);
+    }
+    return MAX_ALLOC_SITES;  // table เต็ม: รวมไว้ที่ "(other)"
+}
+
+static void site_record_alloc(int site_index, size_t size) {
+    alloc_site_t* site = &alloc_sites[site_index];
+    site->live_bytes += size;
+    site->live_count++;
+    site->total_allocs++;
+    if (site->live_bytes > site->peak_live_bytes) {
+        site->peak_live_bytes = site->live_bytes;
+    }
+}
+
+static void site_record_free(int slot) {
+    alloc_site_t* site = &alloc_sites[allocations[slot].site];
+    site->live_bytes -= allocations[slot].size;
+    site->live_count--;
+    site->total_frees++;
+}
+
+static void profile_update_churn(void) {
+    uint64_t now = esp_timer_get_time();
+    float dt = (now - profile_sample_us) / 1000000.0f;
+    if (dt <= 0) return;
+    for (int i = 0; i <= MAX_ALLOC_SITES; i++) {
+        alloc_site_t* site = &alloc_sites[i];
+        uint32_t ops = site->total_allocs + site->total_frees;
+        site->churn_per_sec = (ops - site->ops_at_sample) / dt;
+        site->ops_at_sample = ops;
+    }
+    profile_sample_us = now;
+}
+
+// Memory monitoring functions
+// หยิบ slot ว่างจาก stack (O(1)) — slot ถูกจองทันที
+int find_free_allocation_slot(void) {
+    return free_slot_count > 0 ? free_slots[--free_slot_count] : -1;
+}
+
+int find_allocation_by_ptr(void* ptr) {
+    int pos = index_lookup(ptr);
+    return pos >= 0 ? alloc_index[pos] : -1;
+}
+
+// noinline: __builtin_return_address(0) ต้องเป็น call site จริง ไม่ใช่ของฟังก์ชันที่ inline เข้าไป
+__attribute__((noinline))
 void* tracked_malloc(size_t size, uint32_t caps, const char* description) {
+#if PROFILE_KEY_BY_CALLER
+    uint32_t site_key = (uint32_t)(uintptr_t)__builtin_return_address(0);
+#if CONFIG_IDF_TARGET_ARCH_XTENSA
+    site_key = (site_key & 0x3FFFFFFF) | 0x40000000;  // ตัด window-size bits ของ Xtensa ออกให้ addr2line ใช้ได้
+#endif
+#else
+    uint32_t site_key = tag_hash(description);
+#endif
     void* ptr = heap_caps_malloc(size, caps);
     
     if (memory_monitoring_enabled && memory_mutex) {
+        int slot = -1;
+        int site = MAX_ALLOC_SITES;
         if (xSemaphoreTake(memory_mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
+            site = site_lookup(site_key, description);
             if (ptr) {
-                int slot = find_free_allocation_slot();
+                // pointer ซ้ำกับ record ค้าง (free ครั้งก่อน track ไม่ทัน) → ทิ้ง record เก่า
+                int stale = index_lookup(ptr);
+                if (stale >= 0) {
+                    int stale_slot = alloc_index[stale];
+                    stats.current_allocations--;
+                    stats.total_bytes_deallocated += allocations[stale_slot].size;
+                    stats.stale_records++;
+                    site_record_free(stale_slot);
+                    index_remove(stale);
+                    release_allocation_slot(stale_slot);
+                }
+                
+                slot = find_free_allocation_slot();
                 if (slot >= 0) {
                     allocations[slot].ptr = ptr;
                     allocations[slot].size = size;
                     allocations[slot].caps = caps;
                     allocations[slot].description = description;
                     allocations[slot].timestamp = esp_timer_get_time();
+                    allocations[slot].touch_epoch = leak_epoch;
+                    allocations[slot].site = site;
                     allocations[slot].is_active = true;
+                    index_insert(ptr, slot);
+                    site_record_alloc(allocations[slot].site, size);
                     
                     stats.total_allocations++;
                     stats.current_allocations++;
@@ -101,17 +497,24 @@ void* tracked_malloc(size_t size, uint32_t caps, const char* description) {
                         stats.peak_usage = current_usage;
                     }
                     
-                    ESP_LOGI(TAG, "✅ Allocated %d bytes at %p (%s) - Slot %d", 
-                             size, ptr, description, slot);
                 } else {
-                    ESP_LOGW(TAG, "⚠️ Allocation tracking full!");
+                    // เตือนครั้งแรกและทุก ๆ 1024 ครั้ง (ไม่ท่วม log ตอนโหลดหนัก)
+                    if ((stats.tracking_overflows++ & 1023) == 0) {
+                        ESP_LOGW(TAG, "⚠️ Allocation tracking full! (%lu untracked)", (unsigned long)stats.tracking_overflows);
+                    }
                 }
             } else {
                 stats.allocation_failures++;
-                ESP_LOGE(TAG, "❌ Failed to allocate %d bytes (%s)", size, description);
             }
             
             xSemaphoreGive(memory_mutex);
+            
+            // หลังปล่อย mutex: logger task เป็นคนพิมพ์
+            if (!ptr) {
+                event_record(ALLOC_EVENT_FAIL, NULL, size, -1, site);
+            } else if (slot >= 0) {
+                event_record(ALLOC_EVENT_ALLOC, ptr, size, slot, site);
+            }
         }
     }
     
@@ -123,26 +526,297 @@ void tracked_free(void* ptr, const char* description) {
     
     if (memory_monitoring_enabled && memory_mutex) {
         if (xSemaphoreTake(memory_mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
-            int slot = find_allocation_by_ptr(ptr);
-            if (slot >= 0) {
-                allocations[slot].is_active = false;
+            int slot = -1;
+            int site = 0;
+            uint32_t size = 0;
+            int pos = index_lookup(ptr);
+            if (pos >= 0) {
+                slot = alloc_index[pos];
+                site = allocations[slot].site;
+                size = allocations[slot].size;
+                site_record_free(slot);
+                index_remove(pos);
+                release_allocation_slot(slot);
                 stats.total_deallocations++;
                 stats.current_allocations--;
-                stats.total_bytes_deallocated += allocations[slot].size;
-                
-                ESP_LOGI(TAG, "🗑️ Freed %d bytes at %p (%s) - Slot %d", 
-                         allocations[slot].size, ptr, description, slot);
-            } else {
+                stats.total_bytes_deallocated += size;
+            } else if ((stats.untracked_frees++ & 1023) == 0) {
                 ESP_LOGW(TAG, "⚠️ Freeing untracked pointer %p (%s)", ptr, description);
             }
             
             xSemaphoreGive(memory_mutex);
+            
+            if (slot >= 0) {
+                event_record(ALLOC_EVENT_FREE, ptr, size, slot, site);
+            }
         }
     }
     
     heap_caps_free(ptr);
 }
 
+// บอก leak detector ว่า buffer ยังถูกใช้อยู่ (buffer ที่อยู่นานควรเรียกเป็นระยะ)
+void heap_touch(void* ptr) {
+    if (!ptr || !memory_monitoring_enabled || !memory_mutex) return;
+    
+    if (xSemaphoreTake(memory_mutex, pdMS_TO_TICKS(10)) == pdTRUE) {
+        int pos = index_lookup(ptr);
+        if (pos >= 0) {
+            allocations[alloc_index[pos]].touch_epoch = leak_epoch;
+        }
+        xSemaphoreGive(memory_mutex);
+    }
+}
+
+// ====== Fragmentation analyzer ======
+#if CONFIG_IDF_TARGET_LINUX
+static frag_cap_state_t frag_caps[] = {
+    {"HOST", MALLOC_CAP_DEFAULT},
+};
+#else
+static frag_cap_state_t frag_caps[] = {
+    {"INTERNAL", MALLOC_CAP_INTERNAL},
+    {"SPIRAM", MALLOC_CAP_SPIRAM},
+};
+#endif
+#define FRAG_CAP_COUNT (sizeof(frag_caps) / sizeof(frag_caps[0]))
+static SemaphoreHandle_t frag_mutex;
+
+static inline int frag_bucket(size_t size) {
+    int b = 0;
+    while (b < FRAG_HIST_BUCKETS - 1 && size >= ((size_t)32 << b)) b++;
+    return b;
+}
+
+static void frag_add_free_blocks(frag_snapshot_t* acc, size_t size, uint32_t count) {
+    acc->free_blocks[frag_bucket(size)] += count;
+    acc->total_free += size * count;
+    if (size > acc->largest_free) acc->largest_free = size;
+}
+
+#if CONFIG_IDF_TARGET_LINUX
+// Host: ไม่มี heap_caps_walk ใช้ free-chunk bins จาก malloc_info ของ glibc แทน
+// (แต่ละ bin นับเป็น count blocks ขนาดเฉลี่ย — ไม่รวม top chunk ที่ขยายได้เอง)
+static void frag_walk_host(frag_snapshot_t* acc) {
+#ifdef __GLIBC__
+    char* xml = NULL;
+    size_t len = 0;
+    FILE* fp = open_memstream(&xml, &len);
+    if (!fp) return;
+    malloc_info(0, fp);
+    fclose(fp);
+    
+    for (char* line = xml; line && *line;) {
+        char* next = strchr(line, '\n');
+        if (next) *next++ = '\0';
+        char* tag = strstr(line, "<size ");
+        if (!tag) tag = strstr(line, "<unsorted ");
+        size_t from, to, total, count;
+        if (tag && sscanf(strchr(tag, ' '), " from=\"%zu\" to=\"%zu\" total=\"%zu\" count=\"%zu\"",
+                          &from, &to, &total, &count) == 4 && count > 0) {
+            frag_add_free_blocks(acc, total / count, count);
+        }
+        line = next;
+    }
+    acc->regions = 1;
+    free(xml);
+#endif
+}
+#else
+typedef struct {
+    int target;                          // region ที่เดินรอบนี้ (ลำดับตามที่ heap_caps_walk พบ)
+    int ordinal;
+    intptr_t current_start;
+    bool found;
+    uint32_t blocks;
+    frag_snapshot_t* acc;
+} frag_walk_ctx_t;
+
+static bool frag_walk_cb(walker_heap_into_t heap, walker_block_info_t block, void* user_data) {
+    frag_walk_ctx_t* ctx = user_data;
+    if (heap.start != ctx->current_start) {
+        ctx->ordinal++;
+        ctx->current_start = heap.start;
+    }
+    if (ctx->ordinal != ctx->target) return false;  // region อื่น: หยุดทันที (ถือ lock แค่ block เดียว)
+    
+    ctx->found = true;
+    if (++ctx->blocks > FRAG_MAX_BLOCKS_PER_STEP) {
+        ctx->acc->truncated = true;
+        return false;
+    }
+    if (block.used) {
+        ctx->acc->used_blocks++;
+    } else {
+        frag_add_free_blocks(ctx->acc, block.size, 1);
+    }
+    return true;
+}
+
+// เดิน region ที่ index นี้ของ caps คืน false เมื่อไม่มี region นี้แล้ว
+static bool frag_walk_region(uint32_t caps, int region, frag_snapshot_t* acc) {
+    frag_walk_ctx_t ctx = {.target = region, .ordinal = -1, .acc = acc};
+    heap_caps_walk(caps, frag_walk_cb, &ctx);
+    if (ctx.found) acc->regions++;
+    return ctx.found;
+}
+#endif
+
+// จำนวน allocation ขนาด size ที่ใส่ได้ (ใช้ขอบล่างของแต่ละ bucket จึงไม่ประเมินเกิน)
+static uint32_t frag_fits(const frag_snapshot_t* snap, size_t size) {
+    uint32_t fits = 0;
+    for (int b = 0; b < FRAG_HIST_BUCKETS; b++) {
+        size_t lower = b == 0 ? 0 : (size_t)16 << b;   // bucket 0 มี block < 16 B ปนอยู่
+        if (lower >= size) fits += snap->free_blocks[b] * (lower / size);
+    }
+    if (fits == 0 && snap->largest_free >= size) fits = 1;
+    return fits;
+}
+
+static frag_cap_state_t* frag_find_cap(uint32_t caps) {
+    for (int i = 0; i < FRAG_CAP_COUNT; i++) {
+        if (frag_caps[i].caps == caps) return &frag_caps[i];
+    }
+    return NULL;
+}
+
+frag_prediction_t frag_predict_allocation(uint32_t caps, size_t size) {
+    frag_prediction_t pred = {0, 0.0f, -1, true};
+    frag_cap_state_t* cap = frag_find_cap(caps);
+    if (!cap || !frag_mutex || xSemaphoreTake(frag_mutex, pdMS_TO_TICKS(100)) != pdTRUE) return pred;
+    
+    if (cap->trend_count > 0) {
+        const int n = cap->trend_count;
+        const int first = (cap->trend_next - n + FRAG_TREND_DEPTH) % FRAG_TREND_DEPTH;
+        const frag_snapshot_t* latest = &cap->trend[(cap->trend_next - 1 + FRAG_TREND_DEPTH) % FRAG_TREND_DEPTH];
+        pred.fits_now = frag_fits(latest, size);
+        
+        // least-squares slope ของ fits เทียบเวลา (ต้องมีอย่างน้อย 3 จุด)
+        if (n >= 3) {
+            float mean_t = 0, mean_f = 0;
+            for (int i = 0; i < n; i++) {
+                const frag_snapshot_t* s = &cap->trend[(first + i) % FRAG_TREND_DEPTH];
+                mean_t += (s->timestamp - cap->trend[first].timestamp) / 1e6f;
+                mean_f += frag_fits(s, size);
+            }
+            mean_t /= n;
+            mean_f /= n;
+            float num = 0, den = 0;
+            for (int i = 0; i < n; i++) {
+                const frag_snapshot_t* s = &cap->trend[(first + i) % FRAG_TREND_DEPTH];
+                float dt = (s->timestamp - cap->trend[first].timestamp) / 1e6f - mean_t;
+                num += dt * (frag_fits(s, size) - mean_f);
+                den += dt * dt;
+            }
+            float slope = den > 0 ? num / den : 0.0f;   // fits ต่อวินาที
+            pred.fits_per_min = slope * 60.0f;
+            if (slope < 0) pred.seconds_to_failure = (int32_t)(pred.fits_now / -slope);
+        }
+#if CONFIG_IDF_TARGET_LINUX
+        // host heap ขยายจาก top chunk ได้เสมอ ดูแค่แนวโน้ม
+        pred.ok_within_horizon = pred.seconds_to_failure < 0 || pred.seconds_to_failure > FRAG_PREDICT_HORIZON_S;
+#else
+        pred.ok_within_horizon = pred.fits_now > 0 &&
+            (pred.seconds_to_failure < 0 || pred.seconds_to_failure > FRAG_PREDICT_HORIZON_S);
+#endif
+    }
+    
+    xSemaphoreGive(frag_mutex);
+    return pred;
+}
+
+void print_fragmentation_report(void) {
+    if (!frag_mutex) return;
+    
+    ESP_LOGI(TAG, "\n🧩 ═══ FRAGMENTATION ANALYSIS ═══");
+    for (int i = 0; i < FRAG_CAP_COUNT; i++) {
+        frag_cap_state_t* cap = &frag_caps[i];
+        frag_snapshot_t latest = {0}, oldest = {0};
+        int count = 0;
+        
+        if (xSemaphoreTake(frag_mutex, pdMS_TO_TICKS(100)) != pdTRUE) return;
+        count = cap->trend_count;
+        if (count > 0) {
+            latest = cap->trend[(cap->trend_next - 1 + FRAG_TREND_DEPTH) % FRAG_TREND_DEPTH];
+            oldest = cap->trend[(cap->trend_next - count + FRAG_TREND_DEPTH) % FRAG_TREND_DEPTH];
+        }
+        xSemaphoreGive(frag_mutex);
+        
+        if (count == 0) {
+            ESP_LOGI(TAG, "%s: no data yet", cap->name);
+            continue;
+        }
+        
+        ESP_LOGI(TAG, "%s: %d regions%s, free %d bytes, largest %d bytes, %lu used blocks",
+                 cap->name, latest.regions, latest.truncated ? " (truncated)" : "",
+                 (int)latest.total_free, (int)latest.largest_free, (unsigned long)latest.used_blocks);
+        
+        char line[256];
+        int pos = snprintf(line, sizeof(line), "  Free blocks:");
+        for (int b = 0; b < FRAG_HIST_BUCKETS && pos < (int)sizeof(line); b++) {
+            if (latest.free_blocks[b] == 0) continue;
+            if (b == 0) {
+                pos += snprintf(line + pos, sizeof(line) - pos, " <32:%lu", (unsigned long)latest.free_blocks[b]);
+                continue;
+            }
+            pos += snprintf(line + pos, sizeof(line) - pos, " %d%s:%lu", (16 << b) >= 1024 ? (16 << b) / 1024 : 16 << b,
+                            (16 << b) >= 1024 ? "K+" : "+", (unsigned long)latest.free_blocks[b]);
+        }
+        ESP_LOGI(TAG, "%s", line);
+        ESP_LOGI(TAG, "  Trend (%lu s): free %d -> %d bytes, largest %d -> %d bytes",
+                 (unsigned long)((latest.timestamp - oldest.timestamp) / 1000000),
+                 (int)oldest.total_free, (int)latest.total_free,
+                 (int)oldest.largest_free, (int)latest.largest_free);
+        
+        frag_prediction_t pred = frag_predict_allocation(cap->caps, FRAG_PREDICT_SIZE);
+        if (pred.seconds_to_failure >= 0) {
+            ESP_LOGI(TAG, "  %d-byte allocs: %lu fit now, %+.1f/min, failure in ~%ld s%s",
+                     FRAG_PREDICT_SIZE, (unsigned long)pred.fits_now, pred.fits_per_min, (long)pred.seconds_to_failure,
+                     pred.ok_within_horizon ? "" : " ⚠️");
+        } else {
+            ESP_LOGI(TAG, "  %d-byte allocs: %lu fit now, %+.1f/min, stable%s",
+                     FRAG_PREDICT_SIZE, (unsigned long)pred.fits_now, pred.fits_per_min,
+                     pred.ok_within_horizon ? "" : " ⚠️");
+        }
+    }
+    ESP_LOGI(TAG, "═══════════════════════════════");
+}
+
+bool fragmentation_analyzer_init(void) {
+    if (!frag_mutex) frag_mutex = xSemaphoreCreateMutex();
+    return frag_mutex != NULL;
+}
+
+// Analyzer task: หนึ่ง region ต่อ step แล้ว yield — ไม่มีช่วงไหนถือ heap lock ทั้ง heap
+// (snapshot จึงไม่ atomic ข้าม region แต่พอสำหรับดูแนวโน้ม)
+void fragmentation_analyzer_task(void *pvParameters) {
+    ESP_LOGI(TAG, "🧩 Fragmentation analyzer started");
+    
+    while (1) {
+        for (int i = 0; i < FRAG_CAP_COUNT; i++) {
+            frag_cap_state_t* cap = &frag_caps[i];
+            frag_snapshot_t acc = {0};
+#if CONFIG_IDF_TARGET_LINUX
+            frag_walk_host(&acc);
+#else
+            for (int region = 0; frag_walk_region(cap->caps, region, &acc); region++) {
+                vTaskDelay(pdMS_TO_TICKS(FRAG_STEP_MS));
+            }
+#endif
+            if (acc.regions == 0) continue;  // ไม่มี memory แบบนี้ (เช่นไม่มี SPIRAM)
+            acc.timestamp = esp_timer_get_time();
+            
+            if (xSemaphoreTake(frag_mutex, portMAX_DELAY) == pdTRUE) {
+                cap->trend[cap->trend_next] = acc;
+                cap->trend_next = (cap->trend_next + 1) % FRAG_TREND_DEPTH;
+                if (cap->trend_count < FRAG_TREND_DEPTH) cap->trend_count++;
+                xSemaphoreGive(frag_mutex);
+            }
+        }
+        vTaskDelay(pdMS_TO_TICKS(FRAG_CYCLE_MS));
+    }
+}
+
 // Memory analysis functions
 void analyze_memory_status(void) {
     size_t internal_free = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
@@ -157,11 +831,11 @@ void analyze_memory_status(void) {
     }
     
     ESP_LOGI(TAG, "\n📊 ═══ MEMORY STATUS ═══");
-    ESP_LOGI(TAG, "Internal RAM Free:    %d bytes", internal_free);
-    ESP_LOGI(TAG, "Largest Free Block:   %d bytes", internal_largest);
-    ESP_LOGI(TAG, "SPIRAM Free:          %d bytes", spiram_free);
-    ESP_LOGI(TAG, "Total Free:           %d bytes", total_free);
-    ESP_LOGI(TAG, "Minimum Ever Free:    %d bytes", esp_get_minimum_free_heap_size());
+    ESP_LOGI(TAG, "Internal RAM Free:    %d bytes", (int)internal_free);
+    ESP_LOGI(TAG, "Largest Free Block:   %d bytes", (int)internal_largest);
+    ESP_LOGI(TAG, "SPIRAM Free:          %d bytes", (int)spiram_free);
+    ESP_LOGI(TAG, "Total Free:           %d bytes", (int)total_free);
+    ESP_LOGI(TAG, "Minimum Ever Free:    %lu bytes", (unsigned long)esp_get_minimum_free_heap_size());
     ESP_LOGI(TAG, "Internal Fragmentation: %.1f%%", internal_fragmentation * 100);
     
     // Update LEDs based on status
@@ -183,7 +857,13 @@ void analyze_memory_status(void) {
         gpio_set_level(LED_MEMORY_ERROR, 0);
     }
     
-    if (internal_fragmentation > FRAGMENTATION_THRESHOLD) {
+    // LED ติดเมื่อ ratio สูง หรือ analyzer ทำนายว่า FRAG_PREDICT_SIZE จะ allocate ไม่ได้ใน horizon
+#if CONFIG_IDF_TARGET_LINUX
+    frag_prediction_t pred = frag_predict_allocation(MALLOC_CAP_DEFAULT, FRAG_PREDICT_SIZE);
+#else
+    frag_prediction_t pred = frag_predict_allocation(MALLOC_CAP_INTERNAL, FRAG_PREDICT_SIZE);
+#endif
+    if (internal_fragmentation > FRAGMENTATION_THRESHOLD || !pred.ok_within_horizon) {
         gpio_set_level(LED_FRAGMENTATION, 1);
         stats.fragmentation_events++;
         ESP_LOGW(TAG, "⚠️ High fragmentation detected!");
@@ -200,71 +880,342 @@ void analyze_memory_status(void) {
     ESP_LOGI(TAG, "═══════════════════════════════");
 }
 
+// Top call sites ตาม live bytes (caller must hold memory_mutex)
+static void print_top_sites(void) {
+    bool shown[MAX_ALLOC_SITES + 1] = {false};
+    
+    ESP_LOGI(TAG, "\n🧭 ═══ TOP CALL SITES (live bytes) ═══");
+    ESP_LOGI(TAG, "%-10s %-15s %9s %6s %9s %9s", "Site", "Tag", "Live", "Count", "Peak", "Churn/s");
+    for (int n = 0; n < PROFILE_TOP_SITES; n++) {
+        int best = -1;
+        for (int i = 0; i <= MAX_ALLOC_SITES; i++) {
+            if (alloc_sites[i].total_allocs == 0 || shown[i]) continue;
+            if (best < 0 || alloc_sites[i].live_bytes > alloc_sites[best].live_bytes) best = i;
+        }
+        if (best < 0) break;
+        shown[best] = true;
+        
+        const alloc_site_t* site = &alloc_sites[best];
+        ESP_LOGI(TAG, "0x%08lx %-15s %9lu %6lu %9lu %9.1f", (unsigned long)site->key, site->label,
+                 (unsigned long)site->live_bytes, (unsigned long)site->live_count,
+                 (unsigned long)site->peak_live_bytes, site->churn_per_sec);
+    }
+}
+
 void print_allocation_summary(void) {
     if (!memory_mutex) return;
     
     if (xSemaphoreTake(memory_mutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
         ESP_LOGI(TAG, "\n📈 ═══ ALLOCATION STATISTICS ═══");
-        ESP_LOGI(TAG, "Total Allocations:    %lu", stats.total_allocations);
-        ESP_LOGI(TAG, "Total Deallocations:  %lu", stats.total_deallocations);
-        ESP_LOGI(TAG, "Current Allocations:  %lu", stats.current_allocations);
-        ESP_LOGI(TAG, "Total Allocated:      %llu bytes", stats.total_bytes_allocated);
-        ESP_LOGI(TAG, "Total Deallocated:    %llu bytes", stats.total_bytes_deallocated);
-        ESP_LOGI(TAG, "Peak Usage:           %llu bytes", stats.peak_usage);
-        ESP_LOGI(TAG, "Allocation Failures:  %lu", stats.allocation_failures);
-        ESP_LOGI(TAG, "Fragmentation Events: %lu", stats.fragmentation_events);
-        ESP_LOGI(TAG, "Low Memory Events:    %lu", stats.low_memory_events);
+        ESP_LOGI(TAG, "Total Allocations:    %lu", (unsigned long)stats.total_allocations);
+        ESP_LOGI(TAG, "Total Deallocations:  %lu", (unsigned long)stats.total_deallocations);
+        ESP_LOGI(TAG, "Current Allocations:  %lu", (unsigned long)stats.current_allocations);
+        ESP_LOGI(TAG, "Total Allocated:      %llu bytes", (unsigned long long)stats.total_bytes_allocated);
+        ESP_LOGI(TAG, "Total Deallocated:    %llu bytes", (unsigned long long)stats.total_bytes_deallocated);
+        ESP_LOGI(TAG, "Peak Usage:           %llu bytes", (unsigned long long)stats.peak_usage);
+        ESP_LOGI(TAG, "Allocation Failures:  %lu", (unsigned long)stats.allocation_failures);
+        ESP_LOGI(TAG, "Fragmentation Events: %lu", (unsigned long)stats.fragmentation_events);
+        ESP_LOGI(TAG, "Low Memory Events:    %lu", (unsigned long)stats.low_memory_events);
+        ESP_LOGI(TAG, "Tracking Overflows:   %lu", (unsigned long)stats.tracking_overflows);
+        ESP_LOGI(TAG, "Stale Records:        %lu", (unsigned long)stats.stale_records);
+        ESP_LOGI(TAG, "Events Logged:        %u (1/%u sampled, %u dropped)",
+                 atomic_load(&events_recorded), atomic_load(&event_sample_every),
+                 atomic_load(&events_dropped));
         
         if (stats.current_allocations > 0) {
             ESP_LOGI(TAG, "\n🔍 ═══ ACTIVE ALLOCATIONS ═══");
+            int printed = 0;
             for (int i = 0; i < MAX_ALLOCATIONS; i++) {
-                if (allocations[i].is_active) {
+                if (allocations[i].is_active && printed++ < MAX_PRINTED_ALLOCATIONS) {
                     uint64_t age_ms = (esp_timer_get_time() - allocations[i].timestamp) / 1000;
                     ESP_LOGI(TAG, "Slot %d: %d bytes at %p (%s) - Age: %llu ms",
-                             i, allocations[i].size, allocations[i].ptr,
-                             allocations[i].description, age_ms);
+                             i, (int)allocations[i].size, allocations[i].ptr,
+                             allocations[i].description, (unsigned long long)age_ms);
                 }
             }
+            if (printed > MAX_PRINTED_ALLOCATIONS) {
+                ESP_LOGI(TAG, "... and %d more", printed - MAX_PRINTED_ALLOCATIONS);
+            }
         }
         
+        profile_update_churn();
+        print_top_sites();
+        
         xSemaphoreGive(memory_mutex);
     }
 }
 
+// Sweep ทีละ LEAK_SCAN_SLICE records แล้วปล่อย mutex — task ที่ allocate รอไม่เกินหนึ่ง slice
+// record ที่ถูก free/alloc ใหม่ระหว่าง slice ได้ touch_epoch ปัจจุบัน จึงไม่ถูกนับผิด
 void detect_memory_leaks(void) {
     if (!memory_mutex) return;
     
-    if (xSemaphoreTake(memory_mutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
-        uint64_t current_time = esp_timer_get_time();
-        int leak_count = 0;
-        size_t leaked_bytes = 0;
-        
-        ESP_LOGI(TAG, "\n🔍 ═══ MEMORY LEAK DETECTION ═══");
+    static leak_site_summary_t by_site[MAX_ALLOC_SITES + 1];   // static: ไม่กิน stack ของ monitor
+    memset(by_site, 0, sizeof(by_site));
+    uint32_t cohorts[3] = {0};           // fresh (แตะใน epoch นี้), aging, suspect
+    uint32_t leak_count = 0;
+    size_t leaked_bytes = 0;
+    uint32_t max_pause_us = 0;
+    uint16_t epoch = 0;
+    
+    for (int start = 0; start < MAX_ALLOCATIONS; start += LEAK_SCAN_SLICE) {
+        if (xSemaphoreTake(memory_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) return;
         
-        for (int i = 0; i < MAX_ALLOCATIONS; i++) {
-            if (allocations[i].is_active) {
-                uint64_t age_ms = (current_time - allocations[i].timestamp) / 1000;
-                
-                // Consider allocations older than 30 seconds as potential leaks
-                if (age_ms > 30000) {
-                    ESP_LOGW(TAG, "POTENTIAL LEAK: %d bytes at %p (%s) - Age: %llu ms",
-                             allocations[i].size, allocations[i].ptr,
-                             allocations[i].description, age_ms);
-                    leak_count++;
-                    leaked_bytes += allocations[i].size;
+        uint64_t slice_start = esp_timer_get_time();
+        epoch = leak_epoch;
+        int end = start + LEAK_SCAN_SLICE < MAX_ALLOCATIONS ? start + LEAK_SCAN_SLICE : MAX_ALLOCATIONS;
+        for (int i = start; i < end; i++) {
+            const memory_allocation_t* a = &allocations[i];
+            if (!a->is_active) continue;
+            
+            uint16_t idle = epoch - a->touch_epoch;
+            if (idle == 0) {
+                cohorts[0]++;
+            } else if (idle < LEAK_SUSPECT_EPOCHS) {
+                cohorts[1]++;
+            } else {
+                cohorts[2]++;
+                leak_site_summary_t* group = &by_site[a->site];
+                group->count++;
+                group->bytes += a->size;
+                if (idle >= group->max_idle_epochs) {
+                    group->max_idle_epochs = idle;
+                    group->example = a->ptr;
                 }
+                leak_count++;
+                leaked_bytes += a->size;
             }
         }
+        uint32_t pause_us = esp_timer_get_time() - slice_start;
         
-        if (leak_count > 0) {
-            ESP_LOGW(TAG, "Found %d potential leaks totaling %d bytes", leak_count, leaked_bytes);
-            gpio_set_level(LED_MEMORY_ERROR, 1);
+        xSemaphoreGive(memory_mutex);
+        if (pause_us > max_pause_us) max_pause_us = pause_us;
+        taskYIELD();
+    }
+    
+    // ปิด epoch: record ที่ไม่ถูกแตะจะแก่ขึ้นหนึ่งรุ่นใน sweep ถัดไป
+    if (xSemaphoreTake(memory_mutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
+        leak_epoch++;
+        leak_max_pause_us = max_pause_us;
+        xSemaphoreGive(memory_mutex);
+    }
+    
+    // พิมพ์นอก mutex (label ของ site ไม่เปลี่ยนหลังสร้าง)
+    ESP_LOGI(TAG, "\n🔍 ═══ MEMORY LEAK DETECTION ═══");
+    ESP_LOGI(TAG, "Epoch %u: %lu fresh, %lu aging, %lu idle >= %d epochs (max pause %lu us)",
+             epoch, (unsigned long)cohorts[0], (unsigned long)cohorts[1], (unsigned long)cohorts[2], LEAK_SUSPECT_EPOCHS, (unsigned long)max_pause_us);
+    
+    if (leak_count > 0) {
+        int printed = 0;
+        for (int s = 0; s <= MAX_ALLOC_SITES && printed < MAX_PRINTED_ALLOCATIONS; s++) {
+            if (by_site[s].count == 0) continue;
+            ESP_LOGW(TAG, "POTENTIAL LEAK: %-16s %lu allocs, %lu bytes, idle %u epochs (e.g. %p)",
+                     alloc_sites[s].label, (unsigned long)by_site[s].count, (unsigned long)by_site[s].bytes,
+                     by_site[s].max_idle_epochs, by_site[s].example);
+            printed++;
+        }
+        ESP_LOGW(TAG, "Found %lu potential leaks totaling %d bytes", (unsigned long)leak_count, (int)leaked_bytes);
+        gpio_set_level(LED_MEMORY_ERROR, 1);
+    } else {
+        ESP_LOGI(TAG, "No memory leaks detected");
+        gpio_set_level(LED_MEMORY_ERROR, 0);
+    }
+}
+
+// ====== Heap profile snapshot ======
+// เขียน snapshot ลง buf คืนจำนวน bytes (0 = buf เล็กไป) — format ดู profile_snapshot_*_t
+size_t heap_profile_snapshot(void* buf, size_t buf_size) {
+    if (!memory_mutex || xSemaphoreTake(memory_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) return 0;
+    
+    profile_update_churn();
+    
+    profile_snapshot_header_t header = {
+        .magic = PROFILE_SNAPSHOT_MAGIC,
+        .version = PROFILE_SNAPSHOT_VERSION,
+        .site_count = 0,
+        .timestamp_us = esp_timer_get_time(),
+        .current_allocations = stats.current_allocations,
+        .tracking_overflows = stats.tracking_overflows,
+    };
+    size_t used = sizeof(header);
+    uint8_t* out = buf;
+    
+    for (int i = 0; i <= MAX_ALLOC_SITES; i++) {
+        const alloc_site_t* site = &alloc_sites[i];
+        if (site->total_allocs == 0) continue;
+        if (used + sizeof(profile_snapshot_site_t) > buf_size) {
+            used = 0;
+            break;
+        }
+        profile_snapshot_site_t rec = {
+            .key = site->key,
+            .live_bytes = site->live_bytes,
+            .live_count = site->live_count,
+            .peak_live_bytes = site->peak_live_bytes,
+            .total_allocs = site->total_allocs,
+            .total_frees = site->total_frees,
+            .churn_per_sec = site->churn_per_sec,
+        };
+        memcpy(rec.label, site->label, PROFILE_LABEL_LEN);
+        memcpy(out + used, &rec, sizeof(rec));
+        used += sizeof(rec);
+        header.site_count++;
+    }
+    if (used >= sizeof(header)) memcpy(out, &header, sizeof(header));
+    
+    xSemaphoreGive(memory_mutex);
+    return used;
+}
+
+// Dump snapshot เป็น hex ลง log: "HPROF <chunk>/<total> <hex>" ให้ script บน host ประกอบกลับ
+void heap_profile_dump(void) {
+    const size_t max_size = sizeof(profile_snapshot_header_t) +
+                            (MAX_ALLOC_SITES + 1) * sizeof(profile_snapshot_site_t);
+    uint8_t* buf = heap_caps_malloc(max_size, MALLOC_CAP_DEFAULT);
+    if (!buf) return;
+    
+    size_t len = heap_profile_snapshot(buf, max_size);
+    int chunks = (len + PROFILE_HEX_PER_LINE - 1) / PROFILE_HEX_PER_LINE;
+    char hex[PROFILE_HEX_PER_LINE * 2 + 1];
+    
+    ESP_LOGI(TAG, "📸 Heap profile snapshot: %d bytes", (int)len);
+    for (int c = 0; c < chunks; c++) {
+        size_t off = c * PROFILE_HEX_PER_LINE;
+        size_t n = (len - off < PROFILE_HEX_PER_LINE) ? len - off : PROFILE_HEX_PER_LINE;
+        for (size_t i = 0; i < n; i++) {
+            snprintf(&hex[i * 2], 3, "%02x", buf[off + i]);
+        }
+        ESP_LOGI(TAG, "HPROF %d/%d %s", c + 1, chunks, hex);
+    }
+    heap_caps_free(buf);
+}
+
+// Tracking overhead: tracked vs untracked malloc/free ขณะมี live allocations ค้างอยู่หลายระดับ
+static float time_malloc_free_pairs_ns(bool tracked) {
+    uint64_t start = esp_timer_get_time();
+    for (int i = 0; i < TRACKING_BENCH_PAIRS; i++) {
+        if (tracked) {
+            tracked_free(tracked_malloc(32, MALLOC_CAP_DEFAULT, "BenchPair"), "BenchPair");
         } else {
-            ESP_LOGI(TAG, "No memory leaks detected");
-            gpio_set_level(LED_MEMORY_ERROR, 0);
+            heap_caps_free(heap_caps_malloc(32, MALLOC_CAP_DEFAULT));
+        }
+    }
+    return (esp_timer_get_time() - start) * 1000.0f / TRACKING_BENCH_PAIRS;
+}
+
+void tracking_overhead_benchmark(void) {
+    static const int live_levels[] = {100, 1000, 10000};
+    
+    ESP_LOGI(TAG, "\n⏱️ ═══ TRACKING OVERHEAD BENCHMARK ═══");
+    ESP_LOGI(TAG, "%d malloc/free pairs of 32 bytes per measurement", TRACKING_BENCH_PAIRS);
+    
+    for (int l = 0; l < sizeof(live_levels) / sizeof(live_levels[0]); l++) {
+        const int level = live_levels[l];
+        if (level >= MAX_ALLOCATIONS - (int)stats.current_allocations) {
+            ESP_LOGI(TAG, "%5d live: skipped (MAX_ALLOCATIONS = %d)", level, MAX_ALLOCATIONS);
+            continue;
         }
         
-        xSemaphoreGive(memory_mutex);
+        void** live = heap_caps_malloc(level * sizeof(void*), MALLOC_CAP_DEFAULT);
+        if (!live) {
+            ESP_LOGW(TAG, "%5d live: skipped (no memory for pointer array)", level);
+            continue;
+        }
+        
+        int filled = 0;
+        while (filled < level &&
+               (live[filled] = tracked_malloc(32, MALLOC_CAP_DEFAULT, "BenchLive")) != NULL) {
+            filled++;
+        }
+        float tracked_ns = time_malloc_free_pairs_ns(true);
+        float untracked_ns = time_malloc_free_pairs_ns(false);
+        for (int i = 0; i < filled; i++) {
+            tracked_free(live[i], "BenchLive");
+        }
+        heap_caps_free(live);
+        event_discard_all();
+        
+        ESP_LOGI(TAG, "%5d live: tracked %.0f ns, untracked %.0f ns, overhead %.0f ns/pair",
+                 filled, tracked_ns, untracked_ns, tracked_ns - untracked_ns);
+    }
+    
+    ESP_LOGI(TAG, "═══════════════════════════════");
+}
+
+// Event logging cost: throughput ของ tracked_malloc/free ตาม mode ของ tracking/sampling
+// วัดฝั่ง producer (hot path) — logger task ยังไม่เริ่ม, event ที่ค้างถูกทิ้งหลังแต่ละ mode
+static float time_event_pairs_ops_per_sec(bool monitoring, uint32_t sample_every) {
+    memory_monitoring_enabled = monitoring;
+    heap_event_set_sampling(sample_every);
+    
+    uint64_t start = esp_timer_get_time();
+    for (int i = 0; i < EVENT_BENCH_PAIRS; i++) {
+        tracked_free(tracked_malloc(64, MALLOC_CAP_DEFAULT, "EventBench"), "EventBench");
+        if ((i & (EVENT_RING_SIZE / 4 - 1)) == 0) event_discard_all();  // ไม่ให้ ring เต็มจน drop
+    }
+    uint64_t elapsed = esp_timer_get_time() - start;
+    
+    event_discard_all();
+    return elapsed ? (2.0f * EVENT_BENCH_PAIRS * 1000000.0f) / elapsed : 0.0f;
+}
+
+void event_logging_benchmark(void) {
+    const bool saved_monitoring = memory_monitoring_enabled;
+    const uint32_t saved_sampling = atomic_load(&event_sample_every);
+    const uint32_t saved_recorded = atomic_load(&events_recorded);
+    
+    ESP_LOGI(TAG, "\n⏱️ ═══ EVENT LOGGING BENCHMARK ═══");
+    ESP_LOGI(TAG, "%d tracked malloc/free pairs of 64 bytes per mode", EVENT_BENCH_PAIRS);
+    
+    float untracked = time_event_pairs_ops_per_sec(false, 0);
+    float no_events = time_event_pairs_ops_per_sec(true, 0);
+    float sampled = time_event_pairs_ops_per_sec(true, EVENT_SAMPLE_EVERY);
+    float every = time_event_pairs_ops_per_sec(true, 1);
+    
+    ESP_LOGI(TAG, "Tracking disabled:       %9.0f ops/s", untracked);
+    ESP_LOGI(TAG, "Tracking, no events:     %9.0f ops/s", no_events);
+    ESP_LOGI(TAG, "Tracking, 1/%-2d sampled:  %9.0f ops/s", EVENT_SAMPLE_EVERY, sampled);
+    ESP_LOGI(TAG, "Tracking, every event:   %9.0f ops/s", every);
+    ESP_LOGI(TAG, "═══════════════════════════════");
+    
+    memory_monitoring_enabled = saved_monitoring;
+    heap_event_set_sampling(saved_sampling);
+    atomic_store(&events_recorded, saved_recorded);
+}
+
+// Logger task: พิมพ์ event จาก ring ทีละ batch (ไม่ถือ lock ใด ๆ ระหว่าง format/UART)
+void alloc_event_logger_task(void *pvParameters) {
+    ESP_LOGI(TAG, "📝 Allocation event logger started");
+    uint32_t reported_drops = 0;
+    
+    while (1) {
+        alloc_event_t event;
+        int printed = 0;
+        while (printed < EVENT_LOGGER_BATCH && event_pop(&event)) {
+            const char* label = alloc_sites[event.site].label;
+            switch (event.type) {
+            case ALLOC_EVENT_ALLOC:
+                ESP_LOGI(TAG, "✅ Allocated %lu bytes at %p (%s) - Slot %d",
+                         (unsigned long)event.size, event.ptr, label, event.slot);
+                break;
+            case ALLOC_EVENT_FREE:
+                ESP_LOGI(TAG, "🗑️ Freed %lu bytes at %p (%s) - Slot %d",
+                         (unsigned long)event.size, event.ptr, label, event.slot);
+                break;
+            default:
+                ESP_LOGE(TAG, "❌ Failed to allocate %lu bytes (%s)", (unsigned long)event.size, label);
+                break;
+            }
+            printed++;
+        }
+        
+        uint32_t drops = atomic_load_explicit(&events_dropped, memory_order_relaxed);
+        if (drops != reported_drops) {
+            ESP_LOGW(TAG, "⚠️ %lu allocation events dropped (ring full)", (unsigned long)(drops - reported_drops));
+            reported_drops = drops;
+        }
+        
+        vTaskDelay(pdMS_TO_TICKS(EVENT_LOGGER_PERIOD_MS));
     }
 }
 
@@ -289,7 +1240,7 @@ void memory_stress_test_task(void *pvParameters) {
                 // Write some data to test memory
                 memset(test_ptrs[allocation_count], 0xAA, size);
                 allocation_count++;
-                ESP_LOGI(TAG, "🔧 Stress test: allocated %d bytes (%d/20)", size, allocation_count);
+                ESP_LOGI(TAG, "🔧 Stress test: allocated %d bytes (%d/20)", (int)size, allocation_count);
             }
             
         } else if (action == 1 && allocation_count > 0) {
@@ -307,6 +1258,11 @@ void memory_stress_test_task(void *pvParameters) {
             }
             
         } else if (action == 2) {
+            // buffer ที่ถืออยู่ยังถูกใช้ — touch ให้ leak detector ไม่นับเป็น leak ตามอายุ
+            for (int i = 0; i < allocation_count; i++) {
+                heap_touch(test_ptrs[i]);
+            }
+
             // Memory status check
             analyze_memory_status();
         }
@@ -364,7 +1320,7 @@ void large_allocation_test_task(void *pvParameters) {
         // Try to allocate large chunks
         size_t large_size = 50000 + (esp_random() % 100000); // 50KB-150KB
         
-        ESP_LOGI(TAG, "🐘 Attempting large allocation: %d bytes", large_size);
+        ESP_LOGI(TAG, "🐘 Attempting large allocation: %d bytes", (int)large_size);
         
         // Try internal RAM first, then SPIRAM
         void* large_ptr = tracked_malloc(large_size, MALLOC_CAP_INTERNAL, "LargeInternal");
@@ -383,7 +1339,7 @@ void large_allocation_test_task(void *pvParameters) {
             uint64_t end_time = esp_timer_get_time();
             
             uint32_t access_time_ms = (end_time - start_time) / 1000;
-            ESP_LOGI(TAG, "🐘 Memory access time: %lu ms", access_time_ms);
+            ESP_LOGI(TAG, "🐘 Memory access time: %lu ms", (unsigned long)access_time_ms);
             
             // Keep allocation for a while
             vTaskDelay(pdMS_TO_TICKS(10000)); // 10 seconds
@@ -401,22 +1357,28 @@ void large_allocation_test_task(void *pvParameters) {
 
 void memory_monitor_task(void *pvParameters) {
     ESP_LOGI(TAG, "📊 Memory monitor started");
+    uint32_t cycles = 0;
     
     while (1) {
         vTaskDelay(pdMS_TO_TICKS(10000)); // Check every 10 seconds
         
         analyze_memory_status();
+        print_fragmentation_report();
         print_allocation_summary();
         detect_memory_leaks();
         
+        if (++cycles % PROFILE_SNAPSHOT_EVERY == 0) {
+            heap_profile_dump();
+        }
+        
         // Check heap integrity
         if (!heap_caps_check_integrity_all(true)) {
             ESP_LOGE(TAG, "🚨 HEAP CORRUPTION DETECTED!");
             gpio_set_level(LED_MEMORY_ERROR, 1);
         }
         
-        ESP_LOGI(TAG, "Free heap: %d bytes", esp_get_free_heap_size());
-        ESP_LOGI(TAG, "System uptime: %llu ms\n", esp_timer_get_time() / 1000);
+        ESP_LOGI(TAG, "Free heap: %lu bytes", (unsigned long)esp_get_free_heap_size());
+        ESP_LOGI(TAG, "System uptime: %llu ms\n", (unsigned long long)(esp_timer_get_time() / 1000));
     }
 }
 
@@ -472,7 +1434,7 @@ void heap_integrity_test_task(void *pvParameters) {
             uint64_t read_time = esp_timer_get_time() - start;
             
             ESP_LOGI(TAG, "🔍 Performance: Write %llu μs, Read %llu μs", 
-                     write_time, read_time);
+                     (unsigned long long)write_time, (unsigned long long)read_time);
             
             tracked_free(test_buf, "PerfTest");
         }
@@ -496,21 +1458,27 @@ void app_main(void) {
     gpio_set_level(LED_FRAGMENTATION, 0);
     gpio_set_level(LED_SPIRAM_ACTIVE, 0);
     
-    // Create mutex for memory tracking
-    memory_mutex = xSemaphoreCreateMutex();
-    if (!memory_mutex) {
+    // Create mutex + allocation table
+    if (!heap_tracking_init()) {
         ESP_LOGE(TAG, "Failed to create memory mutex!");
         return;
     }
     
-    // Initialize allocation tracking
-    memset(allocations, 0, sizeof(allocations));
+    if (!fragmentation_analyzer_init()) {
+        ESP_LOGE(TAG, "Failed to create fragmentation mutex!");
+        return;
+    }
     
     ESP_LOGI(TAG, "Memory tracking system initialized");
     
     // Initial memory analysis
     analyze_memory_status();
     
+#if TRACKING_BENCH_ENABLED
+    tracking_overhead_benchmark();
+    event_logging_benchmark();
+#endif
+    
     // Print initial heap info
     ESP_LOGI(TAG, "\n🏗️ ═══ INITIAL HEAP INFORMATION ═══");
     heap_caps_print_heap_info(MALLOC_CAP_INTERNAL);
@@ -523,7 +1491,9 @@ void app_main(void) {
     // Create test tasks
     ESP_LOGI(TAG, "Creating memory test tasks...");
     
+    xTaskCreate(alloc_event_logger_task, "EventLogger", 3072, NULL, EVENT_LOGGER_PRIORITY, NULL);
     xTaskCreate(memory_monitor_task, "MemMonitor", 4096, NULL, 6, NULL);
+    xTaskCreate(fragmentation_analyzer_task, "FragAnalyzer", 3072, NULL, FRAG_ANALYZER_PRIORITY, NULL);
     xTaskCreate(memory_stress_test_task, "StressTest", 3072, NULL, 5, NULL);
     xTaskCreate(memory_pool_test_task, "PoolTest", 3072, NULL, 5, NULL);
     xTaskCreate(large_allocation_test_task, "LargeAlloc", 2048, NULL, 4, NULL);
@@ -541,8 +1511,8 @@ void app_main(void) {
     ESP_LOGI(TAG, "\n🔬 Test Features:");
     ESP_LOGI(TAG, "  • Dynamic Memory Allocation Tracking");
     ESP_LOGI(TAG, "  • Real-time Memory Status Monitoring");
-    ESP_LOGI(TAG, "  • Memory Leak Detection");
-    ESP_LOGI(TAG, "  • Fragmentation Analysis");
+    ESP_LOGI(TAG, "  • Memory Leak Detection (generational, incremental sweep)");
+    ESP_LOGI(TAG, "  • Fragmentation Analysis (free-block histogram + failure prediction)");
     ESP_LOGI(TAG, "  • Heap Integrity Checking");
     ESP_LOGI(TAG, "  • Memory Performance Testing");
     
@@ -0,0 +1,89 @@
+#!/usr/bin/env python3
+"""Diff heap profile snapshots (HPS1) produced by heap_profile_dump().
+
+Usage:
+    heap_profile_diff.py monitor.log              # first vs last snapshot in one log
+    heap_profile_diff.py before.log after.log     # last snapshot of each log
+    heap_profile_diff.py before.bin after.bin     # raw heap_profile_snapshot() output
+
+Sites are matched by key (caller PC or tag hash) and sorted by live-bytes growth.
+Churn/s is (allocs + frees) between the two snapshots divided by the interval.
+Resolve PCs with: xtensa-esp32-elf-addr2line -pfe build/heap_management.elf <key>
+"""
+import re
+import struct
+import sys
+
+MAGIC = 0x31535048
+HEADER = struct.Struct("<IHHQII")
+SITE = struct.Struct("<I16sIIIIIf")
+HPROF_LINE = re.compile(r"HPROF (\d+)/(\d+) ([0-9a-f]+)")
+
+
+def parse_snapshot(blob):
+    magic, version, site_count, timestamp_us, current, overflows = HEADER.unpack_from(blob, 0)
+    if magic != MAGIC or version != 1:
+        raise ValueError("not an HPS1 snapshot")
+    sites = {}
+    for i in range(site_count):
+        key, label, live, count, peak, allocs, frees, churn = SITE.unpack_from(blob, HEADER.size + i * SITE.size)
+        sites[key] = {
+            "label": label.split(b"\0", 1)[0].decode(errors="replace"),
+            "live": live, "count": count, "peak": peak,
+            "allocs": allocs, "frees": frees, "churn": churn,
+        }
+    return {"timestamp_us": timestamp_us, "current": current, "overflows": overflows, "sites": sites}
+
+
+def load_snapshots(path):
+    with open(path, "rb") as f:
+        data = f.read()
+    if data[:4] == struct.pack("<I", MAGIC):
+        return [parse_snapshot(data)]
+
+    snapshots, chunks = [], []
+    for line in data.decode(errors="replace").splitlines():
+        m = HPROF_LINE.search(line)
+        if not m:
+            continue
+        index, total = int(m.group(1)), int(m.group(2))
+        if index == 1:
+            chunks = []
+        chunks.append(bytes.fromhex(m.group(3)))
+        if index == total and len(chunks) == total:
+            snapshots.append(parse_snapshot(b"".join(chunks)))
+    if not snapshots:
+        raise SystemExit(f"{path}: no HPROF snapshot found")
+    return snapshots
+
+
+def main(argv):
+    if len(argv) == 2:
+        snaps = load_snapshots(argv[1])
+        if len(snaps) < 2:
+            raise SystemExit("need at least two snapshots in the log")
+        before, after = snaps[0], snaps[-1]
+    elif len(argv) == 3:
+        before, after = load_snapshots(argv[1])[-1], load_snapshots(argv[2])[-1]
+    else:
+        raise SystemExit(__doc__)
+
+    dt = (after["timestamp_us"] - before["timestamp_us"]) / 1e6
+    print(f"Interval: {dt:.1f} s, live allocations {before['current']} -> {after['current']}, "
+          f"untracked {before['overflows']} -> {after['overflows']}")
+    print(f"{'Site':<10} {'Tag':<15} {'Live':>9} {'dLive':>9} {'dCount':>7} {'Peak':>9} {'Allocs':>8} {'Churn/s':>9}")
+
+    empty = {"label": "", "live": 0, "count": 0, "peak": 0, "allocs": 0, "frees": 0, "churn": 0.0}
+    rows = []
+    for key in set(before["sites"]) | set(after["sites"]):
+        a, b = before["sites"].get(key, empty), after["sites"].get(key, empty)
+        rows.append((b["live"] - a["live"], key, a, b))
+    for d_live, key, a, b in sorted(rows, key=lambda r: r[0], reverse=True):
+        d_allocs = b["allocs"] - a["allocs"]
+        churn = (d_allocs + b["frees"] - a["frees"]) / dt if dt > 0 else 0.0
+        print(f"0x{key:08x} {b['label'] or a['label']:<15} {b['live']:>9} {d_live:>+9} "
+              f"{b['count'] - a['count']:>+7} {b['peak']:>9} {d_allocs:>8} {churn:>9.1f}")
+
+
+if __name__ == "__main__":
+    main(sys.argv)
@@ -2,6 +2,8 @@
 #include <stdint.h>
 #include <string.h>
 #include <math.h>
+#include <stdatomic.h>
+#include "sdkconfig.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
@@ -10,30 +12,143 @@
 #include "esp_heap_caps.h"
 #include "esp_timer.h"
 #include "esp_system.h"
-#include "driver/gpio.h"
 #include "esp_random.h"
+#include "esp_cpu.h"
+
+#if CONFIG_IDF_TARGET_LINUX
+// Host build (idf.py --preview set-target linux): ไม่มี GPIO ให้ LED เป็น no-op
+typedef int gpio_num_t;
+#define GPIO_NUM_2   2
+#define GPIO_NUM_4   4
+#define GPIO_NUM_5   5
+#define GPIO_NUM_18  18
+#define GPIO_NUM_19  19
+#define gpio_set_direction(pin, mode)  ((void)(pin))
+#define gpio_set_level(pin, level)     ((void)(pin), (void)(level))
+#else
+#include "driver/gpio.h"
+#endif
 
 static const char *TAG = "MEM_POOLS";
 
 // GPIO สำหรับแสดงสถานะ pool
-#define LED_SMALL_POOL     GPIO_NUM_2   // Small pool activity
-#define LED_MEDIUM_POOL    GPIO_NUM_4   // Medium pool activity
-#define LED_LARGE_POOL     GPIO_NUM_5   // Large pool activity
-#define LED_POOL_FULL      GPIO_NUM_18  // Pool exhaustion
+#define LED_SMALL_POOL     GPIO_NUM_2   // Small classes activity  (<= 64 B)
+#define LED_MEDIUM_POOL    GPIO_NUM_4   // Medium classes activity (<= 256 B)
+#define LED_LARGE_POOL     GPIO_NUM_5   // Large classes activity  (<= 1 KB)
+#define LED_POOL_FULL      GPIO_NUM_18  // Pool exhaustion / huge classes
 #define LED_POOL_ERROR     GPIO_NUM_19  // Pool error/corruption
 
-// Memory pool configurations
-#define SMALL_POOL_BLOCK_SIZE   64
-#define SMALL_POOL_BLOCK_COUNT  32
-
-#define MEDIUM_POOL_BLOCK_SIZE  256
-#define MEDIUM_POOL_BLOCK_COUNT 16
-
-#define LARGE_POOL_BLOCK_SIZE   1024
-#define LARGE_POOL_BLOCK_COUNT  8
-
-#define HUGE_POOL_BLOCK_SIZE    4096
-#define HUGE_POOL_BLOCK_COUNT   4
+// ====== Size classes (generated at compile time) ======
+// Geometric, 2 classes per power of two: 32, 48, 64, 96, ... 3072, 4096
+// class i: base = MIN << (i/2), size = base + (i odd ? base/2 : 0)
+#define SIZE_CLASS_MIN_BYTES    32
+#define SIZE_CLASS_COUNT        15
+#define SIZE_CLASS_MAX_BYTES    4096
+#define SIZE_CLASS_BASE(i)      (SIZE_CLASS_MIN_BYTES << ((i) / 2))
+#define SIZE_CLASS_BYTES(i)     (SIZE_CLASS_BASE(i) + (((i) & 1) ? SIZE_CLASS_BASE(i) / 2 : 0))
+
+// แต่ละ class ได้งบประมาณ ~3 KB (อย่างน้อย 2, มากสุด 64 blocks)
+#define SIZE_CLASS_BUDGET_BYTES 3072
+#define SIZE_CLASS_BLOCKS(i)    ((SIZE_CLASS_BUDGET_BYTES / SIZE_CLASS_BYTES(i)) < 2  ? 2  : \
+                                 (SIZE_CLASS_BUDGET_BYTES / SIZE_CLASS_BYTES(i)) > 64 ? 64 : \
+                                 (SIZE_CLASS_BUDGET_BYTES / SIZE_CLASS_BYTES(i)))
+
+// Class ใหญ่ขอ SPIRAM ก่อน (init จะ fallback เป็น internal ถ้าไม่มี)
+#define SIZE_CLASS_CAPS(i)      (SIZE_CLASS_BYTES(i) <= 256  ? MALLOC_CAP_INTERNAL : \
+                                 SIZE_CLASS_BYTES(i) <= 1024 ? MALLOC_CAP_DEFAULT  : \
+                                 (MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT))
+#define SIZE_CLASS_LED(i)       (SIZE_CLASS_BYTES(i) <= 64   ? LED_SMALL_POOL  : \
+                                 SIZE_CLASS_BYTES(i) <= 256  ? LED_MEDIUM_POOL : \
+                                 SIZE_CLASS_BYTES(i) <= 1024 ? LED_LARGE_POOL  : LED_POOL_FULL)
+
+// size -> class (tightest class ที่ >= size)
+#define SIZE_TO_CLASS(s) \
+    ((s) <= SIZE_CLASS_BYTES(0)  ? 0  : (s) <= SIZE_CLASS_BYTES(1)  ? 1  : \
+     (s) <= SIZE_CLASS_BYTES(2)  ? 2  : (s) <= SIZE_CLASS_BYTES(3)  ? 3  : \
+     (s) <= SIZE_CLASS_BYTES(4)  ? 4  : (s) <= SIZE_CLASS_BYTES(5)  ? 5  : \
+     (s) <= SIZE_CLASS_BYTES(6)  ? 6  : (s) <= SIZE_CLASS_BYTES(7)  ? 7  : \
+     (s) <= SIZE_CLASS_BYTES(8)  ? 8  : (s) <= SIZE_CLASS_BYTES(9)  ? 9  : \
+     (s) <= SIZE_CLASS_BYTES(10) ? 10 : (s) <= SIZE_CLASS_BYTES(11) ? 11 : \
+     (s) <= SIZE_CLASS_BYTES(12) ? 12 : (s) <= SIZE_CLASS_BYTES(13) ? 13 : 14)
+
+// Lookup table ละเอียดทีละ 16 bytes (ทุก class เป็นพหุคูณของ 16)
+#define SIZE_CLASS_GRANULE      16
+#define SIZE_CLASS_LUT_ENTRIES  (SIZE_CLASS_MAX_BYTES / SIZE_CLASS_GRANULE + 1)
+
+// Spill ไป class ที่ใหญ่ขึ้นได้อีกกี่ขั้นถ้า class ที่พอดีเต็ม (ก่อน fallback ไป heap)
+#define SIZE_CLASS_SPILL        2
+
+// Activity LEDs: allocator แค่นับ (atomic, non-blocking) แล้ว task ความสำคัญต่ำเป็นคนกระพริบ
+#define LED_ACTIVITY_ENABLED    1
+#define LED_ACTIVITY_PERIOD_MS  50   // LED ติดหนึ่งช่วงถ้ามี allocation ในช่วงก่อนหน้า
+#define LED_ACTIVITY_PRIORITY   1
+
+// Benchmark mode: 1 = รันเฉพาะ latency benchmark (ไม่มี stress/pattern/LED task มารบกวน)
+// override ได้จาก build (lab4/alloc_benchmark คอมไพล์ไฟล์นี้ด้วย POOL_BENCH_MODE=1)
+#ifndef POOL_BENCH_MODE
+#define POOL_BENCH_MODE         0
+#endif
+#define LATENCY_BENCH_ITERATIONS 100000
+// จับเวลา alloc/free ทุกครั้ง (esp_timer_get_time 2 ครั้งต่อ op) — ปิดใน benchmark mode
+#define POOL_TIMING_STATS       (!POOL_BENCH_MODE)
+
+// Latency histograms (log-linear แบบ HDR, นับเป็น CPU cycles, lock-free) — 0 = ตัดทิ้งทั้งหมด
+#define POOL_LATENCY_HISTOGRAMS (!POOL_BENCH_MODE)
+#define HIST_SUB_BITS           2    // 4 bucket ย่อยต่อ power of two (~25% resolution)
+#define HIST_MAX_EXP            20   // ค่าตั้งแต่ 2^21 cycles รวมไว้ HIST_OVERFLOW_BUCKET
+#define HIST_BUCKETS            ((HIST_MAX_EXP - HIST_SUB_BITS + 2) << HIST_SUB_BITS)
+#define HIST_OVERFLOW_BUCKET    HIST_BUCKETS   // แยกจาก bucket จริงตัวสุดท้าย (e=MAX_EXP, m=max)
+#ifdef CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ
+#define POOL_CPU_MHZ            CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ
+#else
+#define POOL_CPU_MHZ            240
+#endif
+
+// Per-core magazine cache (fast path ไม่ต้องแตะ mutex ของ pool)
+#define POOL_MAGAZINE_ENABLED   1
+#define POOL_MAGAZINE_SIZE      8   // blocks cached per core
+#define POOL_MAGAZINE_BATCH     4   // blocks moved per refill/drain (<= MAGAZINE_SIZE)
+
+// Shared layer: 0 = intrusive free_list (LIFO), 1 = สแกน bitmap ด้วย ctz (ได้ address ต่ำสุดก่อน)
+#define POOL_BITMAP_ALLOC       0
+
+// Block layout: 0 = header อยู่หน้า payload, 1 = metadata แยกนอก pool (payload ติดกันและ align ตามขนาด)
+// โหมดแยกบังคับใช้ bitmap allocation (ไม่มี next pointer ใน block)
+#define POOL_OOB_METADATA       0
+#define POOL_PAYLOAD_MAX_ALIGN  64   // align payload ได้สูงสุดเท่า cache line
+
+// Canary/สถานะต่อ block ของโหมด metadata แยก ตรวจเฉพาะ debug build
+#ifndef NDEBUG
+#define POOL_DEBUG_CHECKS       1
+#else
+#define POOL_DEBUG_CHECKS       0
+#endif
+#define POOL_CANARY             0xA5C3A5C3U
+
+// Growable pools: เต็มแล้วขอ slab ใหม่ (ขนาดเท่า slab แรก) ได้ไม่เกิน POOL_MAX_SLABS
+// slab บนสุดที่ว่างทั้งก้อนนานเกิน cool-down จะถูกคืน heap (slab แรกไม่คืน)
+#define POOL_MAX_SLABS          4
+#define POOL_SLAB_COOLDOWN_MS   30000
+
+// Batch API: จำนวน block ที่ประมวลผลต่อรอบภายใต้ lock เดียว (buffer บน stack)
+#define POOL_BULK_CHUNK         32
+
+// Address-range index สำหรับหา pool เจ้าของ pointer (smart_pool_free)
+#define POOL_BENCH_SLABS        (POOL_MAX_SLABS + 1 + 1)                  // pool ส่วนตัวของ benchmark: Contend (โตได้) + Batch + Layout
+#define POOL_RANGE_TABLE_SIZE   (SIZE_CLASS_COUNT * POOL_MAX_SLABS + POOL_BENCH_SLABS)  // 1 entry/slab
+
+// Contended throughput benchmark
+#define CONTENTION_BENCH_ITERATIONS  2000
+#define CONTENTION_BENCH_BLOCKS      2   // blocks held per iteration per task
+#define CONTENTION_BENCH_CLASS       SIZE_TO_CLASS(64)
+
+// ====== Latency histogram ======
+#if POOL_LATENCY_HISTOGRAMS
+typedef struct {
+    atomic_uint buckets[HIST_BUCKETS + 1];   // + overflow
+    atomic_uint max;
+} latency_hist_t;
+#endif
 
 // ====== Pool management structures ======
 typedef struct memory_block {
@@ -43,61 +158,135 @@ typedef struct memory_block {
     uint64_t alloc_time;   // When was this allocated
 } memory_block_t;
 
+// Per-core cache of free blocks. Only the owning core touches it in the
+// common case, so the spinlock is uncontended and just keeps the scheduler
+// from switching tasks mid-update.
+typedef struct {
+    portMUX_TYPE lock;
+    memory_block_t* blocks[POOL_MAGAZINE_SIZE];
+    uint32_t count;
+
+    // Statistics (updated inside the magazine critical section)
+    uint64_t requested_bytes;
+    uint64_t allocations;
+    uint64_t deallocations;
+    uint32_t hits;
+    uint32_t refills;
+    uint32_t drains;
+} pool_magazine_t;
+
 typedef struct {
     const char* name;
     size_t block_size;
-    size_t block_count;
+    size_t block_count;          // ความจุปัจจุบัน = slab_count × slab_blocks
     size_t alignment;
     uint32_t caps;
 
-    // Pool memory
-    void* pool_memory;
-    memory_block_t* free_list;
-    uint8_t* usage_bitmap;  // byte-accurate bitmap (1 bit/block)
+    // Pool memory: slab ต่อกันเป็น stack, block index = slab × slab_blocks + ตำแหน่งใน slab
+    void* slabs[POOL_MAX_SLABS];
+    uint32_t slab_count;
+    uint32_t max_slabs;
+    size_t slab_blocks;
+    uint32_t slab_caps;          // caps ที่ใช้ขอ slab ได้จริง (หลัง fallback SPIRAM)
+    uint64_t slab_empty_since;   // เวลาที่ slab บนสุดเริ่มว่างทั้งก้อน (0 = ไม่ว่าง)
+    uint32_t grow_events;
+    uint32_t shrink_events;
+    uint32_t peak_slabs;
+    memory_block_t* free_list;   // ไม่ใช้ในโหมด bitmap
+    uint32_t* usage_bitmap;      // 1 bit/block, อัปเดตทีละ word
+    bool oob_metadata;           // true: block handle = payload, ไม่มี header ใน slab
+    size_t block_stride;         // ระยะห่างระหว่าง block ใน slab
+    uint8_t* block_state;        // โหมด metadata แยก + debug: 1 = allocated
+    size_t bitmap_words;
+    size_t bitmap_hint;          // word แรกที่อาจมี block ว่าง (โหมด bitmap)
+    bool use_bitmap_alloc;
 
     // Statistics
-    size_t allocated_blocks;
     size_t peak_usage;
+    uint64_t requested_bytes;  // ขนาดที่ผู้ใช้ขอจริง (สำหรับ internal fragmentation)
     uint64_t total_allocations;
     uint64_t total_deallocations;
-    uint64_t allocation_time_total;
-    uint64_t deallocation_time_total;
+    atomic_uint_fast64_t allocation_time_total;    // μs, atomic เพราะบวกนอก mutex
+    atomic_uint_fast64_t deallocation_time_total;
     uint32_t allocation_failures;
+    atomic_uint activity;  // นับ allocation ให้ led_activity_task (relaxed, ไม่ block)
+
+#if POOL_LATENCY_HISTOGRAMS
+    latency_hist_t alloc_hist;
+    latency_hist_t free_hist;
+    latency_hist_t lock_wait_hist;
+#endif
 
     // Synchronization
     SemaphoreHandle_t mutex;
 
+    // Per-core caches in front of free_list
+    bool use_magazines;
+    uint32_t magazine_capacity;  // <= POOL_MAGAZINE_SIZE, ลดลงสำหรับ pool ที่มี block น้อย
+    uint32_t magazine_batch;
+    pool_magazine_t magazines[portNUM_PROCESSORS];
+
     // Pool ID for corruption detection
     uint32_t pool_id;
 } memory_pool_t;
 
-typedef enum {
-    POOL_SMALL = 0,
-    POOL_MEDIUM,
-    POOL_LARGE,
-    POOL_HUGE,
-    POOL_COUNT
-} pool_type_t;
+#define POOL_COUNT SIZE_CLASS_COUNT
 
 static memory_pool_t pools[POOL_COUNT];
 static bool pools_initialized = false;
 
-// คอนฟิกพูล (Huge ขอ SPIRAM ก่อน ถ้าไม่มีจะ fallback อัตโนมัติใน init)
+// ช่วง address ของแต่ละ pool เรียงตาม start; อ่านแบบ lock-free ด้วย sequence counter
+typedef struct {
+    uintptr_t start;
+    uintptr_t end;
+    memory_pool_t* pool;
+} pool_range_t;
+
+static pool_range_t pool_ranges[POOL_RANGE_TABLE_SIZE];
+static int pool_range_count = 0;
+static atomic_uint pool_range_seq = 0;  // คี่ = กำลังแก้ตาราง
+static portMUX_TYPE pool_range_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// คอนฟิกพูล (class ใหญ่ขอ SPIRAM ก่อน ถ้าไม่มีจะ fallback อัตโนมัติใน init)
 typedef struct {
     const char* name;
     size_t block_size;
     size_t block_count;
     uint32_t caps;
     gpio_num_t led_pin;
+    bool oob_metadata;
+    uint32_t max_slabs;          // 1 = ขนาดคงที่
 } pool_config_t;
 
+#define SIZE_CLASS_CONFIG(i) \
+    { "Class" #i, SIZE_CLASS_BYTES(i), SIZE_CLASS_BLOCKS(i), SIZE_CLASS_CAPS(i), SIZE_CLASS_LED(i), POOL_OOB_METADATA, POOL_MAX_SLABS }
+
 static const pool_config_t pool_configs[POOL_COUNT] = {
-    {"Small",  SMALL_POOL_BLOCK_SIZE,  SMALL_POOL_BLOCK_COUNT,  MALLOC_CAP_INTERNAL,                    LED_SMALL_POOL},
-    {"Medium", MEDIUM_POOL_BLOCK_SIZE, MEDIUM_POOL_BLOCK_COUNT, MALLOC_CAP_INTERNAL,                    LED_MEDIUM_POOL},
-    {"Large",  LARGE_POOL_BLOCK_SIZE,  LARGE_POOL_BLOCK_COUNT,  MALLOC_CAP_DEFAULT,                     LED_LARGE_POOL},
-    {"Huge",   HUGE_POOL_BLOCK_SIZE,   HUGE_POOL_BLOCK_COUNT,   (MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT),  LED_POOL_FULL}
+    SIZE_CLASS_CONFIG(0),  SIZE_CLASS_CONFIG(1),  SIZE_CLASS_CONFIG(2),  SIZE_CLASS_CONFIG(3),
+    SIZE_CLASS_CONFIG(4),  SIZE_CLASS_CONFIG(5),  SIZE_CLASS_CONFIG(6),  SIZE_CLASS_CONFIG(7),
+    SIZE_CLASS_CONFIG(8),  SIZE_CLASS_CONFIG(9),  SIZE_CLASS_CONFIG(10), SIZE_CLASS_CONFIG(11),
+    SIZE_CLASS_CONFIG(12), SIZE_CLASS_CONFIG(13), SIZE_CLASS_CONFIG(14)
+};
+
+#define SIZE_CLASS_LUT_1(i)    SIZE_TO_CLASS((i) * SIZE_CLASS_GRANULE)
+#define SIZE_CLASS_LUT_4(i)    SIZE_CLASS_LUT_1(i), SIZE_CLASS_LUT_1((i) + 1), SIZE_CLASS_LUT_1((i) + 2), SIZE_CLASS_LUT_1((i) + 3)
+#define SIZE_CLASS_LUT_16(i)   SIZE_CLASS_LUT_4(i), SIZE_CLASS_LUT_4((i) + 4), SIZE_CLASS_LUT_4((i) + 8), SIZE_CLASS_LUT_4((i) + 12)
+#define SIZE_CLASS_LUT_64(i)   SIZE_CLASS_LUT_16(i), SIZE_CLASS_LUT_16((i) + 16), SIZE_CLASS_LUT_16((i) + 32), SIZE_CLASS_LUT_16((i) + 48)
+#define SIZE_CLASS_LUT_256(i)  SIZE_CLASS_LUT_64(i), SIZE_CLASS_LUT_64((i) + 64), SIZE_CLASS_LUT_64((i) + 128), SIZE_CLASS_LUT_64((i) + 192)
+
+// index = ceil(size / 16) -> class
+static const uint8_t size_class_lut[SIZE_CLASS_LUT_ENTRIES] = {
+    SIZE_CLASS_LUT_256(0), SIZE_CLASS_LUT_1(256)
 };
 
+_Static_assert(SIZE_CLASS_BYTES(SIZE_CLASS_COUNT - 1) == SIZE_CLASS_MAX_BYTES, "size classes must end at SIZE_CLASS_MAX_BYTES");
+_Static_assert(SIZE_CLASS_COUNT >= 8 && SIZE_CLASS_COUNT <= 16, "keep 8-16 size classes");
+_Static_assert(SIZE_CLASS_LUT_ENTRIES == 257, "LUT generator covers 257 entries");
+
+static inline int size_to_class(size_t size) {
+    return size_class_lut[(size + SIZE_CLASS_GRANULE - 1) / SIZE_CLASS_GRANULE];
+}
+
 // Magic numbers
 #define POOL_MAGIC_FREE    0xDEADBEEF
 #define POOL_MAGIC_ALLOC   0xCAFEBABE
@@ -105,22 +294,161 @@ static const pool_config_t pool_configs[POOL_COUNT] = {
 // ====== Pool management ======
 static inline size_t align_up(size_t v, size_t a) { return (v + (a - 1)) & ~(a - 1); }
 
+// ====== Latency histogram ======
+#if POOL_LATENCY_HISTOGRAMS
+// index: ค่า < 2^SUB เก็บตรง ๆ, ที่เหลือ = (exponent, SUB bits ถัดจาก MSB)
+static inline uint32_t hist_bucket(uint32_t v) {
+    if (v < (1U << HIST_SUB_BITS)) return v;
+    uint32_t e = 31 - __builtin_clz(v);
+    if (e > HIST_MAX_EXP) return HIST_OVERFLOW_BUCKET;
+    return ((e - HIST_SUB_BITS + 1) << HIST_SUB_BITS) + ((v >> (e - HIST_SUB_BITS)) & ((1U << HIST_SUB_BITS) - 1));
+}
+
+// ค่าบนสุดของ bucket
+static uint32_t hist_bucket_upper(uint32_t index) {
+    if (index < (1U << HIST_SUB_BITS)) return index;
+    const uint32_t e = (index >> HIST_SUB_BITS) + HIST_SUB_BITS - 1;
+    const uint32_t m = index & ((1U << HIST_SUB_BITS) - 1);
+    const uint32_t lower = ((1U << HIST_SUB_BITS) + m) << (e - HIST_SUB_BITS);
+    return lower + (1U << (e - HIST_SUB_BITS)) - 1;
+}
+
+static inline void hist_record(latency_hist_t* h, uint32_t cycles) {
+    atomic_fetch_add_explicit(&h->buckets[hist_bucket(cycles)], 1, memory_order_relaxed);
+    unsigned cur = atomic_load_explicit(&h->max, memory_order_relaxed);
+    while (cycles > cur &&
+           !atomic_compare_exchange_weak_explicit(&h->max, &cur, cycles, memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+// คืน percentile (0..1) เป็น cycles; อ่านแบบ relaxed (ตัวเลขอาจคลาดเล็กน้อยระหว่างมีคนบันทึก)
+static uint32_t hist_percentile(latency_hist_t* h, uint64_t total, double p) {
+    if (total == 0) return 0;
+    uint64_t target = (uint64_t)(p * (double)total);
+    if (target < 1) target = 1;
+    uint64_t seen = 0;
+    const uint32_t max = atomic_load_explicit(&h->max, memory_order_relaxed);
+    for (uint32_t i = 0; i <= HIST_OVERFLOW_BUCKET; i++) {
+        seen += atomic_load_explicit(&h->buckets[i], memory_order_relaxed);
+        if (seen >= target) {
+            if (i == HIST_OVERFLOW_BUCKET) return max;  // bucket ล้น ไม่มีขอบบน
+            uint32_t upper = hist_bucket_upper(i);
+            return upper < max ? upper : max;
+        }
+    }
+    return max;
+}
+
+static void hist_print(const char* label, latency_hist_t* h) {
+    uint64_t total = 0;
+    for (uint32_t i = 0; i <= HIST_OVERFLOW_BUCKET; i++) total += atomic_load_explicit(&h->buckets[i], memory_order_relaxed);
+    if (total == 0) return;
+    const float ns_per_cycle = 1000.0f / POOL_CPU_MHZ;
+    ESP_LOGI(TAG, "  %-10s p50 %6.0f ns, p99 %6.0f ns, p99.9 %6.0f ns, max %7.0f ns (n=%llu)", label,
+             hist_percentile(h, total, 0.50)  * ns_per_cycle,
+             hist_percentile(h, total, 0.99)  * ns_per_cycle,
+             hist_percentile(h, total, 0.999) * ns_per_cycle,
+             atomic_load_explicit(&h->max, memory_order_relaxed) * ns_per_cycle,
+             (unsigned long long)total);
+}
+
+#define HIST_START()            uint32_t hist_t0 = esp_cpu_get_cycle_count()
+#define HIST_RECORD(h)          hist_record((h), esp_cpu_get_cycle_count() - hist_t0)
+#else
+#define HIST_START()            do { } while (0)
+#define HIST_RECORD(h)          do { } while (0)
+#endif
+
+// ====== Address-range index ======
+static bool pool_range_register(memory_pool_t* pool, const void* memory, size_t size) {
+    bool ok = false;
+    portENTER_CRITICAL(&pool_range_lock);
+    if (pool_range_count < POOL_RANGE_TABLE_SIZE) {
+        atomic_fetch_add_explicit(&pool_range_seq, 1, memory_order_acq_rel);
+
+        const uintptr_t start = (uintptr_t)memory;
+        int pos = pool_range_count;
+        while (pos > 0 && pool_ranges[pos - 1].start > start) {
+            pool_ranges[pos] = pool_ranges[pos - 1];
+            pos--;
+        }
+        pool_ranges[pos].start = start;
+        pool_ranges[pos].end   = start + size;
+        pool_ranges[pos].pool  = pool;
+        pool_range_count++;
+
+        atomic_fetch_add_explicit(&pool_range_seq, 1, memory_order_acq_rel);
+        ok = true;
+    }
+    portEXIT_CRITICAL(&pool_range_lock);
+    return ok;
+}
+
+// ลบ range ของ slab ที่ขึ้นต้นด้วย memory (NULL = ทุก slab ของ pool)
+static void pool_range_unregister(memory_pool_t* pool, const void* memory) {
+    portENTER_CRITICAL(&pool_range_lock);
+    atomic_fetch_add_explicit(&pool_range_seq, 1, memory_order_acq_rel);
+    int kept = 0;
+    for (int i = 0; i < pool_range_count; i++) {
+        const bool match = pool_ranges[i].pool == pool && (!memory || pool_ranges[i].start == (uintptr_t)memory);
+        if (!match) pool_ranges[kept++] = pool_ranges[i];
+    }
+    pool_range_count = kept;
+    atomic_fetch_add_explicit(&pool_range_seq, 1, memory_order_acq_rel);
+    portEXIT_CRITICAL(&pool_range_lock);
+}
+
+// คืน pool ที่เป็นเจ้าของ ptr หรือ NULL ถ้าเป็นหน่วยความจำจาก heap
+// Binary search บนตารางขนาดคงที่ ไม่แตะ mutex และไม่อ่าน header ของ ptr
+memory_pool_t* pool_find_owner(const void* ptr) {
+    const uintptr_t addr = (uintptr_t)ptr;
+    memory_pool_t* owner;
+    unsigned seq;
+
+    do {
+        seq = atomic_load_explicit(&pool_range_seq, memory_order_acquire);
+        owner = NULL;
+        if (seq & 1U) continue;
+
+        int lo = 0, hi = pool_range_count - 1;
+        while (lo <= hi) {
+            const int mid = (lo + hi) / 2;
+            if (addr < pool_ranges[mid].start)      hi = mid - 1;
+            else if (addr >= pool_ranges[mid].end)  lo = mid + 1;
+            else { owner = pool_ranges[mid].pool; break; }
+        }
+        atomic_thread_fence(memory_order_acquire);
+    } while ((seq & 1U) || seq != atomic_load_explicit(&pool_range_seq, memory_order_relaxed));
+
+    return owner;
+}
+
+static bool pool_add_slab(memory_pool_t* pool);
+
 bool init_memory_pool(memory_pool_t* pool, const pool_config_t* config, uint32_t pool_id) {
     if (!pool || !config) return false;
 
     memset(pool, 0, sizeof(memory_pool_t));
     pool->name        = config->name;
     pool->block_size  = config->block_size;
-    pool->block_count = config->block_count;
+    pool->slab_blocks = config->block_count;
     pool->alignment   = 4; // 4-byte alignment
     pool->caps        = config->caps;
     pool->pool_id     = pool_id;
+    pool->max_slabs   = config->max_slabs == 0 ? 1 : (config->max_slabs > POOL_MAX_SLABS ? POOL_MAX_SLABS : config->max_slabs);
 
     // คำนวณขนาดจริงต่อบล็อก
-    const size_t header_size        = sizeof(memory_block_t);
-    const size_t aligned_block_size = align_up(config->block_size, pool->alignment);
-    const size_t total_block_size   = header_size + aligned_block_size;
-    const size_t total_memory       = total_block_size * config->block_count;
+    // metadata แยก: payload align ตาม power-of-two ที่หาร block_size ลงตัว (สูงสุด POOL_PAYLOAD_MAX_ALIGN)
+    pool->oob_metadata = config->oob_metadata;
+    if (pool->oob_metadata) {
+        size_t natural = config->block_size & (~config->block_size + 1);
+        if (natural > POOL_PAYLOAD_MAX_ALIGN) natural = POOL_PAYLOAD_MAX_ALIGN;
+        if (POOL_DEBUG_CHECKS && natural > 16) natural = 16;  // debug: canary 4 B ไม่ให้ stride โตเป็น 2 เท่า
+        if (natural > pool->alignment) pool->alignment = natural;
+    }
+    const size_t header_size        = pool->oob_metadata ? 0 : sizeof(memory_block_t);
+    const size_t canary_size        = (pool->oob_metadata && POOL_DEBUG_CHECKS) ? sizeof(uint32_t) : 0;
+    pool->block_stride = align_up(header_size + align_up(config->block_size, 4) + canary_size, pool->alignment);
 
     // ขอ 8-bit capable เสมอ และทำ fallback ถ้าขอ SPIRAM แต่ไม่มี
     uint32_t req_caps = (config->caps | MALLOC_CAP_8BIT);
@@ -128,157 +456,697 @@ bool init_memory_pool(memory_pool_t* pool, const pool_config_t* config, uint32_t
         ESP_LOGW(TAG, "%s pool requested SPIRAM but none available. Falling back to INTERNAL DRAM.", config->name);
         req_caps = (req_caps & ~MALLOC_CAP_SPIRAM) | MALLOC_CAP_INTERNAL;
     }
+    pool->slab_caps = req_caps;
 
-    pool->pool_memory = heap_caps_malloc(total_memory, req_caps);
-    if (!pool->pool_memory) {
-        ESP_LOGE(TAG, "Failed to allocate memory for %s pool", config->name);
-        return false;
-    }
-
-    // Bitmap (1 bit/block) อยู่ใน INTERNAL 8-bit
-    const size_t bitmap_bytes = (config->block_count + 7) / 8;
-    pool->usage_bitmap = (uint8_t*)heap_caps_calloc(bitmap_bytes, 1, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    // Bitmap (1 bit/block, 32-bit words) อยู่ใน INTERNAL, จองไว้เท่าความจุสูงสุด
+    // bit ของ slab ที่ยังไม่มีถือว่าใช้แล้ว (scan จะไม่เจอ) -> เริ่มเป็น 1 ทั้งหมด
+    const size_t max_blocks   = pool->slab_blocks * pool->max_slabs;
+    const size_t bitmap_words = (max_blocks + 31) / 32;
+    pool->usage_bitmap = (uint32_t*)heap_caps_malloc(bitmap_words * sizeof(uint32_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
     if (!pool->usage_bitmap) {
-        heap_caps_free(pool->pool_memory);
         ESP_LOGE(TAG, "Failed to allocate bitmap for %s pool", config->name);
         return false;
     }
-
-    // สร้าง free list
-    uint8_t* memory_ptr = (uint8_t*)pool->pool_memory;
-    pool->free_list = NULL;
-    for (int i = 0; i < (int)config->block_count; i++) {
-        memory_block_t* block = (memory_block_t*)(memory_ptr + (i * total_block_size));
-        block->magic = POOL_MAGIC_FREE;
-        block->pool_id = pool_id;
-        block->alloc_time = 0;
-        block->next = pool->free_list;
-        pool->free_list = block;
+    memset(pool->usage_bitmap, 0xFF, bitmap_words * sizeof(uint32_t));
+    pool->bitmap_words = bitmap_words;
+    pool->use_bitmap_alloc = POOL_BITMAP_ALLOC || pool->oob_metadata;
+
+#if POOL_DEBUG_CHECKS
+    // metadata แยก: สถานะ 1 byte/block + canary ท้าย payload แทน magic/pool_id
+    if (pool->oob_metadata) {
+        pool->block_state = (uint8_t*)heap_caps_calloc(max_blocks, 1, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        if (!pool->block_state) {
+            heap_caps_free(pool->usage_bitmap);
+            ESP_LOGE(TAG, "Failed to allocate block state for %s pool", config->name);
+            return false;
+        }
     }
+#endif
 
     // Mutex
     pool->mutex = xSemaphoreCreateMutex();
     if (!pool->mutex) {
-        heap_caps_free(pool->pool_memory);
         heap_caps_free(pool->usage_bitmap);
+        heap_caps_free(pool->block_state);
         ESP_LOGE(TAG, "Failed to create mutex for %s pool", config->name);
         return false;
     }
 
-    ESP_LOGI(TAG, "✅ Initialized %s pool: %d blocks × %d bytes = %d total bytes",
-             config->name, (int)config->block_count, (int)config->block_size, (int)total_memory);
+    // Slab แรก
+    if (!pool_add_slab(pool)) {
+        vSemaphoreDelete(pool->mutex);
+        heap_caps_free(pool->usage_bitmap);
+        heap_caps_free(pool->block_state);
+        memset(pool, 0, sizeof(memory_pool_t));
+        ESP_LOGE(TAG, "Failed to allocate memory for %s pool", config->name);
+        return false;
+    }
+
+    // Magazines เริ่มว่าง เติมจาก free_list เมื่อใช้งานครั้งแรก
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        portMUX_INITIALIZE(&pool->magazines[core].lock);
+    }
+    // ไม่ให้ magazine กัก block เกินครึ่ง pool
+    pool->magazine_capacity = config->block_count / (2 * portNUM_PROCESSORS);
+    if (pool->magazine_capacity > POOL_MAGAZINE_SIZE) pool->magazine_capacity = POOL_MAGAZINE_SIZE;
+    pool->magazine_batch = (pool->magazine_capacity < POOL_MAGAZINE_BATCH) ? pool->magazine_capacity : POOL_MAGAZINE_BATCH;
+    if (pool->magazine_batch == 0) pool->magazine_batch = 1;
+    pool->use_magazines = POOL_MAGAZINE_ENABLED && pool->magazine_capacity > 0;
+
+    ESP_LOGI(TAG, "✅ Initialized %s pool: %d blocks × %d bytes = %d total bytes%s (up to %d slabs)",
+             config->name, (int)config->block_count, (int)config->block_size,
+             (int)(pool->block_stride * pool->slab_blocks),
+             pool->oob_metadata ? " (out-of-band metadata)" : "", (int)pool->max_slabs);
     return true;
 }
 
-void* pool_malloc(memory_pool_t* pool) {
-    if (!pool || !pool->mutex) return NULL;
+static inline size_t pool_total_block_size(const memory_pool_t* pool) {
+    return pool->block_stride;
+}
 
-    uint64_t start_time = esp_timer_get_time();
-    void* result = NULL;
+// slab ที่มี block นี้ หรือ -1 (ส่วนใหญ่มี slab เดียว วนไม่กี่รอบ)
+static inline int pool_block_slab(const memory_pool_t* pool, const memory_block_t* block) {
+    const size_t slab_bytes = pool->block_stride * pool->slab_blocks;
+    for (int s = 0; s < (int)pool->slab_count; s++) {
+        const uint8_t* start = (const uint8_t*)pool->slabs[s];
+        if ((const uint8_t*)block >= start && (const uint8_t*)block < start + slab_bytes) return s;
+    }
+    return -1;
+}
+static inline size_t pool_block_index(const memory_pool_t* pool, const memory_block_t* block) {
+    const int s = pool_block_slab(pool, block);
+    if (s < 0) return SIZE_MAX;
+    return s * pool->slab_blocks + ((const uint8_t*)block - (const uint8_t*)pool->slabs[s]) / pool_total_block_size(pool);
+}
+static inline memory_block_t* pool_block_at(const memory_pool_t* pool, size_t index) {
+    return (memory_block_t*)((uint8_t*)pool->slabs[index / pool->slab_blocks] +
+                             (index % pool->slab_blocks) * pool_total_block_size(pool));
+}
 
-    if (xSemaphoreTake(pool->mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
-        if (pool->free_list) {
-            memory_block_t* block = pool->free_list;
-            pool->free_list = block->next;
+// Block handle: header inline -> ชี้ header, metadata แยก -> ชี้ payload เลย (ห้าม dereference เป็น header)
+static inline void* pool_block_payload(const memory_pool_t* pool, memory_block_t* block) {
+    return pool->oob_metadata ? (void*)block : (uint8_t*)block + sizeof(memory_block_t);
+}
+static inline memory_block_t* pool_payload_block(const memory_pool_t* pool, void* ptr) {
+    return pool->oob_metadata ? (memory_block_t*)ptr : (memory_block_t*)((uint8_t*)ptr - sizeof(memory_block_t));
+}
 
-            if (block->magic != POOL_MAGIC_FREE || block->pool_id != pool->pool_id) {
+// ตรวจว่า block อยู่ในสถานะ magic ที่คาด (metadata แยก: ตรวจ state + canary เฉพาะ debug build)
+static inline bool pool_block_valid(const memory_pool_t* pool, memory_block_t* block, uint32_t magic) {
+    if (!pool->oob_metadata) return block->magic == magic && block->pool_id == pool->pool_id;
+#if POOL_DEBUG_CHECKS
+    uint32_t canary;
+    memcpy(&canary, (uint8_t*)block + pool->block_size, sizeof(canary));
+    return canary == POOL_CANARY &&
+           pool->block_state[pool_block_index(pool, block)] == (magic == POOL_MAGIC_ALLOC);
+#else
+    return true;
+#endif
+}
+// metadata แยกไม่มี magic กันไว้ จึงต้องเช็คด้วยว่า ptr ตรงต้น block พอดี
+static inline bool pool_block_in_bounds(const memory_pool_t* pool, const memory_block_t* block) {
+    const int s = pool_block_slab(pool, block);
+    if (s < 0) return false;
+    return !pool->oob_metadata || ((const uint8_t*)block - (const uint8_t*)pool->slabs[s]) % pool->block_stride == 0;
+}
+static inline void pool_block_mark(const memory_pool_t* pool, memory_block_t* block, uint32_t magic, uint64_t now) {
+    if (!pool->oob_metadata) {
+        block->magic = magic;
+        if (magic == POOL_MAGIC_ALLOC) block->alloc_time = now;
+        return;
+    }
+#if POOL_DEBUG_CHECKS
+    pool->block_state[pool_block_index(pool, block)] = (magic == POOL_MAGIC_ALLOC);
+#endif
+}
+
+// Mutex ของ pool บน alloc/free path (บันทึกเวลารอ lock ลง histogram)
+static inline BaseType_t pool_lock(memory_pool_t* pool, TickType_t timeout) {
+    HIST_START();
+    BaseType_t ok = xSemaphoreTake(pool->mutex, timeout);
+    HIST_RECORD(&pool->lock_wait_hist);
+    return ok;
+}
+
+// ====== Shared free_list / bitmap (caller must hold pool->mutex) ======
+// bitmap: 1 = block ไม่อยู่ใน free_list (ถูกใช้อยู่ หรือพักอยู่ใน magazine)
+// รวม bit ของ block ที่อยู่ word เดียวกันแล้วเขียนครั้งเดียว
+static void bitmap_update(memory_pool_t* pool, memory_block_t** blocks, int count, bool set) {
+    int i = 0;
+    while (i < count) {
+        const size_t index = pool_block_index(pool, blocks[i++]);
+        if (index >= pool->block_count) continue;
+        const size_t word = index / 32;
+        uint32_t mask = 1U << (index % 32);
+        while (i < count) {
+            const size_t next = pool_block_index(pool, blocks[i]);
+            if (next >= pool->block_count || next / 32 != word) break;
+            mask |= 1U << (next % 32);
+            i++;
+        }
+        if (set) {
+            pool->usage_bitmap[word] |= mask;
+        } else {
+            pool->usage_bitmap[word] &= ~mask;
+            if (word < pool->bitmap_hint) pool->bitmap_hint = word;
+        }
+    }
+}
+
+// ====== Slabs (caller must hold pool->mutex, ยกเว้นตอน init) ======
+static bool pool_add_slab(memory_pool_t* pool) {
+    if (pool->slab_count >= pool->max_slabs) return false;
+
+    const size_t slab_bytes = pool->block_stride * pool->slab_blocks;
+    uint8_t* memory = pool->oob_metadata ? heap_caps_aligned_alloc(pool->alignment, slab_bytes, pool->slab_caps)
+                                         : heap_caps_malloc(slab_bytes, pool->slab_caps);
+    if (!memory) return false;
+
+    // ลงทะเบียน range ก่อนแจก block: smart_pool_free ไม่มีทางอื่นหาเจ้าของ (ไม่เจอ = ส่งให้ heap_caps_free)
+    if (!pool_range_register(pool, memory, slab_bytes)) {
+        ESP_LOGW(TAG, "Range table full: %s pool cannot add a slab", pool->name);
+        heap_caps_free(memory);
+        return false;
+    }
+
+    const int slab = pool->slab_count;
+    const size_t first = slab * pool->slab_blocks;
+    for (size_t i = 0; i < pool->slab_blocks; i++) {
+        uint8_t* at = memory + i * pool->block_stride;
+        if (pool->oob_metadata) {
+#if POOL_DEBUG_CHECKS
+            const uint32_t canary = POOL_CANARY;
+            memcpy(at + pool->block_size, &canary, sizeof(canary));
+            pool->block_state[first + i] = 0;
+#endif
+            continue;
+        }
+        // สร้าง free list (โหมด bitmap: เขียนแค่ header ไม่ต้อง link block ว่าง)
+        memory_block_t* block = (memory_block_t*)at;
+        block->magic = POOL_MAGIC_FREE;
+        block->pool_id = pool->pool_id;
+        block->alloc_time = 0;
+        block->next = NULL;
+        if (!pool->use_bitmap_alloc) {
+            block->next = pool->free_list;
+            pool->free_list = block;
+        }
+    }
+
+    // เผยแพร่ slab ก่อนเพิ่ม slab_count (pool_free อ่านโดยไม่ถือ mutex)
+    pool->slabs[slab] = memory;
+    atomic_thread_fence(memory_order_release);
+    pool->slab_count++;
+    pool->block_count += pool->slab_blocks;
+    for (size_t i = first; i < first + pool->slab_blocks; i++) pool->usage_bitmap[i / 32] &= ~(1U << (i % 32));
+    if (first / 32 < pool->bitmap_hint) pool->bitmap_hint = first / 32;
+    if (pool->slab_count > pool->peak_slabs) pool->peak_slabs = pool->slab_count;
+    pool->slab_empty_since = 0;
+    return true;
+}
+
+// ขยาย pool เมื่อ shared layer หมด (log นอก hot path ของ magazine แล้ว เพราะเกิดไม่บ่อย)
+static bool pool_grow(memory_pool_t* pool) {
+    if (pool->slab_count == 0 || !pool_add_slab(pool)) return false;
+    pool->grow_events++;
+    ESP_LOGI(TAG, "📈 %s pool grew to %d slabs (%d blocks)", pool->name, (int)pool->slab_count, (int)pool->block_count);
+    return true;
+}
+
+// slab บนสุดว่างทั้งก้อนหรือไม่ (ทุก bit เป็น 0 = อยู่ใน shared layer หมด)
+static bool pool_top_slab_empty(const memory_pool_t* pool) {
+    const size_t first = (pool->slab_count - 1) * pool->slab_blocks;
+    for (size_t i = first; i < first + pool->slab_blocks; i++) {
+        if (pool->usage_bitmap[i / 32] & (1U << (i % 32))) return false;
+    }
+    return true;
+}
+
+static void pool_release_top_slab(memory_pool_t* pool) {
+    const int slab = pool->slab_count - 1;
+    const size_t first = slab * pool->slab_blocks;
+    uint8_t* memory = (uint8_t*)pool->slabs[slab];
+    const size_t slab_bytes = pool->block_stride * pool->slab_blocks;
+
+    // ถอด block ของ slab นี้ออกจาก free_list
+    if (!pool->use_bitmap_alloc) {
+        memory_block_t** link = &pool->free_list;
+        while (*link) {
+            if ((uint8_t*)*link >= memory && (uint8_t*)*link < memory + slab_bytes) *link = (*link)->next;
+            else link = &(*link)->next;
+        }
+    }
+    for (size_t i = first; i < first + pool->slab_blocks; i++) pool->usage_bitmap[i / 32] |= 1U << (i % 32);
+
+    pool_range_unregister(pool, memory);
+    pool->slab_count--;
+    pool->block_count -= pool->slab_blocks;
+    pool->slabs[slab] = NULL;
+    pool->shrink_events++;
+    pool->slab_empty_since = 0;
+    heap_caps_free(memory);
+}
+
+// โหมด bitmap: หา bit 0 ด้วย ctz ทีละ word เริ่มจาก hint -> block address ต่ำสุดก่อน
+static int bitmap_take_blocks(memory_pool_t* pool, memory_block_t** out, int max_blocks) {
+    int taken = 0;
+    for (size_t w = pool->bitmap_hint; w < pool->bitmap_words && taken < max_blocks; w++) {
+        uint32_t free_bits = ~pool->usage_bitmap[w];
+        uint32_t grabbed = 0;
+        while (free_bits && taken < max_blocks) {
+            const int bit = __builtin_ctz(free_bits);
+            free_bits &= free_bits - 1;
+            grabbed |= 1U << bit;
+
+            memory_block_t* block = pool_block_at(pool, w * 32 + bit);
+            if (!pool_block_valid(pool, block, POOL_MAGIC_FREE)) {
+                // กัก block เสียไว้ (bit ค้างเป็น 1) integrity check จะเห็นว่าไม่ตรง
                 ESP_LOGE(TAG, "🚨 Corruption detected in %s pool block %p!", pool->name, block);
                 gpio_set_level(LED_POOL_ERROR, 1);
-                xSemaphoreGive(pool->mutex);
-                return NULL;
+                continue;
             }
+            out[taken++] = block;
+        }
+        pool->usage_bitmap[w] |= grabbed;
+    }
+    while (pool->bitmap_hint < pool->bitmap_words && pool->usage_bitmap[pool->bitmap_hint] == ~0U) pool->bitmap_hint++;
+    return taken;
+}
 
-            block->magic = POOL_MAGIC_ALLOC;
-            block->alloc_time = esp_timer_get_time();
-            block->next = NULL;
+// จำนวน block ที่ไม่อยู่ใน shared layer (ใช้อยู่ + พักใน magazine), O(words)
+static size_t bitmap_count_taken(const memory_pool_t* pool) {
+    size_t bits = 0;
+    for (size_t w = 0; w < pool->bitmap_words; w++) bits += __builtin_popcount(pool->usage_bitmap[w]);
+    return bits - (pool->bitmap_words * 32 - pool->block_count);
+}
 
-            pool->allocated_blocks++;
-            if (pool->allocated_blocks > pool->peak_usage) pool->peak_usage = pool->allocated_blocks;
-            pool->total_allocations++;
+// ตัด sublist ยาว max_blocks ออกจากหัว free_list ทีเดียว (caller ถือ mutex)
+static int freelist_take_blocks(memory_pool_t* pool, memory_block_t** out, int max_blocks) {
+    int taken = 0;
+    memory_block_t* block = pool->free_list;
+    while (taken < max_blocks && block) {
+        if (!pool_block_valid(pool, block, POOL_MAGIC_FREE)) {
+            ESP_LOGE(TAG, "🚨 Corruption detected in %s pool block %p!", pool->name, block);
+            gpio_set_level(LED_POOL_ERROR, 1);
+            break;
+        }
+        out[taken++] = block;
+        block = block->next;
+    }
+    pool->free_list = block;
+    if (taken > 0) out[taken - 1]->next = NULL;
 
-            const size_t header_size        = sizeof(memory_block_t);
-            const size_t aligned_block_size = align_up(pool->block_size, pool->alignment);
-            const size_t total_block_size   = header_size + aligned_block_size;
-            const size_t block_index = ((uint8_t*)block - (uint8_t*)pool->pool_memory) / total_block_size;
+    bitmap_update(pool, out, taken, true);
+    return taken;
+}
 
-            if (block_index < pool->block_count) {
-                pool->usage_bitmap[block_index / 8] |= (1U << (block_index % 8));
-            }
+// ไม่พอ -> ขอ slab เพิ่ม (ถ้ายังไม่ถึง max_slabs) แทนการ fallback ไป heap
+static int shared_take_blocks(memory_pool_t* pool, memory_block_t** out, int max_blocks) {
+    int taken = 0;
+    do {
+        taken += pool->use_bitmap_alloc ? bitmap_take_blocks(pool, out + taken, max_blocks - taken)
+                                        : freelist_take_blocks(pool, out + taken, max_blocks - taken);
+    } while (taken < max_blocks && pool_grow(pool));
+    return taken;
+}
+
+// ต่อ blocks[] เป็น sublist แล้ว splice เข้าหัว free_list ทีเดียว (caller ถือ mutex)
+static void shared_return_blocks(memory_pool_t* pool, memory_block_t** blocks, int count) {
+    if (count <= 0) return;
+    if (pool->use_bitmap_alloc) {
+        bitmap_update(pool, blocks, count, false);
+        return;
+    }
+    for (int i = 0; i < count - 1; i++) blocks[i]->next = blocks[i + 1];
+    blocks[count - 1]->next = pool->free_list;
+    pool->free_list = blocks[0];
+
+    bitmap_update(pool, blocks, count, false);
+}
+
+// Block ที่ผู้ใช้ถืออยู่ = alloc - free รวมทุกทาง (shared path + magazines)
+static void pool_totals(const memory_pool_t* pool, uint64_t* allocs, uint64_t* frees) {
+    *allocs = pool->total_allocations;
+    *frees  = pool->total_deallocations;
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        *allocs += pool->magazines[core].allocations;
+        *frees  += pool->magazines[core].deallocations;
+    }
+}
+
+static uint64_t pool_requested_bytes(const memory_pool_t* pool) {
+    uint64_t requested = pool->requested_bytes;
+    for (int core = 0; core < portNUM_PROCESSORS; core++) requested += pool->magazines[core].requested_bytes;
+    return requested;
+}
+
+size_t pool_used_blocks(const memory_pool_t* pool) {
+    uint64_t allocs, frees;
+    pool_totals(pool, &allocs, &frees);
+    return (allocs > frees) ? (size_t)(allocs - frees) : 0;
+}
+
+// ====== Per-core magazines ======
+// Shared list ว่าง: ขอ block จาก magazine ของ core อื่นก่อนจะถือว่า pool หมด
+static memory_block_t* magazine_steal(memory_pool_t* pool) {
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        pool_magazine_t* victim = &pool->magazines[core];
+        memory_block_t* block = NULL;
+        portENTER_CRITICAL(&victim->lock);
+        if (victim->count > 0) block = victim->blocks[--victim->count];
+        portEXIT_CRITICAL(&victim->lock);
+        if (block) return block;
+    }
+    return NULL;
+}
+
+static memory_block_t* magazine_alloc(memory_pool_t* pool, size_t requested) {
+    pool_magazine_t* mag = &pool->magazines[xPortGetCoreID()];
+    memory_block_t* block = NULL;
+
+    portENTER_CRITICAL(&mag->lock);
+    if (mag->count > 0) {
+        block = mag->blocks[--mag->count];
+        mag->hits++;
+        mag->allocations++;
+        mag->requested_bytes += requested;
+    }
+    portEXIT_CRITICAL(&mag->lock);
+    if (block) return block;
+
+    // Miss: ดึงทีละ batch จาก free_list ด้วย mutex ครั้งเดียว
+    memory_block_t* batch[POOL_MAGAZINE_BATCH];
+    int taken = 0;
+    if (pool_lock(pool, pdMS_TO_TICKS(100)) != pdTRUE) return NULL;
+    taken = shared_take_blocks(pool, batch, pool->magazine_batch);
+    xSemaphoreGive(pool->mutex);
+
+    if (taken == 0) {
+        block = magazine_steal(pool);
+        if (!block) {
+            pool->allocation_failures++;
+            ESP_LOGW(TAG, "🔴 %s pool exhausted! (%d/%d blocks used)",
+                     pool->name, (int)pool_used_blocks(pool), (int)pool->block_count);
+            gpio_set_level(LED_POOL_FULL, 1);
+            return NULL;
+        }
+        batch[0] = block;
+        taken = 1;
+    }
+
+    // ช่วงที่ปล่อย lock ไป task อื่นบน core เดียวกันอาจเติม magazine แล้ว -> ส่วนเกินคืน free_list
+    int overflow = 0;
+    portENTER_CRITICAL(&mag->lock);
+    mag->refills++;
+    mag->allocations++;
+    mag->requested_bytes += requested;
+    for (int i = 1; i < taken; i++) {
+        if (mag->count < pool->magazine_capacity) mag->blocks[mag->count++] = batch[i];
+        else batch[1 + overflow++] = batch[i];
+    }
+    portEXIT_CRITICAL(&mag->lock);
+
+    if (overflow > 0 && pool_lock(pool, portMAX_DELAY) == pdTRUE) {
+        shared_return_blocks(pool, &batch[1], overflow);
+        xSemaphoreGive(pool->mutex);
+    }
+    return batch[0];
+}
+
+static void magazine_free(memory_pool_t* pool, memory_block_t* block) {
+    pool_magazine_t* mag = &pool->magazines[xPortGetCoreID()];
+    memory_block_t* drained[POOL_MAGAZINE_BATCH];
+    int drain_count = 0;
+
+    portENTER_CRITICAL(&mag->lock);
+    if (mag->count >= pool->magazine_capacity) {
+        while (drain_count < (int)pool->magazine_batch && mag->count > 0) drained[drain_count++] = mag->blocks[--mag->count];
+        mag->drains++;
+    }
+    mag->blocks[mag->count++] = block;
+    mag->deallocations++;
+    portEXIT_CRITICAL(&mag->lock);
 
-            result = (uint8_t*)block + header_size;
-            ESP_LOGD(TAG, "🟢 %s pool: allocated block %p (index %d)", pool->name, result, (int)block_index);
+    if (drain_count > 0 && pool_lock(pool, portMAX_DELAY) == pdTRUE) {
+        shared_return_blocks(pool, drained, drain_count);
+        xSemaphoreGive(pool->mutex);
+    }
+}
+
+// คืน block ทั้งหมดที่พักอยู่ใน magazine กลับ free_list (ใช้ก่อน integrity check / benchmark)
+void pool_flush_magazines(memory_pool_t* pool) {
+    if (!pool || !pool->mutex) return;
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        pool_magazine_t* mag = &pool->magazines[core];
+        memory_block_t* cached[POOL_MAGAZINE_SIZE];
+        int count = 0;
+
+        portENTER_CRITICAL(&mag->lock);
+        while (mag->count > 0) cached[count++] = mag->blocks[--mag->count];
+        portEXIT_CRITICAL(&mag->lock);
+
+        if (count > 0 && xSemaphoreTake(pool->mutex, portMAX_DELAY) == pdTRUE) {
+            shared_return_blocks(pool, cached, count);
+            xSemaphoreGive(pool->mutex);
+        }
+    }
+}
+
+// เรียกเป็นระยะ (pool_monitor_task): คืน slab บนสุดที่ว่างต่อเนื่องเกิน cool-down
+void pool_maybe_shrink(memory_pool_t* pool) {
+    if (!pool || !pool->mutex || pool->slab_count <= 1) return;
+
+    if (xSemaphoreTake(pool->mutex, pdMS_TO_TICKS(100)) != pdTRUE) return;
+    bool empty = pool_top_slab_empty(pool);
+    xSemaphoreGive(pool->mutex);
+    if (!empty) {
+        // block อาจพักอยู่ใน magazine: คืนก่อนแล้วดูใหม่
+        pool_flush_magazines(pool);
+    }
+
+    if (xSemaphoreTake(pool->mutex, pdMS_TO_TICKS(100)) != pdTRUE) return;
+    const uint64_t now = esp_timer_get_time();
+    if (pool->slab_count > 1 && pool_top_slab_empty(pool)) {
+        if (pool->slab_empty_since == 0) {
+            pool->slab_empty_since = now;
+        } else if (now - pool->slab_empty_since >= (uint64_t)POOL_SLAB_COOLDOWN_MS * 1000) {
+            pool_release_top_slab(pool);
+            ESP_LOGI(TAG, "📉 %s pool shrank to %d slabs (%d blocks)", pool->name, (int)pool->slab_count, (int)pool->block_count);
+        }
+    } else {
+        pool->slab_empty_since = 0;
+    }
+    xSemaphoreGive(pool->mutex);
+}
+
+void destroy_memory_pool(memory_pool_t* pool) {
+    if (!pool || !pool->mutex) return;
+    pool_flush_magazines(pool);
+    size_t used = pool_used_blocks(pool);
+    if (used > 0) ESP_LOGW(TAG, "⚠️ Destroying %s pool with %d blocks still in use", pool->name, (int)used);
+
+    pool_range_unregister(pool, NULL);
+    vSemaphoreDelete(pool->mutex);
+    for (uint32_t slab = 0; slab < pool->slab_count; slab++) heap_caps_free(pool->slabs[slab]);
+    heap_caps_free(pool->usage_bitmap);
+    heap_caps_free(pool->block_state);
+    memset(pool, 0, sizeof(memory_pool_t));
+}
+
+// requested = ขนาดที่ผู้ใช้ขอจริง ใช้คำนวณ internal fragmentation ของ class
+static void* pool_malloc_sized(memory_pool_t* pool, size_t requested) {
+    if (!pool || !pool->mutex) return NULL;
+
+    HIST_START();
+#if POOL_TIMING_STATS
+    uint64_t start_time = esp_timer_get_time();
+#else
+    const uint64_t start_time = 0;
+#endif
+    memory_block_t* block = NULL;
+
+    if (pool->use_magazines) {
+        block = magazine_alloc(pool, requested);
+        if (block) {
+            pool_block_mark(pool, block, POOL_MAGIC_ALLOC, start_time);
+
+            size_t used = pool_used_blocks(pool);
+            if (used > pool->peak_usage) pool->peak_usage = used; // approximate under contention
+        }
+    } else if (pool_lock(pool, pdMS_TO_TICKS(100)) == pdTRUE) {
+        if (shared_take_blocks(pool, &block, 1) == 1) {
+            pool_block_mark(pool, block, POOL_MAGIC_ALLOC, start_time);
+
+            pool->total_allocations++;
+            pool->requested_bytes += requested;
+            size_t used = pool_used_blocks(pool);
+            if (used > pool->peak_usage) pool->peak_usage = used;
         } else {
             pool->allocation_failures++;
-            ESP_LOGW(TAG, "🔴 %s pool exhausted! (%d/%d blocks used)", pool->name, (int)pool->allocated_blocks, (int)pool->block_count);
+            ESP_LOGW(TAG, "🔴 %s pool exhausted! (%d/%d blocks used)",
+                     pool->name, (int)pool_used_blocks(pool), (int)pool->block_count);
             gpio_set_level(LED_POOL_FULL, 1);
         }
         xSemaphoreGive(pool->mutex);
     }
 
-    pool->allocation_time_total += (esp_timer_get_time() - start_time);
+    void* result = block ? pool_block_payload(pool, block) : NULL;
+    if (result) ESP_LOGD(TAG, "🟢 %s pool: allocated block %p (index %d)", pool->name, result, (int)pool_block_index(pool, block));
+
+#if POOL_TIMING_STATS
+    atomic_fetch_add_explicit(&pool->allocation_time_total, esp_timer_get_time() - start_time, memory_order_relaxed);
+#endif
+    HIST_RECORD(&pool->alloc_hist);
     return result;
 }
 
+void* pool_malloc(memory_pool_t* pool) {
+    return pool ? pool_malloc_sized(pool, pool->block_size) : NULL;
+}
+
 bool pool_free(memory_pool_t* pool, void* ptr) {
     if (!pool || !ptr || !pool->mutex) return false;
 
+    HIST_START();
+#if POOL_TIMING_STATS
     uint64_t start_time = esp_timer_get_time();
-    bool ok = false;
+#endif
+    memory_block_t* block = pool_payload_block(pool, ptr);
 
-    if (xSemaphoreTake(pool->mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
-        const size_t header_size = sizeof(memory_block_t);
-        memory_block_t* block = (memory_block_t*)((uint8_t*)ptr - header_size);
+    if (!pool_block_in_bounds(pool, block)) {
+        ESP_LOGE(TAG, "🚨 Block %p out of bounds (or not a block start) for %s pool!", ptr, pool->name);
+        gpio_set_level(LED_POOL_ERROR, 1);
+        return false;
+    }
 
-        if (block->magic != POOL_MAGIC_ALLOC || block->pool_id != pool->pool_id) {
+    // อยู่ในช่วงของ pool และเป็นของผู้เรียก ตรวจ header ได้โดยไม่ต้องถือ mutex
+    if (!pool_block_valid(pool, block, POOL_MAGIC_ALLOC)) {
+        if (pool->oob_metadata) {
+            ESP_LOGE(TAG, "🚨 Invalid block %p for %s pool! (double free or canary overwritten)", ptr, pool->name);
+        } else {
             ESP_LOGE(TAG, "🚨 Invalid block %p for %s pool! Magic: 0x%08X, Pool ID: %lu",
-                     ptr, pool->name, block->magic, (unsigned long)block->pool_id);
-            gpio_set_level(LED_POOL_ERROR, 1);
-            xSemaphoreGive(pool->mutex);
-            return false;
+                     ptr, pool->name, (unsigned)block->magic, (unsigned long)block->pool_id);
         }
+        gpio_set_level(LED_POOL_ERROR, 1);
+        return false;
+    }
 
-        const size_t aligned_block_size = align_up(pool->block_size, pool->alignment);
-        const size_t total_block_size   = header_size + aligned_block_size;
-
-        if ((uint8_t*)block >= (uint8_t*)pool->pool_memory &&
-            (uint8_t*)block < (uint8_t*)pool->pool_memory + (total_block_size * pool->block_count)) {
+    pool_block_mark(pool, block, POOL_MAGIC_FREE, 0);
+    bool ok = true;
 
-            const size_t block_index = ((uint8_t*)block - (uint8_t*)pool->pool_memory) / total_block_size;
+    if (pool->use_magazines) {
+        magazine_free(pool, block);
+    } else if (pool_lock(pool, pdMS_TO_TICKS(100)) == pdTRUE) {
+        shared_return_blocks(pool, &block, 1);
+        pool->total_deallocations++;
+        xSemaphoreGive(pool->mutex);
+    } else {
+        pool_block_mark(pool, block, POOL_MAGIC_ALLOC, 0);
+        ok = false;
+    }
 
-            if (block_index < pool->block_count) {
-                pool->usage_bitmap[block_index / 8] &= ~(1U << (block_index % 8));
-            }
+    if (ok) ESP_LOGD(TAG, "🟢 %s pool: freed block %p (index %d)", pool->name, ptr, (int)pool_block_index(pool, block));
 
-            block->magic = POOL_MAGIC_FREE;
-            block->next = pool->free_list;
-            pool->free_list = block;
+#if POOL_TIMING_STATS
+    atomic_fetch_add_explicit(&pool->deallocation_time_total, esp_timer_get_time() - start_time, memory_order_relaxed);
+#endif
+    HIST_RECORD(&pool->free_hist);
+    return ok;
+}
 
-            pool->allocated_blocks--;
-            pool->total_deallocations++;
-            ok = true;
+// ====== Batch API ======
+// ใช้ mutex ครั้งเดียวต่อ batch, ตัด/ต่อ free_list เป็น sublist และแก้ bitmap ทีละ word
+// (ทำงานกับ free_list ตรง ๆ ไม่ผ่าน magazine) คืนจำนวน block ที่ได้จริง (อาจน้อยกว่า n)
+size_t pool_malloc_n(memory_pool_t* pool, void** out, size_t n) {
+    if (!pool || !out || !pool->mutex || n == 0) return 0;
 
-            ESP_LOGD(TAG, "🟢 %s pool: freed block %p (index %d)", pool->name, ptr, (int)block_index);
-        } else {
-            ESP_LOGE(TAG, "🚨 Block %p out of bounds for %s pool!", ptr, pool->name);
-            gpio_set_level(LED_POOL_ERROR, 1);
+    HIST_START();
+#if POOL_TIMING_STATS
+    uint64_t start_time = esp_timer_get_time();
+#else
+    const uint64_t start_time = 0;
+#endif
+    memory_block_t* chunk[POOL_BULK_CHUNK];
+    size_t got = 0;
+
+    if (pool_lock(pool, pdMS_TO_TICKS(100)) != pdTRUE) return 0;
+    while (got < n) {
+        const int want = (n - got < POOL_BULK_CHUNK) ? (int)(n - got) : POOL_BULK_CHUNK;
+        const int taken = shared_take_blocks(pool, chunk, want);
+        for (int i = 0; i < taken; i++) {
+            pool_block_mark(pool, chunk[i], POOL_MAGIC_ALLOC, start_time);
+            out[got++] = pool_block_payload(pool, chunk[i]);
         }
-        xSemaphoreGive(pool->mutex);
+        if (taken < want) break;
     }
+    pool->total_allocations += got;
+    pool->requested_bytes   += (uint64_t)got * pool->block_size;
+    size_t used = pool_used_blocks(pool);
+    if (used > pool->peak_usage) pool->peak_usage = used;
+    if (got < n) pool->allocation_failures++;
+    xSemaphoreGive(pool->mutex);
+
+    ESP_LOGD(TAG, "🟢 %s pool: batch allocated %d/%d blocks", pool->name, (int)got, (int)n);
+#if POOL_TIMING_STATS
+    atomic_fetch_add_explicit(&pool->allocation_time_total, esp_timer_get_time() - start_time, memory_order_relaxed);
+#endif
+    HIST_RECORD(&pool->alloc_hist);  // ทั้ง batch นับเป็น 1 ครั้ง
+    return got;
+}
 
-    pool->deallocation_time_total += (esp_timer_get_time() - start_time);
-    return ok;
+// คืนจำนวน pointer ที่ free สำเร็จ (pointer ที่ไม่ใช่ของ pool หรือ header เสียจะถูกข้าม)
+size_t pool_free_n(memory_pool_t* pool, void* const* ptrs, size_t n) {
+    if (!pool || !ptrs || !pool->mutex || n == 0) return 0;
+
+    HIST_START();
+#if POOL_TIMING_STATS
+    uint64_t start_time = esp_timer_get_time();
+#endif
+    memory_block_t* chunk[POOL_BULK_CHUNK];
+    size_t freed = 0;
+
+    if (pool_lock(pool, pdMS_TO_TICKS(100)) != pdTRUE) return 0;
+    size_t i = 0;
+    while (i < n) {
+        int count = 0;
+        for (; i < n && count < POOL_BULK_CHUNK; i++) {
+            if (!ptrs[i]) continue;
+            memory_block_t* block = pool_payload_block(pool, ptrs[i]);
+            if (!pool_block_in_bounds(pool, block) || !pool_block_valid(pool, block, POOL_MAGIC_ALLOC)) {
+                ESP_LOGE(TAG, "🚨 Invalid block %p in batch free for %s pool!", ptrs[i], pool->name);
+                gpio_set_level(LED_POOL_ERROR, 1);
+                continue;
+            }
+            pool_block_mark(pool, block, POOL_MAGIC_FREE, 0);
+            chunk[count++] = block;
+        }
+        shared_return_blocks(pool, chunk, count);
+        freed += count;
+    }
+    pool->total_deallocations += freed;
+    xSemaphoreGive(pool->mutex);
+
+    ESP_LOGD(TAG, "🟢 %s pool: batch freed %d/%d blocks", pool->name, (int)freed, (int)n);
+#if POOL_TIMING_STATS
+    atomic_fetch_add_explicit(&pool->deallocation_time_total, esp_timer_get_time() - start_time, memory_order_relaxed);
+#endif
+    HIST_RECORD(&pool->free_hist);
+    return freed;
 }
 
 // ====== Smart pool allocator ======
 void* smart_pool_malloc(size_t size) {
-    const size_t required_size = size + 16; // safety margin
-    for (int i = 0; i < POOL_COUNT; i++) {
-        if (required_size <= pools[i].block_size) {
-            void* ptr = pool_malloc(&pools[i]);
+    if (size > 0 && size <= SIZE_CLASS_MAX_BYTES) {
+        // Table lookup หา class ที่พอดีที่สุด ถ้าเต็มให้ spill ไป class ถัดไปไม่เกิน SIZE_CLASS_SPILL ขั้น
+        const int first = size_to_class(size);
+        const int last  = (first + SIZE_CLASS_SPILL < POOL_COUNT - 1) ? first + SIZE_CLASS_SPILL : POOL_COUNT - 1;
+        for (int i = first; i <= last; i++) {
+            if (!pools[i].mutex) continue;
+            void* ptr = pool_malloc_sized(&pools[i], size);
             if (ptr) {
-                gpio_set_level(pool_configs[i].led_pin, 1);
-                vTaskDelay(pdMS_TO_TICKS(50));
-                gpio_set_level(pool_configs[i].led_pin, 0);
+#if LED_ACTIVITY_ENABLED
+                atomic_fetch_add_explicit(&pools[i].activity, 1, memory_order_relaxed);
+#endif
                 ESP_LOGD(TAG, "🎯 Smart allocation: %d bytes from %s pool", (int)size, pools[i].name);
                 return ptr;
             }
@@ -290,10 +1158,26 @@ void* smart_pool_malloc(size_t size) {
 
 bool smart_pool_free(void* ptr) {
     if (!ptr) return false;
+    memory_pool_t* owner = pool_find_owner(ptr);
+    if (owner) return pool_free(owner, ptr);
+
+    ESP_LOGD(TAG, "🎯 Freeing %p from heap (not from pool)", ptr);
+    heap_caps_free(ptr);
+    return true;
+}
+
+// วิธีเดิม: ลอง pool_free ทีละ pool (ใช้เป็น baseline ใน benchmark เท่านั้น)
+static bool smart_pool_free_probe(void* ptr) {
+    if (!ptr) return false;
+    // แบบเดิม: ถือ mutex ทีละ pool แล้วเช็ค bounds เอง (เงียบ) — ไม่เรียก pool_free กับ pool ผิดตัว
+    // เพราะ path out-of-bounds จะ log error และจุด LED_POOL_ERROR ทุกรอบ benchmark
     for (int i = 0; i < POOL_COUNT; i++) {
-        if (pool_free(&pools[i], ptr)) return true;
+        memory_pool_t* pool = &pools[i];
+        if (!pool->mutex || xSemaphoreTake(pool->mutex, portMAX_DELAY) != pdTRUE) continue;
+        bool owned = pool_block_in_bounds(pool, pool_payload_block(pool, ptr));
+        xSemaphoreGive(pool->mutex);
+        if (owned) return pool_free(pool, ptr);
     }
-    ESP_LOGD(TAG, "🎯 Freeing %p from heap (not from pool)", ptr);
     heap_caps_free(ptr);
     return true;
 }
@@ -304,24 +1188,59 @@ void print_pool_statistics(void) {
     for (int i = 0; i < POOL_COUNT; i++) {
         memory_pool_t* pool = &pools[i];
         if (pool->mutex && xSemaphoreTake(pool->mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
+            uint64_t total_allocs, total_frees;
+            pool_totals(pool, &total_allocs, &total_frees);
+            const size_t used_blocks = pool_used_blocks(pool);
+
+            uint32_t hits = 0, refills = 0, drains = 0, cached = 0;
+            for (int core = 0; core < portNUM_PROCESSORS; core++) {
+                hits    += pool->magazines[core].hits;
+                refills += pool->magazines[core].refills;
+                drains  += pool->magazines[core].drains;
+                cached  += pool->magazines[core].count;
+            }
+
             ESP_LOGI(TAG, "\n%s Pool:", pool->name);
             ESP_LOGI(TAG, "  Block Size:      %d bytes", (int)pool->block_size);
             ESP_LOGI(TAG, "  Total Blocks:    %d", (int)pool->block_count);
+            ESP_LOGI(TAG, "  Slabs:           %lu/%lu (peak %lu), grow %lu, shrink %lu",
+                     (unsigned long)pool->slab_count, (unsigned long)pool->max_slabs, (unsigned long)pool->peak_slabs,
+                     (unsigned long)pool->grow_events, (unsigned long)pool->shrink_events);
             ESP_LOGI(TAG, "  Used Blocks:     %d (%d%%)",
-                     (int)pool->allocated_blocks,
-                     (int)((pool->allocated_blocks * 100) / pool->block_count));
+                     (int)used_blocks,
+                     (int)((used_blocks * 100) / pool->block_count));
             ESP_LOGI(TAG, "  Peak Usage:      %d blocks", (int)pool->peak_usage);
-            ESP_LOGI(TAG, "  Allocations:     %llu", pool->total_allocations);
-            ESP_LOGI(TAG, "  Deallocations:   %llu", pool->total_deallocations);
+            ESP_LOGI(TAG, "  Allocations:     %llu", (unsigned long long)total_allocs);
+            ESP_LOGI(TAG, "  Deallocations:   %llu", (unsigned long long)total_frees);
             ESP_LOGI(TAG, "  Failures:        %lu", (unsigned long)pool->allocation_failures);
-            if (pool->total_allocations > 0) {
-                uint32_t avg_alloc_time = pool->allocation_time_total / pool->total_allocations;
-                ESP_LOGI(TAG, "  Avg Alloc Time:  %lu μs", (unsigned long)avg_alloc_time);
+            if (total_allocs > 0) {
+                // Internal fragmentation = ส่วนของ block ที่ผู้ใช้ไม่ได้ขอ
+                const uint64_t granted   = total_allocs * pool->block_size;
+                const uint64_t requested = pool_requested_bytes(pool);
+                ESP_LOGI(TAG, "  Avg Request:     %lu bytes, Int. Fragmentation: %.1f%%",
+                         (unsigned long)(requested / total_allocs),
+                         granted ? 100.0f * (float)(granted - requested) / (float)granted : 0.0f);
+            }
+            if (pool->use_magazines) {
+                ESP_LOGI(TAG, "  Magazine Hits:   %lu (%d%%), refills %lu, drains %lu, cached %lu",
+                         (unsigned long)hits, total_allocs ? (int)((hits * 100ULL) / total_allocs) : 0,
+                         (unsigned long)refills, (unsigned long)drains, (unsigned long)cached);
+            }
+#if POOL_TIMING_STATS
+            if (total_allocs > 0) {
+                float avg_alloc_time = (float)atomic_load(&pool->allocation_time_total) / total_allocs;
+                ESP_LOGI(TAG, "  Avg Alloc Time:  %.2f μs", avg_alloc_time);
             }
-            if (pool->total_deallocations > 0) {
-                uint32_t avg_dealloc_time = pool->deallocation_time_total / pool->total_deallocations;
-                ESP_LOGI(TAG, "  Avg Dealloc Time: %lu μs", (unsigned long)avg_dealloc_time);
+            if (total_frees > 0) {
+                float avg_dealloc_time = (float)atomic_load(&pool->deallocation_time_total) / total_frees;
+                ESP_LOGI(TAG, "  Avg Dealloc Time: %.2f μs", avg_dealloc_time);
             }
+#endif
+#if POOL_LATENCY_HISTOGRAMS
+            hist_print("Alloc:", &pool->alloc_hist);
+            hist_print("Free:", &pool->free_hist);
+            hist_print("Lock wait:", &pool->lock_wait_hist);
+#endif
             xSemaphoreGive(pool->mutex);
         }
     }
@@ -335,35 +1254,63 @@ void visualize_pool_usage(void) {
         if (pool->mutex && xSemaphoreTake(pool->mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
             char usage_bar[33] = {0}; // 32 chars + null
             const int bar_length = 32;
-            const int used_chars = (pool->allocated_blocks * bar_length) / pool->block_count;
+            const size_t used_blocks = pool_used_blocks(pool);
+            const int used_chars = (used_blocks * bar_length) / pool->block_count;
             for (int j = 0; j < bar_length; j++) usage_bar[j] = (j < used_chars) ? '█' : '░';
             ESP_LOGI(TAG, "%s: [%s] %d/%d",
-                     pool->name, usage_bar, (int)pool->allocated_blocks, (int)pool->block_count);
+                     pool->name, usage_bar, (int)used_blocks, (int)pool->block_count);
             xSemaphoreGive(pool->mutex);
         }
     }
     ESP_LOGI(TAG, "═══════════════════════════════════════");
 }
 
+// Popcount ของ bitmap ต้องเท่ากับ (block ที่ใช้อยู่ + block ที่พักใน magazine) — O(n/32) ไม่ต้องเดิน free_list
+#define INTEGRITY_RETRIES  3   // refill/drain ที่กำลังทำอยู่ทำให้ตัวเลขคลาดชั่วคราวได้
+
 bool check_pool_integrity(void) {
     bool all_ok = true;
     ESP_LOGI(TAG, "\n🔍 ═══ POOL INTEGRITY CHECK ═══");
     for (int i = 0; i < POOL_COUNT; i++) {
         memory_pool_t* pool = &pools[i];
-        bool pool_ok = true;
-        if (pool->mutex && xSemaphoreTake(pool->mutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
-            memory_block_t* current = pool->free_list;
-            int free_count = 0;
-            while (current && free_count < pool->block_count) {
-                if (current->magic != POOL_MAGIC_FREE || current->pool_id != pool->pool_id) {
-                    ESP_LOGE(TAG, "❌ %s pool: Corrupted free block %p", pool->name, current);
-                    pool_ok = false; break;
+        if (!pool->mutex) continue;
+
+        bool pool_ok = false, magazine_ok = true;
+        size_t taken_bits = 0, cached = 0, used = 0;
+        for (int attempt = 0; attempt < INTEGRITY_RETRIES && !pool_ok && magazine_ok; attempt++) {
+            if (attempt > 0) vTaskDelay(1);
+            if (xSemaphoreTake(pool->mutex, pdMS_TO_TICKS(1000)) != pdTRUE) break;
+            taken_bits = bitmap_count_taken(pool);
+
+            // ล็อกทุก magazine พร้อมกันเพื่อให้ counter กับ count ตรงกับ bitmap
+            uint64_t allocs = pool->total_allocations, frees = pool->total_deallocations;
+            cached = 0;
+            for (int core = 0; core < portNUM_PROCESSORS; core++) portENTER_CRITICAL(&pool->magazines[core].lock);
+            for (int core = 0; core < portNUM_PROCESSORS; core++) {
+                pool_magazine_t* mag = &pool->magazines[core];
+                allocs += mag->allocations;
+                frees  += mag->deallocations;
+                cached += mag->count;
+                // Block ที่พักใน magazine ต้องยังเป็น FREE ด้วย
+                for (uint32_t j = 0; j < mag->count; j++) {
+                    if (!pool_block_valid(pool, mag->blocks[j], POOL_MAGIC_FREE)) magazine_ok = false;
                 }
-                current = current->next;
-                free_count++;
             }
-            if (pool_ok) ESP_LOGI(TAG, "✅ %s pool: %d free blocks verified", pool->name, free_count);
+            for (int core = portNUM_PROCESSORS - 1; core >= 0; core--) portEXIT_CRITICAL(&pool->magazines[core].lock);
             xSemaphoreGive(pool->mutex);
+
+            used = (allocs > frees) ? (size_t)(allocs - frees) : 0;
+            pool_ok = magazine_ok && taken_bits == used + cached;
+        }
+
+        if (!magazine_ok) {
+            ESP_LOGE(TAG, "❌ %s pool: Corrupted block in magazine", pool->name);
+        } else if (!pool_ok) {
+            ESP_LOGE(TAG, "❌ %s pool: bitmap marks %d blocks taken, counters say %d used + %d cached",
+                     pool->name, (int)taken_bits, (int)used, (int)cached);
+        } else {
+            ESP_LOGI(TAG, "✅ %s pool: %d free blocks verified",
+                     pool->name, (int)(pool->block_count - taken_bits + cached));
         }
         if (!pool_ok) { all_ok = false; gpio_set_level(LED_POOL_ERROR, 1); }
     }
@@ -414,6 +1361,227 @@ void pool_stress_test_task(void *pvParameters) {
     }
 }
 
+// ====== Contended throughput benchmark ======
+typedef struct {
+    memory_pool_t* pool;
+    int iterations;
+    uint32_t completed_ops;
+    SemaphoreHandle_t done;
+} contention_worker_args_t;
+
+static void contention_worker_task(void *pvParameters) {
+    contention_worker_args_t* args = (contention_worker_args_t*)pvParameters;
+    void* held[CONTENTION_BENCH_BLOCKS];
+    uint32_t ops = 0;
+
+    for (int i = 0; i < args->iterations; i++) {
+        for (int j = 0; j < CONTENTION_BENCH_BLOCKS; j++) {
+            held[j] = pool_malloc(args->pool);
+            if (held[j]) ops++;
+        }
+        for (int j = 0; j < CONTENTION_BENCH_BLOCKS; j++) {
+            if (held[j]) { pool_free(args->pool, held[j]); ops++; }
+        }
+    }
+
+    args->completed_ops = ops;
+    xSemaphoreGive(args->done);
+    vTaskDelete(NULL);
+}
+
+// รัน N task แย่งกัน alloc/free จาก pool เดียวกัน แล้ววัด ops/s รวม
+static float run_contention_benchmark(memory_pool_t* pool, int task_count) {
+    contention_worker_args_t args[8];
+    if (task_count > 8) return 0.0f;
+    SemaphoreHandle_t done = xSemaphoreCreateCounting(task_count, 0);
+    if (!done) return 0.0f;
+
+    uint64_t start = esp_timer_get_time();
+    int started = 0;
+    for (int t = 0; t < task_count; t++) {
+        args[t].pool = pool;
+        args[t].iterations = CONTENTION_BENCH_ITERATIONS;
+        args[t].completed_ops = 0;
+        args[t].done = done;
+        if (xTaskCreatePinnedToCore(contention_worker_task, "PoolBench", 2048, &args[t],
+                                    uxTaskPriorityGet(NULL), NULL, t % portNUM_PROCESSORS) == pdPASS) {
+            started++;
+        }
+    }
+    for (int t = 0; t < started; t++) xSemaphoreTake(done, portMAX_DELAY);
+    uint64_t elapsed = esp_timer_get_time() - start;
+    vSemaphoreDelete(done);
+
+    uint64_t total_ops = 0;
+    for (int t = 0; t < started; t++) total_ops += args[t].completed_ops;
+    return elapsed ? (float)total_ops * 1000000.0f / (float)elapsed : 0.0f;
+}
+
+void pool_contention_benchmark(void) {
+    // Pool ส่วนตัว (config เดียวกับ class 64 B) → สลับโหมดได้โดยไม่ชนกับ task อื่น และตัวเลขไม่ปน traffic ภายนอก
+    static memory_pool_t bench_pool;
+    memory_pool_t* pool = &bench_pool;
+    pool_config_t config = pool_configs[CONTENTION_BENCH_CLASS];
+    config.name = "Contend";
+    if (!init_memory_pool(pool, &config, POOL_COUNT + 3)) return;
+
+    const int task_counts[] = {2, 4, 8};
+
+    ESP_LOGI(TAG, "\n🏁 Contended throughput (%s pool, %d blocks/task):", pool->name, CONTENTION_BENCH_BLOCKS);
+    for (int i = 0; i < sizeof(task_counts) / sizeof(task_counts[0]); i++) {
+        pool_flush_magazines(pool);
+        pool->use_magazines = false;
+        float mutex_ops = run_contention_benchmark(pool, task_counts[i]);
+
+        pool->use_magazines = (pool->magazine_capacity > 0);
+        float magazine_ops = run_contention_benchmark(pool, task_counts[i]);
+
+        ESP_LOGI(TAG, "  %d tasks: mutex %.0f ops/s, magazine %.0f ops/s (%.2fx)",
+                 task_counts[i], mutex_ops, magazine_ops,
+                 mutex_ops > 0 ? magazine_ops / mutex_ops : 0.0f);
+    }
+    destroy_memory_pool(pool);
+}
+
+// ====== Batch API: amortized cost per block ======
+#define BATCH_BENCH_MAX     128
+#define BATCH_BENCH_BLOCKS  4096  // blocks ต่อการวัดหนึ่งครั้ง (รอบ = BLOCKS / batch)
+
+void pool_batch_benchmark(void) {
+    // Pool ส่วนตัว ไม่ไปรบกวน class pools ที่ task อื่นใช้อยู่
+    static memory_pool_t bench_pool;
+    static void* ptrs[BATCH_BENCH_MAX];
+    const pool_config_t config = {"Batch", 64, BATCH_BENCH_MAX, MALLOC_CAP_INTERNAL, LED_SMALL_POOL, POOL_OOB_METADATA, 1};
+    const int batch_sizes[] = {1, 8, 32, 128};
+
+    if (!init_memory_pool(&bench_pool, &config, POOL_COUNT + 1)) return;
+
+    ESP_LOGI(TAG, "\n📦 Batch alloc+free (%d blocks per run, %d B blocks)", BATCH_BENCH_BLOCKS, (int)config.block_size);
+    uint64_t start = esp_timer_get_time();
+    for (int i = 0; i < BATCH_BENCH_BLOCKS; i++) pool_free(&bench_pool, pool_malloc(&bench_pool));
+    uint64_t single_time = esp_timer_get_time() - start;
+    ESP_LOGI(TAG, "  pool_malloc/free     : %7.1f ns/block", (float)single_time * 1000.0f / BATCH_BENCH_BLOCKS);
+    
+    // คืน block ที่ค้างใน magazine → pool_malloc_n(BATCH_BENCH_MAX) ได้ครบทุก block
+    pool_flush_magazines(&bench_pool);
+
+    for (int b = 0; b < sizeof(batch_sizes) / sizeof(batch_sizes[0]); b++) {
+        const int batch = batch_sizes[b];
+        size_t blocks = 0;
+        start = esp_timer_get_time();
+        for (int round = 0; round < BATCH_BENCH_BLOCKS / batch; round++) {
+            size_t got = pool_malloc_n(&bench_pool, ptrs, batch);
+            blocks += pool_free_n(&bench_pool, ptrs, got);
+        }
+        uint64_t elapsed = esp_timer_get_time() - start;
+        ESP_LOGI(TAG, "  pool_malloc_n(%3d)   : %7.1f ns/block", batch,
+                 blocks ? (float)elapsed * 1000.0f / blocks : 0.0f);
+    }
+    destroy_memory_pool(&bench_pool);
+}
+
+// ====== Block layout: inline header vs out-of-band metadata ======
+#define LAYOUT_BENCH_BLOCKS  64
+
+static size_t pool_bytes_per_block(const memory_pool_t* pool) {
+    size_t bytes = pool->block_stride * pool->block_count + pool->bitmap_words * sizeof(uint32_t);
+    if (pool->block_state) bytes += pool->block_count;
+    return bytes / pool->block_count;
+}
+
+// alignment จริงของ payload = power-of-two สูงสุดที่หาร address ของทุก block ได้
+static size_t pool_payload_alignment(memory_pool_t* pool) {
+    uintptr_t bits = 0;
+    for (size_t i = 0; i < pool->block_count; i++) bits |= (uintptr_t)pool_block_payload(pool, pool_block_at(pool, i));
+    size_t align = (size_t)(bits & (~bits + 1));
+    return align > 4096 ? 4096 : align;
+}
+
+void pool_layout_benchmark(void) {
+    static memory_pool_t bench_pool;
+    const bool layouts[] = {false, true};
+
+    ESP_LOGI(TAG, "\n🧱 Block layout (%d × 64 B blocks, %d alloc+free pairs)%s", LAYOUT_BENCH_BLOCKS,
+             LATENCY_BENCH_ITERATIONS, POOL_DEBUG_CHECKS ? " [debug canaries on]" : "");
+    for (int l = 0; l < 2; l++) {
+        const pool_config_t config = {layouts[l] ? "OOB" : "Inline", 64, LAYOUT_BENCH_BLOCKS,
+                                      MALLOC_CAP_INTERNAL, LED_SMALL_POOL, layouts[l], 1};
+        if (!init_memory_pool(&bench_pool, &config, POOL_COUNT + 2)) continue;
+
+        uint64_t start = esp_timer_get_time();
+        for (int i = 0; i < LATENCY_BENCH_ITERATIONS; i++) pool_free(&bench_pool, pool_malloc(&bench_pool));
+        uint64_t elapsed = esp_timer_get_time() - start;
+
+        ESP_LOGI(TAG, "  %-7s %3d bytes/block (%d payload), payload align %3d B, %6.1f ns/pair",
+                 config.name, (int)pool_bytes_per_block(&bench_pool), (int)config.block_size,
+                 (int)pool_payload_alignment(&bench_pool),
+                 (float)elapsed * 1000.0f / LATENCY_BENCH_ITERATIONS);
+        destroy_memory_pool(&bench_pool);
+    }
+}
+
+// ====== Free latency: probing vs range index ======
+#define FREE_BENCH_BLOCKS  4
+
+static uint64_t time_frees(void** ptrs, int count, bool (*free_fn)(void*)) {
+    uint64_t start = esp_timer_get_time();
+    for (int i = 0; i < count; i++) { if (ptrs[i]) free_fn(ptrs[i]); }
+    return esp_timer_get_time() - start;
+}
+
+void pool_free_lookup_benchmark(void) {
+    // ขนาดที่ตก class เล็ก/กลาง/ใหญ่ + ขนาดที่ต้อง fallback ไป heap
+    const size_t sizes[] = {32, 128, 512, 2048, 8192};
+    void* ptrs[FREE_BENCH_BLOCKS];
+
+    ESP_LOGI(TAG, "\n🔎 Free latency (%d blocks): probe every pool vs range index", FREE_BENCH_BLOCKS);
+    for (int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        for (int i = 0; i < FREE_BENCH_BLOCKS; i++) ptrs[i] = smart_pool_malloc(sizes[s]);
+        uint64_t probe_time = time_frees(ptrs, FREE_BENCH_BLOCKS, smart_pool_free_probe);
+
+        for (int i = 0; i < FREE_BENCH_BLOCKS; i++) ptrs[i] = smart_pool_malloc(sizes[s]);
+        memory_pool_t* owner = pool_find_owner(ptrs[0]);
+        uint64_t index_time = time_frees(ptrs, FREE_BENCH_BLOCKS, smart_pool_free);
+
+        ESP_LOGI(TAG, "  %5d B (%-7s) probe %.2f μs/free, index %.2f μs/free (%.1fx)",
+                 (int)sizes[s], owner ? owner->name : "Heap",
+                 (float)probe_time / FREE_BENCH_BLOCKS, (float)index_time / FREE_BENCH_BLOCKS,
+                 index_time ? (float)probe_time / (float)index_time : 0.0f);
+    }
+}
+
+// Latency ต่อ alloc+free หนึ่งคู่ (ns) — วนหลายรอบเพื่อให้ timer ระดับ μs แยกได้ถึง ns
+static float time_alloc_free_pairs_ns(size_t size, int mode) {
+    memory_pool_t* pool = &pools[size_to_class(size)];
+    uint64_t start = esp_timer_get_time();
+    for (int i = 0; i < LATENCY_BENCH_ITERATIONS; i++) {
+        void* p;
+        switch (mode) {
+            case 0:  p = pool_malloc(pool);        pool_free(pool, p);   break;
+            case 1:  p = smart_pool_malloc(size);  smart_pool_free(p);   break;
+            default: p = heap_caps_malloc(size, MALLOC_CAP_DEFAULT | MALLOC_CAP_8BIT); heap_caps_free(p); break;
+        }
+    }
+    uint64_t elapsed = esp_timer_get_time() - start;
+    return (float)elapsed * 1000.0f / LATENCY_BENCH_ITERATIONS;
+}
+
+void pool_latency_benchmark(void) {
+    const size_t sizes[] = {32, 128, 512, 2048};
+    const int num_sizes = sizeof(sizes) / sizeof(sizes[0]);
+
+    ESP_LOGI(TAG, "\n⏱️ Alloc+free latency (%d pairs, single task)", LATENCY_BENCH_ITERATIONS);
+    ESP_LOGI(TAG, "   Size   pool_malloc  smart_pool   heap_caps");
+    for (int s = 0; s < num_sizes; s++) {
+        if (!pools[size_to_class(sizes[s])].mutex) continue;
+        float direct = time_alloc_free_pairs_ns(sizes[s], 0);
+        float smart  = time_alloc_free_pairs_ns(sizes[s], 1);
+        float heap   = time_alloc_free_pairs_ns(sizes[s], 2);
+        ESP_LOGI(TAG, "  %5d B  %8.1f ns  %8.1f ns  %8.1f ns",
+                 (int)sizes[s], direct, smart, heap);
+    }
+}
+
 void pool_performance_test_task(void *pvParameters) {
     ESP_LOGI(TAG, "⚡ Pool performance test started");
     const int test_iterations = 1000;
@@ -446,15 +1614,21 @@ void pool_performance_test_task(void *pvParameters) {
             uint64_t heap_free_time = esp_timer_get_time() - heap_free_start;
 
             ESP_LOGI(TAG, "\n📏 Size: %d bytes (%d iterations)", (int)test_size, test_iterations);
-            ESP_LOGI(TAG, "Pool Alloc:  %llu μs (%.2f μs/alloc)", pool_alloc_time, (float)pool_alloc_time / test_iterations);
-            ESP_LOGI(TAG, "Pool Free:   %llu μs (%.2f μs/free)",  pool_free_time, (float)pool_free_time / test_iterations);
-            ESP_LOGI(TAG, "Heap Alloc:  %llu μs (%.2f μs/alloc)", heap_alloc_time, (float)heap_alloc_time / test_iterations);
-            ESP_LOGI(TAG, "Heap Free:   %llu μs (%.2f μs/free)",  heap_free_time, (float)heap_free_time / test_iterations);
+            ESP_LOGI(TAG, "Pool Alloc:  %llu μs (%.2f μs/alloc)", (unsigned long long)pool_alloc_time, (float)pool_alloc_time / test_iterations);
+            ESP_LOGI(TAG, "Pool Free:   %llu μs (%.2f μs/free)",  (unsigned long long)pool_free_time, (float)pool_free_time / test_iterations);
+            ESP_LOGI(TAG, "Heap Alloc:  %llu μs (%.2f μs/alloc)", (unsigned long long)heap_alloc_time, (float)heap_alloc_time / test_iterations);
+            ESP_LOGI(TAG, "Heap Free:   %llu μs (%.2f μs/free)",  (unsigned long long)heap_free_time, (float)heap_free_time / test_iterations);
 
             float alloc_speedup = (float)heap_alloc_time / (float)pool_alloc_time;
             float free_speedup  = (float)heap_free_time  / (float)pool_free_time;
             ESP_LOGI(TAG, "Speedup: Alloc %.2fx, Free %.2fx", alloc_speedup, free_speedup);
         }
+
+        pool_latency_benchmark();
+        pool_batch_benchmark();
+        pool_layout_benchmark();
+        pool_contention_benchmark();
+        pool_free_lookup_benchmark();
         vTaskDelay(pdMS_TO_TICKS(30000)); // 30 s
     }
 }
@@ -504,6 +1678,32 @@ void pool_pattern_test_task(void *pvParameters) {
     }
 }
 
+// กระพริบ LED ตาม activity counter ของแต่ละ pool (allocator ไม่ต้องรอ GPIO/delay)
+void led_activity_task(void *pvParameters) {
+    const gpio_num_t pins[] = {LED_SMALL_POOL, LED_MEDIUM_POOL, LED_LARGE_POOL, LED_POOL_FULL};
+    const int num_pins = sizeof(pins) / sizeof(pins[0]);
+    unsigned last_seen[POOL_COUNT] = {0};
+    bool lit[sizeof(pins) / sizeof(pins[0])] = {false};
+
+    while (1) {
+        bool active[sizeof(pins) / sizeof(pins[0])] = {false};
+        for (int i = 0; i < POOL_COUNT; i++) {
+            unsigned now = atomic_load_explicit(&pools[i].activity, memory_order_relaxed);
+            if (now == last_seen[i]) continue;
+            last_seen[i] = now;
+            for (int p = 0; p < num_pins; p++) {
+                if (pins[p] == pool_configs[i].led_pin) active[p] = true;
+            }
+        }
+        // LED_POOL_FULL ใช้ร่วมกับ warning ของ pool_monitor_task: แตะเฉพาะตอนเราเป็นคนเปิดเอง
+        for (int p = 0; p < num_pins; p++) {
+            if (active[p] || lit[p]) gpio_set_level(pins[p], active[p] ? 1 : 0);
+            lit[p] = active[p];
+        }
+        vTaskDelay(pdMS_TO_TICKS(LED_ACTIVITY_PERIOD_MS));
+    }
+}
+
 void pool_monitor_task(void *pvParameters) {
     ESP_LOGI(TAG, "📊 Pool monitor started");
     while (1) {
@@ -513,12 +1713,30 @@ void pool_monitor_task(void *pvParameters) {
         check_pool_integrity();
         bool any_exhausted = false;
         for (int i = 0; i < POOL_COUNT; i++) {
-            if (pools[i].allocated_blocks >= pools[i].block_count) { any_exhausted = true; break; }
+            pool_maybe_shrink(&pools[i]);
+            if (pools[i].slab_count >= pools[i].max_slabs &&
+                pool_used_blocks(&pools[i]) >= pools[i].block_count) any_exhausted = true;
         }
         gpio_set_level(LED_POOL_FULL, any_exhausted ? 1 : 0);
-        ESP_LOGI(TAG, "System uptime: %llu ms", esp_timer_get_time() / 1000);
-        ESP_LOGI(TAG, "Free heap: %d bytes\n", esp_get_free_heap_size());
+        ESP_LOGI(TAG, "System uptime: %llu ms", (unsigned long long)(esp_timer_get_time() / 1000));
+        ESP_LOGI(TAG, "Free heap: %lu bytes\n", (unsigned long)esp_get_free_heap_size());
+    }
+}
+
+// ====== Init ======
+// สร้างทุก size class (ไม่หยุดทั้งโปรแกรมถ้าบางพูลล้มเหลว) — ใช้ร่วมกับ benchmark harness ของ lab4
+bool memory_pools_init(void) {
+    ESP_LOGI(TAG, "Initializing memory pools...");
+    int ok_count = 0;
+    for (int i = 0; i < POOL_COUNT; i++) {
+        if (init_memory_pool(&pools[i], &pool_configs[i], i + 1)) ok_count++;
+        else ESP_LOGW(TAG, "Skip %s pool (init failed).", pool_configs[i].name);
     }
+    if (ok_count == 0) return false;
+
+    pools_initialized = true;
+    ESP_LOGI(TAG, "Initialized %d/%d pools successfully", ok_count, POOL_COUNT);
+    return true;
 }
 
 // ====== app_main ======
@@ -538,25 +1756,30 @@ void app_main(void) {
     gpio_set_level(LED_POOL_FULL, 0);
     gpio_set_level(LED_POOL_ERROR, 0);
 
-    // Init pools (ไม่หยุดทั้งโปรแกรมถ้าบางพูลล้มเหลว)
-    ESP_LOGI(TAG, "Initializing memory pools...");
-    int ok_count = 0;
-    for (int i = 0; i < POOL_COUNT; i++) {
-        if (init_memory_pool(&pools[i], &pool_configs[i], i + 1)) ok_count++;
-        else ESP_LOGW(TAG, "Skip %s pool (init failed).", pool_configs[i].name);
-    }
-    if (ok_count == 0) {
+    if (!memory_pools_init()) {
         ESP_LOGE(TAG, "No pools initialized. Exiting.");
         return;
     }
 
-    pools_initialized = true;
-    ESP_LOGI(TAG, "Initialized %d/%d pools successfully", ok_count, POOL_COUNT);
+    print_pool_statistics();
 
+#if POOL_BENCH_MODE
+    // Benchmark mode: วัด latency ล้วน ๆ ไม่สร้าง task อื่นมาแย่ง CPU
+    ESP_LOGI(TAG, "⏱️ Benchmark mode: latency only");
+    pool_latency_benchmark();
+    pool_batch_benchmark();
+    pool_layout_benchmark();
+    pool_contention_benchmark();
+    pool_free_lookup_benchmark();
     print_pool_statistics();
+    return;
+#endif
 
     // Tasks
     ESP_LOGI(TAG, "Creating memory pool test tasks...");
+#if LED_ACTIVITY_ENABLED
+    xTaskCreate(led_activity_task,         "LedActivity", 2048, NULL, LED_ACTIVITY_PRIORITY, NULL);
+#endif
     xTaskCreate(pool_monitor_task,         "PoolMonitor", 4096, NULL, 6, NULL);
     xTaskCreate(pool_stress_test_task,     "StressTest",  3072, NULL, 5, NULL);
     xTaskCreate(pool_performance_test_task,"PerfTest",    3072, NULL, 4, NULL);
@@ -565,21 +1788,23 @@ void app_main(void) {
     ESP_LOGI(TAG, "All tasks created successfully");
 
     ESP_LOGI(TAG, "\n🎯 LED Indicators:");
-    ESP_LOGI(TAG, "  GPIO2  - Small Pool Activity (64B)");
-    ESP_LOGI(TAG, "  GPIO4  - Medium Pool Activity (256B)");
-    ESP_LOGI(TAG, "  GPIO5  - Large Pool Activity (1KB)");
-    ESP_LOGI(TAG, "  GPIO18 - Pool Full Warning");
+    ESP_LOGI(TAG, "  GPIO2  - Small Classes Activity (<=64B)");
+    ESP_LOGI(TAG, "  GPIO4  - Medium Classes Activity (<=256B)");
+    ESP_LOGI(TAG, "  GPIO5  - Large Classes Activity (<=1KB)");
+    ESP_LOGI(TAG, "  GPIO18 - Pool Full Warning / Huge Classes");
     ESP_LOGI(TAG, "  GPIO19 - Pool Error/Corruption");
 
-    ESP_LOGI(TAG, "\n🏊 Pool Configuration:");
-    ESP_LOGI(TAG, "  Small Pool:  %d × %d bytes = %d KB", SMALL_POOL_BLOCK_COUNT, SMALL_POOL_BLOCK_SIZE,  (SMALL_POOL_BLOCK_COUNT * SMALL_POOL_BLOCK_SIZE) / 1024);
-    ESP_LOGI(TAG, "  Medium Pool: %d × %d bytes = %d KB", MEDIUM_POOL_BLOCK_COUNT, MEDIUM_POOL_BLOCK_SIZE, (MEDIUM_POOL_BLOCK_COUNT * MEDIUM_POOL_BLOCK_SIZE) / 1024);
-    ESP_LOGI(TAG, "  Large Pool:  %d × %d bytes = %d KB", LARGE_POOL_BLOCK_COUNT,  LARGE_POOL_BLOCK_SIZE,  (LARGE_POOL_BLOCK_COUNT  * LARGE_POOL_BLOCK_SIZE)  / 1024);
-    ESP_LOGI(TAG, "  Huge Pool:   %d × %d bytes = %d KB", HUGE_POOL_BLOCK_COUNT,   HUGE_POOL_BLOCK_SIZE,   (HUGE_POOL_BLOCK_COUNT   * HUGE_POOL_BLOCK_SIZE)   / 1024);
+    ESP_LOGI(TAG, "\n🏊 Size Class Configuration (%d classes):", POOL_COUNT);
+    for (int i = 0; i < POOL_COUNT; i++) {
+        ESP_LOGI(TAG, "  %-7s %2d × %4d bytes = %.1f KB", pool_configs[i].name,
+                 (int)pool_configs[i].block_count, (int)pool_configs[i].block_size,
+                 (pool_configs[i].block_count * pool_configs[i].block_size) / 1024.0f);
+    }
 
     ESP_LOGI(TAG, "\n🧪 Test Features:");
-    ESP_LOGI(TAG, "  • Multi-tier Memory Pool System");
-    ESP_LOGI(TAG, "  • Smart Pool Selection");
+    ESP_LOGI(TAG, "  • Geometric Size-Class Pool System");
+    ESP_LOGI(TAG, "  • Table-driven Size Class Selection");
+    ESP_LOGI(TAG, "  • Per-core Magazine Caches");
     ESP_LOGI(TAG, "  • Performance Benchmarking");
     ESP_LOGI(TAG, "  • Corruption Detection");
     ESP_LOGI(TAG, "  • Usage Visualization");
@@ -2,6 +2,8 @@
 #include <stdint.h>
 #include <string.h>
 #include <math.h>
+#include <stdatomic.h>
+#include "sdkconfig.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
@@ -11,9 +13,30 @@
 #include "esp_timer.h"
 #include "esp_system.h"
 #include "esp_attr.h"
+#include "esp_random.h"
+
+// Static task arena คืน slot ผ่าน deletion hook (ดู sdkconfig.defaults)
+#if CONFIG_FREERTOS_TASK_PRE_DELETION_HOOK || CONFIG_FREERTOS_ENABLE_STATIC_TASK_CLEAN_UP
+#define TASK_ARENA_RECLAIM  1
+#include "esp_freertos_hooks.h"
+#else
+#define TASK_ARENA_RECLAIM  0
+#endif
+
+#if CONFIG_IDF_TARGET_LINUX
+// Host build (idf.py --preview set-target linux): ไม่มี GPIO ให้ LED เป็น no-op
+typedef int gpio_num_t;
+#define GPIO_NUM_2   2
+#define GPIO_NUM_4   4
+#define GPIO_NUM_5   5
+#define GPIO_NUM_18  18
+#define GPIO_NUM_19  19
+#define gpio_set_direction(pin, mode)  ((void)(pin))
+#define gpio_set_level(pin, level)     ((void)(pin), (void)(level))
+#else
 #include "driver/gpio.h"
 #include "soc/soc_memory_layout.h"
-#include "esp_random.h"
+#endif
 static const char *TAG = "MEM_OPT";
 
 // GPIO สำหรับแสดงสถานะ optimization
@@ -30,19 +53,101 @@ static const char *TAG = "MEM_OPT";
 
 // Static memory pools for optimization demonstration
 #define STATIC_BUFFER_SIZE   4096
-#define STATIC_BUFFER_COUNT  8
-#define TASK_STACK_SIZE      2048
-#define MAX_TASKS            4
+#define STATIC_BUFFER_COUNT  8        // <= 32 (หนึ่ง bit ต่อ buffer ใน bitmap)
+#define TASK_STACK_SIZE      2048     // default ของ create_static_task
+
+#if STATIC_BUFFER_COUNT > 32
+#error "STATIC_BUFFER_COUNT must fit in the 32-bit static_buffer_bitmap"
+#endif
+#define STATIC_BUFFER_ALL_MASK  ((uint32_t)(((uint64_t)1 << STATIC_BUFFER_COUNT) - 1))
+
+// Aligned slabs: ทุก block ขนาดเป็นพหุคูณของ 64 และ arena align 64 → ทุก block align 64 เอง
+// ไม่ต้อง pad ต่อ call (alignment > 64 หรือขนาดเกิน class ใหญ่สุด → heap_caps_aligned_alloc)
+#define ALIGNED_SLAB_ALIGN      64
+#define ALIGNED_SLAB_ARENA_SIZE 40960    // ผลรวม block_size * block_count ของ aligned_slabs
+#define ALIGNED_BENCH_ITERATIONS 2000
+
+// Static task arena: stack หลายขนาด (slot_count <= 32 ต่อ class), TCB อยู่ internal RAM เสมอ
+#define TASK_ARENA_SLOTS        16       // >= ผลรวม slot_count ของ task_stack_classes
+#define TASK_ARENA_INTERNAL_CAPS (MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT)
+#if CONFIG_SPIRAM_ALLOW_STACK_EXTERNAL_MEMORY
+#define TASK_ARENA_LARGE_CAPS   (MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT)   // stack ใหญ่ไป PSRAM ได้
+#else
+#define TASK_ARENA_LARGE_CAPS   TASK_ARENA_INTERNAL_CAPS
+#endif
+#define TASK_BENCH_WORKERS      200      // short-lived tasks ต่อรอบของ benchmark
+#define TASK_BENCH_STACK        1024
+
+// Memory hierarchy benchmark (optimize_memory_access_patterns)
+// buffer ใหญ่สุดต่อ region — ถ้า allocate ไม่ได้จะลดลงครึ่งหนึ่งจนกว่าจะได้
+#define CACHE_BENCH_NODE        64       // bytes ต่อ node ของ pointer chase (>= cache line)
+#define CACHE_BENCH_MIN_WSET    1024
+#define CACHE_BENCH_CHASE_STEPS 100000
+#define CACHE_BENCH_STRIDE_ACCESSES 100000
+#define CACHE_BENCH_MAX_STRIDE  1024
+#define CACHE_BENCH_TILE        16       // tile ของ transpose (16×16×4 = 1 KB)
+#if CONFIG_IDF_TARGET_LINUX
+#define CACHE_BENCH_STREAM_TOTAL (256 * 1024 * 1024)   // bytes ต่อการวัด bandwidth
+#else
+#define CACHE_BENCH_STREAM_TOTAL (4 * 1024 * 1024)
+#endif
+
+// Struct layout benchmark: AoS packed / AoS reordered / SoA
+#define SOA_COLUMN_ALIGN        64       // ทุก column เริ่มที่ขอบ cache line
+#define SOA_BENCH_RECORDS       100000   // ลดครึ่งหนึ่งจนกว่าจะ allocate ได้
+#define SOA_BENCH_MIN_RECORDS   1000
+#define SOA_BENCH_REPEATS       3        // ใช้ผลที่ดีที่สุด
+#if CONFIG_IDF_TARGET_LINUX
+#define SOA_BENCH_CAPS_LIST     {MALLOC_CAP_DEFAULT}
+#else
+#define SOA_BENCH_CAPS_LIST     {MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT}
+#endif
+
+// Contention benchmark: N tasks (กระจายทั้งสอง core) alloc/free พร้อมกัน
+#define CONTENTION_ITERATIONS   2000     // alloc/free pairs ต่อ task
+#define CONTENTION_MAX_TASKS    4
 
 // Static allocations
 static uint8_t static_buffers[STATIC_BUFFER_COUNT][STATIC_BUFFER_SIZE] __attribute__((aligned(4)));
-static bool static_buffer_used[STATIC_BUFFER_COUNT] = {false};
-static SemaphoreHandle_t static_buffer_mutex;
+static atomic_uint static_buffer_bitmap;   // bit i = static_buffers[i] ถูกใช้อยู่ (lock-free, ใช้จาก ISR ได้)
+
+// Static task arena: stack ของแต่ละ class จองครั้งเดียวตอน init (ตาม caps) แล้ว reuse
+// slot ที่ task ถูกลบ → retired[core] ใน deletion hook → กลับเป็นว่างใน idle hook ของ core นั้น
+// (หลัง hook kernel ยังแตะ TCB/stack อยู่ จึงคืนทันทีไม่ได้)
+typedef struct {
+    uint32_t stack_depth;                // StackType_t
+    uint8_t slot_count;
+    uint32_t caps;
+    StackType_t* stacks;
+    uint16_t first_slot;                 // index ใน task_tcbs[]
+    atomic_uint bitmap;                  // bit = slot ถูกใช้อยู่
+    atomic_uint retired[portNUM_PROCESSORS];
+} task_stack_class_t;
 
-// Static task stacks
-static StackType_t task_stacks[MAX_TASKS][TASK_STACK_SIZE] __attribute__((aligned(8)));
-static StaticTask_t task_buffers[MAX_TASKS];
-static int next_task_slot = 0;
+static task_stack_class_t task_stack_classes[] = {
+    {1024, 8, TASK_ARENA_INTERNAL_CAPS},     // short-lived workers
+    {2048, 4, TASK_ARENA_INTERNAL_CAPS},
+    {4096, 2, TASK_ARENA_LARGE_CAPS},
+};
+#define TASK_STACK_CLASSES (sizeof(task_stack_classes) / sizeof(task_stack_classes[0]))
+static StaticTask_t task_tcbs[TASK_ARENA_SLOTS];
+static atomic_uint task_arena_live;
+static atomic_uint task_arena_reclaimed;
+
+// Aligned slab size class (block_count <= 32 — bitmap เดียวกับ static buffers)
+typedef struct {
+    uint16_t block_size;
+    uint8_t block_count;
+    uint8_t* base;
+    atomic_uint bitmap;
+} aligned_slab_t;
+
+static uint8_t aligned_slab_arena[ALIGNED_SLAB_ARENA_SIZE] __attribute__((aligned(ALIGNED_SLAB_ALIGN)));
+static aligned_slab_t aligned_slabs[] = {
+    {64, 32}, {128, 16}, {192, 16}, {256, 16}, {384, 8},
+    {512, 8}, {768, 4}, {1024, 4}, {1536, 2}, {2048, 2}, {4096, 2},
+};
+#define ALIGNED_SLAB_CLASSES (sizeof(aligned_slabs) / sizeof(aligned_slabs[0]))
 
 // Memory optimization statistics
 typedef struct {
@@ -77,6 +182,77 @@ typedef struct {
     // 1 byte padding for alignment
 } __attribute__((aligned(8))) good_struct_t;
 
+// ====== Structure-of-arrays toolkit ======
+// ประกาศ field list เป็น X-macro ครั้งเดียว ได้ทั้ง row struct และ SoA container เช่น
+//   #define SENSOR_FIELDS(X) X(uint32_t, timestamp) X(float, value) X(uint8_t, status)
+//   SOA_DECLARE(sensor_soa, SENSOR_FIELDS)
+//   → sensor_soa_row_t, sensor_soa_t, sensor_soa_init/_free/_push/_get/_set/_row_bytes
+// ทุก column อยู่ใน block เดียว (allocate ครั้งเดียวตาม caps) ใช้ column ตรง ๆ ได้: soa.value[i]
+#define SOA_ROW_MEMBER(type, field)     type field;
+#define SOA_COLUMN_PTR(type, field)     type* field;
+#define SOA_COLUMN_BYTES(type, field)   bytes += ALIGN_UP(capacity * sizeof(type), SOA_COLUMN_ALIGN);
+#define SOA_COLUMN_CARVE(type, field)   soa->field = (type*)cursor; \
+                                        cursor += ALIGN_UP(capacity * sizeof(type), SOA_COLUMN_ALIGN);
+#define SOA_COLUMN_STORE(type, field)   soa->field[index] = row->field;
+#define SOA_COLUMN_LOAD(type, field)    row->field = soa->field[index];
+#define SOA_FIELD_SIZE(type, field)     + sizeof(type)
+
+#define SOA_DECLARE(name, FIELDS)                                                           \
+    typedef struct { FIELDS(SOA_ROW_MEMBER) } name##_row_t;                                 \
+    typedef struct {                                                                        \
+        size_t count;                                                                       \
+        size_t capacity;                                                                    \
+        uint8_t* block;                                                                     \
+        FIELDS(SOA_COLUMN_PTR)                                                              \
+    } name##_t;                                                                             \
+    static inline size_t name##_row_bytes(void) { return 0 FIELDS(SOA_FIELD_SIZE); }        \
+    static inline bool name##_init(name##_t* soa, size_t capacity, uint32_t caps) {         \
+        size_t bytes = 0;                                                                   \
+        FIELDS(SOA_COLUMN_BYTES)                                                            \
+        soa->block = heap_caps_aligned_alloc(SOA_COLUMN_ALIGN, bytes, caps);                \
+        if (!soa->block) return false;                                                      \
+        uint8_t* cursor = soa->block;                                                       \
+        FIELDS(SOA_COLUMN_CARVE)                                                            \
+        soa->count = 0;                                                                     \
+        soa->capacity = capacity;                                                           \
+        return true;                                                                        \
+    }                                                                                       \
+    static inline void name##_free(name##_t* soa) {                                         \
+        heap_caps_free(soa->block);                                                         \
+        memset(soa, 0, sizeof(*soa));                                                       \
+    }                                                                                       \
+    static inline void name##_get(const name##_t* soa, size_t index, name##_row_t* row) {   \
+        FIELDS(SOA_COLUMN_LOAD)                                                             \
+    }                                                                                       \
+    static inline void name##_set(name##_t* soa, size_t index, const name##_row_t* row) {   \
+        FIELDS(SOA_COLUMN_STORE)                                                            \
+    }                                                                                       \
+    static inline bool name##_push(name##_t* soa, const name##_row_t* row) {                \
+        if (soa->count >= soa->capacity) return false;                                      \
+        name##_set(soa, soa->count++, row);                                                 \
+        return true;                                                                        \
+    }
+
+// field เดียวกับ bad_struct_t / good_struct_t
+#define DEMO_RECORD_FIELDS(X) X(char, a) X(int, b) X(char, c) X(double, d) X(char, e)
+SOA_DECLARE(demo_record_soa, DEMO_RECORD_FIELDS)
+
+// ผลของหนึ่ง layout (bytes = ขนาด memory ที่ workload ต้องดึงผ่าน)
+typedef struct {
+    uint64_t scan_us;
+    uint64_t update_us;
+    size_t scan_bytes;
+    size_t update_bytes;
+    double checksum;
+} layout_bench_result_t;
+
+// Region ที่ benchmark memory hierarchy
+typedef struct {
+    const char* name;
+    uint32_t caps;
+    size_t max_wset;
+} cache_bench_region_t;
+
 // Memory region analysis
 typedef struct {
     const char* name;
@@ -87,102 +263,311 @@ typedef struct {
     bool is_dma_capable;
 } memory_region_info_t;
 
-// Static buffer management
-void* allocate_static_buffer(void) {
-    void* buffer = NULL;
-    
-    if (static_buffer_mutex && xSemaphoreTake(static_buffer_mutex, pdMS_TO_TICKS(100))) {
-        for (int i = 0; i < STATIC_BUFFER_COUNT; i++) {
-            if (!static_buffer_used[i]) {
-                static_buffer_used[i] = true;
-                buffer = static_buffers[i];
-                opt_stats.static_allocations++;
-                ESP_LOGD(TAG, "🟢 Static buffer %d allocated: %p", i, buffer);
-                gpio_set_level(LED_STATIC_ALLOC, 1);
-                break;
-            }
-        }
-        xSemaphoreGive(static_buffer_mutex);
+// Static buffer management: atomic bitmask แทน mutex
+// allocate/free เป็น CAS ล้วน ๆ — เรียกจาก ISR และจากทั้งสอง core ได้ ไม่มี log ใน path นี้
+bool static_buffers_init(void) {
+    atomic_store(&static_buffer_bitmap, 0);
+    return true;
+}
+
+// Claim bit ว่างต่ำสุดด้วย CAS คืน index (-1 = เต็ม), previous = bitmap ก่อน claim
+static inline int IRAM_ATTR bitmap_claim(atomic_uint* bitmap, uint32_t all_mask, uint32_t* previous) {
+    uint32_t used = atomic_load_explicit(bitmap, memory_order_relaxed);
+    uint32_t bit;
+    
+    do {
+        uint32_t free_mask = ~used & all_mask;
+        if (free_mask == 0) return -1;
+        bit = free_mask & -free_mask;    // bit ว่างต่ำสุด
+    } while (!atomic_compare_exchange_weak_explicit(bitmap, &used, used | bit,
+                                                    memory_order_acquire, memory_order_relaxed));
+    
+    *previous = used;
+    return __builtin_ctz(bit);
+}
+
+void* IRAM_ATTR allocate_static_buffer(void) {
+    uint32_t previous;
+    int index = bitmap_claim(&static_buffer_bitmap, STATIC_BUFFER_ALL_MASK, &previous);
+    if (index < 0) return NULL;
+    
+    __atomic_fetch_add(&opt_stats.static_allocations, 1, __ATOMIC_RELAXED);
+    if (previous == 0) {
+        gpio_set_level(LED_STATIC_ALLOC, 1);   // buffer แรกที่ถูกใช้
     }
+    return static_buffers[index];
+}
+
+void IRAM_ATTR free_static_buffer(void* buffer) {
+    uintptr_t offset = (uintptr_t)buffer - (uintptr_t)static_buffers[0];
+    if (!buffer || offset >= sizeof(static_buffers) || offset % STATIC_BUFFER_SIZE != 0) return;
+    
+    uint32_t bit = 1U << (offset / STATIC_BUFFER_SIZE);
+    uint32_t previous = atomic_fetch_and_explicit(&static_buffer_bitmap, ~bit, memory_order_release);
     
-    return buffer;
+    // LED เป็นแค่ indicator: ระหว่าง core อาจสลับลำดับได้ชั่วครู่ (free ซ้ำ → previous ไม่มี bit นี้ ไม่ทำอะไร)
+    if (previous == bit) {
+        gpio_set_level(LED_STATIC_ALLOC, 0);   // buffer สุดท้ายถูกคืน
+    }
 }
 
-void free_static_buffer(void* buffer) {
-    if (!buffer || !static_buffer_mutex) return;
+// Memory alignment optimization: aligned slabs (lock-free, ไม่ block)
+bool aligned_slabs_init(void) {
+    size_t offset = 0;
+    for (int i = 0; i < ALIGNED_SLAB_CLASSES; i++) {
+        aligned_slabs[i].base = aligned_slab_arena + offset;
+        atomic_store(&aligned_slabs[i].bitmap, 0);
+        offset += (size_t)aligned_slabs[i].block_size * aligned_slabs[i].block_count;
+    }
+    if (offset > sizeof(aligned_slab_arena)) {
+        ESP_LOGE(TAG, "Aligned slab layout needs %d bytes, arena has %d", (int)offset, (int)sizeof(aligned_slab_arena));
+        return false;
+    }
+    return true;
+}
+
+// slab ที่ ptr อยู่ (NULL = มาจาก heap_caps_aligned_alloc)
+static aligned_slab_t* aligned_slab_of(const void* ptr) {
+    uintptr_t offset = (uintptr_t)ptr - (uintptr_t)aligned_slab_arena;
+    if (offset >= sizeof(aligned_slab_arena)) return NULL;
     
-    if (xSemaphoreTake(static_buffer_mutex, pdMS_TO_TICKS(100))) {
-        for (int i = 0; i < STATIC_BUFFER_COUNT; i++) {
-            if (buffer == static_buffers[i] && static_buffer_used[i]) {
-                static_buffer_used[i] = false;
-                ESP_LOGD(TAG, "🗑️ Static buffer %d freed: %p", i, buffer);
-                break;
-            }
-        }
-        
-        // Check if any static buffers still in use
-        bool any_used = false;
-        for (int i = 0; i < STATIC_BUFFER_COUNT; i++) {
-            if (static_buffer_used[i]) {
-                any_used = true;
-                break;
-            }
-        }
-        
-        if (!any_used) {
-            gpio_set_level(LED_STATIC_ALLOC, 0);
-        }
-        
-        xSemaphoreGive(static_buffer_mutex);
+    for (int i = ALIGNED_SLAB_CLASSES - 1; i >= 0; i--) {
+        if ((const uint8_t*)ptr >= aligned_slabs[i].base) return &aligned_slabs[i];
     }
+    return NULL;
+}
+
+static size_t aligned_usable_size(void* ptr) {
+    aligned_slab_t* slab = aligned_slab_of(ptr);
+    return slab ? slab->block_size : heap_caps_get_allocated_size(ptr);
 }
 
-// Memory alignment optimization
 void* aligned_malloc(size_t size, size_t alignment) {
     if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
-        ESP_LOGE(TAG, "Invalid alignment: %d (must be power of 2)", alignment);
+        ESP_LOGE(TAG, "Invalid alignment: %d (must be power of 2)", (int)alignment);
         return NULL;
     }
     
-    // Allocate extra space for alignment
-    size_t total_size = size + alignment + sizeof(void*);
-    void* raw_ptr = malloc(total_size);
+    __atomic_fetch_add(&opt_stats.alignment_optimizations, 1, __ATOMIC_RELAXED);
     
-    if (!raw_ptr) {
-        return NULL;
+    if (alignment <= ALIGNED_SLAB_ALIGN) {
+        // class แรกที่ใส่ได้ ถ้าเต็มลอง class ถัดไป (เปลืองกว่าแต่ยังดีกว่าไป heap)
+        for (int i = 0; i < ALIGNED_SLAB_CLASSES; i++) {
+            aligned_slab_t* slab = &aligned_slabs[i];
+            if (slab->block_size < size) continue;
+            
+            uint32_t previous;
+            uint32_t all_mask = (uint32_t)(((uint64_t)1 << slab->block_count) - 1);
+            int index = bitmap_claim(&slab->bitmap, all_mask, &previous);
+            if (index >= 0) {
+                if (previous == 0) {
+                    gpio_set_level(LED_ALIGNMENT_OPT, 1);   // block แรกของ slab นี้
+                }
+                return slab->base + (size_t)index * slab->block_size;
+            }
+        }
+    }
+    
+    void* ptr = heap_caps_aligned_alloc(alignment, size, MALLOC_CAP_DEFAULT);
+    if (ptr) {
+        __atomic_fetch_add(&opt_stats.dynamic_allocations, 1, __ATOMIC_RELAXED);
+    }
+    return ptr;
+}
+
+void* aligned_calloc(size_t count, size_t size, size_t alignment) {
+    if (size && count > SIZE_MAX / size) return NULL;
+    
+    void* ptr = aligned_malloc(count * size, alignment);
+    if (ptr) {
+        memset(ptr, 0, count * size);
+    }
+    return ptr;
+}
+
+void aligned_free(void* aligned_ptr) {
+    if (!aligned_ptr) return;
+    
+    aligned_slab_t* slab = aligned_slab_of(aligned_ptr);
+    if (!slab) {
+        heap_caps_free(aligned_ptr);
+        return;
     }
     
-    // Calculate aligned address
-    uintptr_t raw_addr = (uintptr_t)raw_ptr;
-    uintptr_t aligned_addr = ALIGN_UP(raw_addr + sizeof(void*), alignment);
-    void* aligned_ptr = (void*)aligned_addr;
+    size_t offset = (uint8_t*)aligned_ptr - slab->base;
+    if (offset % slab->block_size != 0) return;   // ไม่ใช่ต้น block
+    uint32_t bit = 1U << (offset / slab->block_size);
+    uint32_t previous = atomic_fetch_and_explicit(&slab->bitmap, ~bit, memory_order_release);
     
-    // Store original pointer before aligned address
-    void** orig_ptr_storage = (void**)aligned_addr - 1;
-    *orig_ptr_storage = raw_ptr;
+    // block สุดท้ายของทุก slab ถูกคืน → ดับ LED (indicator เหมือน static buffers)
+    if (previous == bit) {
+        for (int i = 0; i < ALIGNED_SLAB_CLASSES; i++) {
+            if (atomic_load_explicit(&aligned_slabs[i].bitmap, memory_order_relaxed) != 0) return;
+        }
+        gpio_set_level(LED_ALIGNMENT_OPT, 0);
+    }
+}
+
+// ยังอยู่ใน block เดิมได้ถ้าขนาดใหม่ใส่ได้และ alignment ยังตรง
+void* aligned_realloc(void* aligned_ptr, size_t new_size, size_t alignment) {
+    if (!aligned_ptr) return aligned_malloc(new_size, alignment);
+    if (new_size == 0) {
+        aligned_free(aligned_ptr);
+        return NULL;
+    }
     
-    opt_stats.alignment_optimizations++;
-    opt_stats.dynamic_allocations++;
+    size_t old_size = aligned_usable_size(aligned_ptr);
+    if (new_size <= old_size && IS_ALIGNED(aligned_ptr, alignment)) {
+        return aligned_ptr;
+    }
     
-    ESP_LOGD(TAG, "🎯 Aligned malloc: %d bytes, %d-byte aligned at %p", 
-             size, alignment, aligned_ptr);
+    void* new_ptr = aligned_malloc(new_size, alignment);
+    if (!new_ptr) return NULL;   // เหมือน realloc: ของเดิมยังใช้ได้
     
-    gpio_set_level(LED_ALIGNMENT_OPT, 1);
-    vTaskDelay(pdMS_TO_TICKS(50));
-    gpio_set_level(LED_ALIGNMENT_OPT, 0);
+    memcpy(new_ptr, aligned_ptr, old_size < new_size ? old_size : new_size);
+    aligned_free(aligned_ptr);
+    return new_ptr;
+}
+
+// ====== Struct layout benchmark ======
+// Workload เดียวกันทุก layout: scan = sum(d) ของ record ที่ b เป็นบวก (ใช้ 2 fields)
+// update = แก้ทุก field ของทุก record
+static inline void demo_record_fill(size_t i, char* a, int* b, char* c, double* d, char* e) {
+    *a = 'A' + i % 26;
+    *b = (int)(i * 2654435761u);
+    *c = 'a' + i % 26;
+    *d = i * 0.5;
+    *e = (char)i;
+}
+
+// AoS ทั้งสองแบบใช้โค้ดเดียวกัน ต่างกันแค่ type ของ record
+#define DEFINE_AOS_LAYOUT_BENCH(fn, type)                                                   \
+    static void fn(type* records, size_t count, layout_bench_result_t* result) {           \
+        for (size_t i = 0; i < count; i++) {                                                \
+            char a, c, e; int b; double d;                                                  \
+            demo_record_fill(i, &a, &b, &c, &d, &e);                                        \
+            records[i].a = a; records[i].b = b; records[i].c = c;                           \
+            records[i].d = d; records[i].e = e;                                             \
+        }                                                                                   \
+        result->scan_us = result->update_us = UINT64_MAX;                                   \
+        for (int rep = 0; rep < SOA_BENCH_REPEATS; rep++) {                                 \
+            uint64_t start_time = esp_timer_get_time();                                     \
+            double sum = 0;                                                                 \
+            for (size_t i = 0; i < count; i++) {                                            \
+                if (records[i].b > 0) sum += records[i].d;                                  \
+            }                                                                               \
+            uint64_t elapsed = esp_timer_get_time() - start_time;                           \
+            if (elapsed < result->scan_us) result->scan_us = elapsed;                       \
+            result->checksum = sum;                                                         \
+                                                                                            \
+            start_time = esp_timer_get_time();                                              \
+            for (size_t i = 0; i < count; i++) {                                            \
+                records[i].a++; records[i].b += 3; records[i].c ^= 1;                       \
+                records[i].d += 1.0; records[i].e--;                                        \
+            }                                                                               \
+            elapsed = esp_timer_get_time() - start_time;                                    \
+            if (elapsed < result->update_us) result->update_us = elapsed;                   \
+        }                                                                                   \
+        result->scan_bytes = result->update_bytes = count * sizeof(type);                   \
+    }
+
+DEFINE_AOS_LAYOUT_BENCH(bench_aos_packed, bad_struct_t)
+DEFINE_AOS_LAYOUT_BENCH(bench_aos_reordered, good_struct_t)
+
+static void bench_soa(demo_record_soa_t* soa, layout_bench_result_t* result) {
+    for (size_t i = 0; i < soa->capacity; i++) {
+        demo_record_soa_row_t row;
+        demo_record_fill(i, &row.a, &row.b, &row.c, &row.d, &row.e);
+        demo_record_soa_push(soa, &row);
+    }
     
-    return aligned_ptr;
+    // column เป็น local restrict: column char alias กับทุกอย่าง ถ้าอ่านผ่าน soa-> compiler ต้อง reload ทุกรอบ
+    size_t count = soa->count;
+    char* restrict a = soa->a;
+    int* restrict b = soa->b;
+    char* restrict c = soa->c;
+    double* restrict d = soa->d;
+    char* restrict e = soa->e;
+    result->scan_us = result->update_us = UINT64_MAX;
+    for (int rep = 0; rep < SOA_BENCH_REPEATS; rep++) {
+        uint64_t start_time = esp_timer_get_time();
+        double sum = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (b[i] > 0) sum += d[i];
+        }
+        uint64_t elapsed = esp_timer_get_time() - start_time;
+        if (elapsed < result->scan_us) result->scan_us = elapsed;
+        result->checksum = sum;
+        
+        // column ละ loop: แต่ละ loop เป็น stream ต่อเนื่องเส้นเดียว
+        start_time = esp_timer_get_time();
+        for (size_t i = 0; i < count; i++) a[i]++;
+        for (size_t i = 0; i < count; i++) b[i] += 3;
+        for (size_t i = 0; i < count; i++) c[i] ^= 1;
+        for (size_t i = 0; i < count; i++) d[i] += 1.0;
+        for (size_t i = 0; i < count; i++) e[i]--;
+        elapsed = esp_timer_get_time() - start_time;
+        if (elapsed < result->update_us) result->update_us = elapsed;
+    }
+    result->scan_bytes = count * (sizeof(int) + sizeof(double));
+    result->update_bytes = count * demo_record_soa_row_bytes();
 }
 
-void aligned_free(void* aligned_ptr) {
-    if (!aligned_ptr) return;
+static void log_layout_result(const char* name, size_t record_bytes, const layout_bench_result_t* result) {
+    ESP_LOGI(TAG, "  %-14s %2d B   scan %6llu μs %6d KB   update %6llu μs %6d KB",
+             name, (int)record_bytes, (unsigned long long)result->scan_us, (int)(result->scan_bytes / 1024),
+             (unsigned long long)result->update_us, (int)(result->update_bytes / 1024));
+}
+
+void benchmark_struct_layouts(void) {
+    // หา caps + จำนวน record ที่ layout ใหญ่สุดใส่ได้ (ทดลอง allocate แล้วคืน)
+    const uint32_t caps_list[] = SOA_BENCH_CAPS_LIST;
+    size_t count = 0;
+    uint32_t caps = 0;
+    for (int c = 0; c < sizeof(caps_list) / sizeof(caps_list[0]) && count == 0; c++) {
+        for (size_t n = SOA_BENCH_RECORDS; n >= SOA_BENCH_MIN_RECORDS; n /= 2) {
+            void* probe = heap_caps_aligned_alloc(SOA_COLUMN_ALIGN,
+                                                  n * sizeof(good_struct_t) + 5 * SOA_COLUMN_ALIGN, caps_list[c]);
+            if (probe) {
+                heap_caps_free(probe);
+                count = n;
+                caps = caps_list[c];
+                break;
+            }
+        }
+    }
+    if (count == 0) {
+        ESP_LOGW(TAG, "Struct layout benchmark skipped (not enough memory)");
+        return;
+    }
     
-    // Retrieve original pointer
-    void** orig_ptr_storage = (void**)aligned_ptr - 1;
-    void* orig_ptr = *orig_ptr_storage;
+    ESP_LOGI(TAG, "Layout Benchmark (%d records, best of %d):", (int)count, SOA_BENCH_REPEATS);
+    layout_bench_result_t packed = {0}, reordered = {0}, soa_result = {0};
     
-    ESP_LOGD(TAG, "🗑️ Aligned free: %p (original: %p)", aligned_ptr, orig_ptr);
-    free(orig_ptr);
+    bad_struct_t* packed_records = heap_caps_malloc(count * sizeof(bad_struct_t), caps);
+    if (packed_records) {
+        bench_aos_packed(packed_records, count, &packed);
+        heap_caps_free(packed_records);
+        log_layout_result("AoS packed", sizeof(bad_struct_t), &packed);
+    }
+    
+    good_struct_t* reordered_records = heap_caps_aligned_alloc(sizeof(good_struct_t), count * sizeof(good_struct_t), caps);
+    if (reordered_records) {
+        bench_aos_reordered(reordered_records, count, &reordered);
+        heap_caps_free(reordered_records);
+        log_layout_result("AoS reordered", sizeof(good_struct_t), &reordered);
+    }
+    
+    demo_record_soa_t soa;
+    if (demo_record_soa_init(&soa, count, caps)) {
+        bench_soa(&soa, &soa_result);
+        demo_record_soa_free(&soa);
+        log_layout_result("SoA", demo_record_soa_row_bytes(), &soa_result);
+    }
+    
+    if (packed.checksum != reordered.checksum || packed.checksum != soa_result.checksum) {
+        ESP_LOGW(TAG, "  ⚠️ Layout checksums differ");
+    }
 }
 
 // Struct packing optimization demonstration
@@ -206,10 +591,10 @@ void demonstrate_struct_optimization(void) {
     good_example.d = 3.14159;
     good_example.e = 'E';
     
-    ESP_LOGI(TAG, "Bad struct size:  %d bytes", sizeof(bad_struct_t));
-    ESP_LOGI(TAG, "Good struct size: %d bytes", sizeof(good_struct_t));
+    ESP_LOGI(TAG, "Bad struct size:  %d bytes", (int)sizeof(bad_struct_t));
+    ESP_LOGI(TAG, "Good struct size: %d bytes", (int)sizeof(good_struct_t));
     ESP_LOGI(TAG, "Memory saved:     %d bytes per instance", 
-             sizeof(bad_struct_t) - sizeof(good_struct_t));
+             (int)(sizeof(bad_struct_t) - sizeof(good_struct_t)));
     
     // Calculate savings for arrays
     const int array_size = 1000;
@@ -218,14 +603,16 @@ void demonstrate_struct_optimization(void) {
     size_t array_savings = bad_array_size - good_array_size;
     
     ESP_LOGI(TAG, "Array of %d elements:", array_size);
-    ESP_LOGI(TAG, "  Bad alignment:  %d bytes", bad_array_size);
-    ESP_LOGI(TAG, "  Good alignment: %d bytes", good_array_size);
+    ESP_LOGI(TAG, "  Bad alignment:  %d bytes", (int)bad_array_size);
+    ESP_LOGI(TAG, "  Good alignment: %d bytes", (int)good_array_size);
     ESP_LOGI(TAG, "  Total saved:    %d bytes (%.1f KB)", 
-             array_savings, array_savings / 1024.0);
+             (int)array_savings, array_savings / 1024.0);
     
     opt_stats.packing_optimizations++;
     opt_stats.memory_saved_bytes += array_savings;
     
+    benchmark_struct_layouts();
+    
     gpio_set_level(LED_PACKING_OPT, 1);
     vTaskDelay(pdMS_TO_TICKS(100));
     gpio_set_level(LED_PACKING_OPT, 0);
@@ -262,9 +649,9 @@ void analyze_memory_regions(void) {
             }
             
             ESP_LOGI(TAG, "%s:", region->name);
-            ESP_LOGI(TAG, "  Total:         %d bytes (%.1f KB)", total_size, total_size / 1024.0);
-            ESP_LOGI(TAG, "  Free:          %d bytes (%.1f KB)", free_size, free_size / 1024.0);
-            ESP_LOGI(TAG, "  Largest Block: %d bytes", largest_block);
+            ESP_LOGI(TAG, "  Total:         %d bytes (%.1f KB)", (int)total_size, total_size / 1024.0);
+            ESP_LOGI(TAG, "  Free:          %d bytes (%.1f KB)", (int)free_size, free_size / 1024.0);
+            ESP_LOGI(TAG, "  Largest Block: %d bytes", (int)largest_block);
             ESP_LOGI(TAG, "  Utilization:   %.1f%%", utilization);
             ESP_LOGI(TAG, "  Fragmentation: %.1f%%", fragmentation);
             ESP_LOGI(TAG, "  Executable:    %s", region->is_executable ? "Yes" : "No");
@@ -276,6 +663,209 @@ void analyze_memory_regions(void) {
     ESP_LOGI(TAG, "═══════════════════════════════════════");
 }
 
+// ====== Memory hierarchy benchmark ======
+// index/pointer stream สร้างก่อนจับเวลาทั้งหมด — ใน loop ที่วัดมีแค่ memory access
+#if CONFIG_IDF_TARGET_LINUX
+static const cache_bench_region_t cache_bench_regions[] = {
+    {"HOST", MALLOC_CAP_DEFAULT, 8 * 1024 * 1024},
+};
+#else
+static const cache_bench_region_t cache_bench_regions[] = {
+    {"INTERNAL", MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT, 64 * 1024},   // SRAM ไม่มี cache
+    {"PSRAM", MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT, 1024 * 1024},      // ผ่าน cache 32 KB
+};
+#endif
+#define CACHE_BENCH_REGIONS (sizeof(cache_bench_regions) / sizeof(cache_bench_regions[0]))
+
+static volatile uintptr_t cache_bench_sink;   // กัน compiler ตัด loop ทิ้ง
+
+static inline uint32_t bench_xorshift(uint32_t* state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+// Cycle สุ่มผ่านทุก node (Sattolo) — prefetcher เดาไม่ได้ ทุก load ต้องรอ load ก่อนหน้า
+static void build_pointer_chain(uint8_t* buf, size_t nodes, uint32_t* seed) {
+    for (size_t i = 0; i < nodes; i++) {
+        *(uint32_t*)(buf + i * CACHE_BENCH_NODE) = i;
+    }
+    for (size_t i = nodes - 1; i > 0; i--) {
+        size_t j = bench_xorshift(seed) % i;   // j < i → ได้ cycle เดียว
+        uint32_t* a = (uint32_t*)(buf + i * CACHE_BENCH_NODE);
+        uint32_t* b = (uint32_t*)(buf + j * CACHE_BENCH_NODE);
+        uint32_t tmp = *a;
+        *a = *b;
+        *b = tmp;
+    }
+    for (size_t i = 0; i < nodes; i++) {
+        uint32_t next = *(uint32_t*)(buf + i * CACHE_BENCH_NODE);
+        *(void**)(buf + i * CACHE_BENCH_NODE) = buf + (size_t)next * CACHE_BENCH_NODE;
+    }
+}
+
+static float chase_ns_per_load(uint8_t* buf, size_t wset, uint32_t* seed) {
+    size_t nodes = wset / CACHE_BENCH_NODE;
+    build_pointer_chain(buf, nodes, seed);
+    
+    void** p = (void**)buf;
+    for (size_t i = 0; i < nodes; i++) {   // warm-up หนึ่งรอบ
+        p = (void**)*p;
+    }
+    
+    uint64_t start_time = esp_timer_get_time();
+    for (int i = 0; i < CACHE_BENCH_CHASE_STEPS; i++) {
+        p = (void**)*p;
+    }
+    uint64_t elapsed = esp_timer_get_time() - start_time;
+    
+    cache_bench_sink = (uintptr_t)p;
+    return elapsed * 1000.0f / CACHE_BENCH_CHASE_STEPS;
+}
+
+// MB/s (= bytes ต่อ μs) ของ read / write / copy (copy นับ bytes ที่ถูก copy)
+static void stream_bandwidth(uint8_t* buf, size_t bytes, float* read_mbs, float* write_mbs, float* copy_mbs) {
+    uint32_t* words = (uint32_t*)buf;
+    size_t count = bytes / sizeof(uint32_t);
+    int passes = CACHE_BENCH_STREAM_TOTAL / bytes > 0 ? CACHE_BENCH_STREAM_TOTAL / bytes : 1;
+    
+    uint64_t start_time = esp_timer_get_time();
+    for (int pass = 0; pass < passes; pass++) {
+        for (size_t i = 0; i < count; i++) {
+            words[i] = (uint32_t)i;
+        }
+        cache_bench_sink = words[pass % count];
+    }
+    uint64_t write_time = esp_timer_get_time() - start_time;
+    
+    start_time = esp_timer_get_time();
+    uint32_t sum = 0;
+    for (int pass = 0; pass < passes; pass++) {
+        for (size_t i = 0; i < count; i++) {
+            sum += words[i];
+        }
+    }
+    uint64_t read_time = esp_timer_get_time() - start_time;
+    cache_bench_sink = sum;
+    
+    size_t half = bytes / 2;
+    start_time = esp_timer_get_time();
+    for (int pass = 0; pass < passes * 2; pass++) {
+        memcpy(buf + (pass & 1 ? 0 : half), buf + (pass & 1 ? half : 0), half);
+    }
+    uint64_t copy_time = esp_timer_get_time() - start_time;
+    cache_bench_sink = buf[half];
+    
+    uint64_t total = (uint64_t)bytes * passes;
+    *read_mbs = read_time ? (float)total / read_time : 0;
+    *write_mbs = write_time ? (float)total / write_time : 0;
+    *copy_mbs = copy_time ? (float)total / copy_time : 0;
+}
+
+// ns ต่อ access เมื่อเดินทั้ง buffer ด้วย stride นี้ (วนหลายรอบจนได้ CACHE_BENCH_STRIDE_ACCESSES)
+static float stride_ns_per_access(uint8_t* buf, size_t bytes, size_t stride) {
+    size_t per_pass = bytes / stride;
+    int passes = (CACHE_BENCH_STRIDE_ACCESSES + per_pass - 1) / per_pass;
+    uint32_t sum = 0;
+    
+    uint64_t start_time = esp_timer_get_time();
+    for (int pass = 0; pass < passes; pass++) {
+        for (size_t offset = 0; offset < bytes; offset += stride) {
+            sum += *(volatile uint32_t*)(buf + offset);
+        }
+    }
+    uint64_t elapsed = esp_timer_get_time() - start_time;
+    
+    cache_bench_sink = sum;
+    return elapsed * 1000.0f / ((float)passes * per_pass);
+}
+
+static void transpose_naive(const uint32_t* src, uint32_t* dst, size_t n) {
+    for (size_t row = 0; row < n; row++) {
+        for (size_t col = 0; col < n; col++) {
+            dst[col * n + row] = src[row * n + col];
+        }
+    }
+}
+
+// ทีละ tile: ทั้ง src และ dst ของ tile อยู่ใน cache พร้อมกัน
+static void transpose_tiled(const uint32_t* src, uint32_t* dst, size_t n) {
+    for (size_t row0 = 0; row0 < n; row0 += CACHE_BENCH_TILE) {
+        for (size_t col0 = 0; col0 < n; col0 += CACHE_BENCH_TILE) {
+            for (size_t row = row0; row < row0 + CACHE_BENCH_TILE; row++) {
+                for (size_t col = col0; col < col0 + CACHE_BENCH_TILE; col++) {
+                    dst[col * n + row] = src[row * n + col];
+                }
+            }
+        }
+    }
+}
+
+static void run_cache_bench_region(const cache_bench_region_t* region) {
+    size_t wset = region->max_wset;
+    uint8_t* buf = NULL;
+    while (wset >= CACHE_BENCH_MIN_WSET * 4 &&
+           !(buf = heap_caps_aligned_alloc(CACHE_BENCH_NODE, wset, region->caps))) {
+        wset /= 2;
+    }
+    if (!buf) {
+        ESP_LOGI(TAG, "%s: not available, skipped", region->name);
+        return;
+    }
+    
+    ESP_LOGI(TAG, "%s (%d KB buffer):", region->name, (int)(wset / 1024));
+    uint32_t seed = 0x9E3779B9;
+    
+    ESP_LOGI(TAG, "  Pointer chase latency:");
+    for (size_t size = CACHE_BENCH_MIN_WSET; size <= wset; size *= 2) {
+        ESP_LOGI(TAG, "    %7d KB: %6.1f ns/load", (int)(size / 1024), chase_ns_per_load(buf, size, &seed));
+    }
+    
+    float read_mbs, write_mbs, copy_mbs;
+    stream_bandwidth(buf, wset, &read_mbs, &write_mbs, &copy_mbs);
+    ESP_LOGI(TAG, "  Stream: read %.0f MB/s, write %.0f MB/s, copy %.0f MB/s", read_mbs, write_mbs, copy_mbs);
+    
+    ESP_LOGI(TAG, "  Stride sweep:");
+    for (size_t stride = sizeof(uint32_t); stride <= CACHE_BENCH_MAX_STRIDE && stride < wset; stride *= 2) {
+        ESP_LOGI(TAG, "    %5d B: %6.2f ns/access", (int)stride, stride_ns_per_access(buf, wset, stride));
+    }
+    
+    // matrix ใหญ่สุดที่ src + dst ใส่ buffer ได้
+    size_t n = CACHE_BENCH_TILE;
+    while (2 * (n * 2) * (n * 2) * sizeof(uint32_t) <= wset) n *= 2;
+    uint32_t* src = (uint32_t*)buf;
+    uint32_t* dst = src + n * n;
+    for (size_t i = 0; i < n * n; i++) {
+        src[i] = (uint32_t)i;
+    }
+    
+    uint64_t start_time = esp_timer_get_time();
+    transpose_naive(src, dst, n);
+    uint64_t naive_time = esp_timer_get_time() - start_time;
+    cache_bench_sink = dst[1];
+    
+    start_time = esp_timer_get_time();
+    transpose_tiled(src, dst, n);
+    uint64_t tiled_time = esp_timer_get_time() - start_time;
+    cache_bench_sink = dst[1];
+    
+    ESP_LOGI(TAG, "  Transpose %dx%d: naive %llu μs, tiled(%d) %llu μs (%.2fx)",
+             (int)n, (int)n, (unsigned long long)naive_time, CACHE_BENCH_TILE, (unsigned long long)tiled_time,
+             tiled_time ? (float)naive_time / tiled_time : 0.0f);
+    
+    heap_caps_free(buf);
+}
+
+void run_memory_hierarchy_benchmark(void) {
+    ESP_LOGI(TAG, "\n🧠 ═══ MEMORY HIERARCHY BENCHMARK ═══");
+    for (int r = 0; r < CACHE_BENCH_REGIONS; r++) {
+        run_cache_bench_region(&cache_bench_regions[r]);
+    }
+    ESP_LOGI(TAG, "═══════════════════════════════════════");
+}
+
 // Memory access pattern optimization
 void optimize_memory_access_patterns(void) {
     ESP_LOGI(TAG, "\n⚡ ═══ MEMORY ACCESS OPTIMIZATION ═══");
@@ -290,9 +880,23 @@ void optimize_memory_access_patterns(void) {
         return;
     }
     
+    // Index streams สร้างก่อนจับเวลา (เดิมเรียก esp_random() ใน loop ที่วัด)
+    uint16_t* sequential_index = malloc(array_size * sizeof(uint16_t));
+    uint16_t* random_index = malloc(array_size * sizeof(uint16_t));
+    if (!sequential_index || !random_index) {
+        ESP_LOGE(TAG, "Failed to allocate index streams");
+        free(sequential_index);
+        free(random_index);
+        aligned_free(test_array);
+        return;
+    }
+    
     // Initialize array
+    uint32_t seed = esp_random() | 1;
     for (size_t i = 0; i < array_size; i++) {
         test_array[i] = i;
+        sequential_index[i] = i;
+        random_index[i] = bench_xorshift(&seed) % array_size;
     }
     
     // Sequential access test
@@ -301,7 +905,7 @@ void optimize_memory_access_patterns(void) {
     
     for (int iter = 0; iter < iterations; iter++) {
         for (size_t i = 0; i < array_size; i++) {
-            sum += test_array[i];
+            sum += test_array[sequential_index[i]];
         }
     }
     
@@ -313,19 +917,20 @@ void optimize_memory_access_patterns(void) {
     
     for (int iter = 0; iter < iterations; iter++) {
         for (size_t i = 0; i < array_size; i++) {
-            size_t random_index = esp_random() % array_size;
-            sum += test_array[random_index];
+            sum += test_array[random_index[i]];
         }
     }
     
     uint64_t random_time = esp_timer_get_time() - start_time;
     
     ESP_LOGI(TAG, "Access Pattern Performance (%d iterations):", iterations);
-    ESP_LOGI(TAG, "  Sequential: %llu μs", sequential_time);
-    ESP_LOGI(TAG, "  Random:     %llu μs", random_time);
+    ESP_LOGI(TAG, "  Sequential: %llu μs", (unsigned long long)sequential_time);
+    ESP_LOGI(TAG, "  Random:     %llu μs", (unsigned long long)random_time);
     ESP_LOGI(TAG, "  Speedup:    %.2fx (sequential vs random)", 
              (float)random_time / sequential_time);
     
+    free(sequential_index);
+    free(random_index);
     aligned_free(test_array);
     
     // Test 2: Cache-friendly vs Cache-unfriendly access
@@ -333,6 +938,8 @@ void optimize_memory_access_patterns(void) {
     uint32_t* matrix = aligned_malloc(matrix_size * matrix_size * sizeof(uint32_t), 64);
     
     if (matrix) {
+        memset(matrix, 0, matrix_size * matrix_size * sizeof(uint32_t));   // แตะทุก page ก่อนจับเวลา
+        
         // Row-major access (cache-friendly)
         start_time = esp_timer_get_time();
         sum = 0;
@@ -357,9 +964,9 @@ void optimize_memory_access_patterns(void) {
         
         uint64_t col_major_time = esp_timer_get_time() - start_time;
         
-        ESP_LOGI(TAG, "Matrix Access (%dx%d):", matrix_size, matrix_size);
-        ESP_LOGI(TAG, "  Row-major:    %llu μs (cache-friendly)", row_major_time);
-        ESP_LOGI(TAG, "  Column-major: %llu μs (cache-unfriendly)", col_major_time);
+        ESP_LOGI(TAG, "Matrix Access (%dx%d):", (int)matrix_size, (int)matrix_size);
+        ESP_LOGI(TAG, "  Row-major:    %llu μs (cache-friendly)", (unsigned long long)row_major_time);
+        ESP_LOGI(TAG, "  Column-major: %llu μs (cache-unfriendly)", (unsigned long long)col_major_time);
         ESP_LOGI(TAG, "  Performance:  %.2fx better with row-major", 
                  (float)col_major_time / row_major_time);
         
@@ -367,6 +974,127 @@ void optimize_memory_access_patterns(void) {
     }
     
     ESP_LOGI(TAG, "═══════════════════════════════════════");
+    
+    run_memory_hierarchy_benchmark();
+}
+
+// Contention benchmark worker
+typedef struct {
+    bool use_static;
+    size_t size;
+    uint32_t failures;
+    SemaphoreHandle_t done;
+} contention_worker_t;
+
+static void contention_worker_task(void *pvParameters) {
+    contention_worker_t* worker = (contention_worker_t*)pvParameters;
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);   // รอให้ทุก worker พร้อมแล้วเริ่มพร้อมกัน
+    
+    for (int i = 0; i < CONTENTION_ITERATIONS; i++) {
+        void* ptr = worker->use_static ? allocate_static_buffer() : malloc(worker->size);
+        if (!ptr) {
+            worker->failures++;
+            continue;
+        }
+        ((volatile uint8_t*)ptr)[0] = (uint8_t)i;
+        if (worker->use_static) {
+            free_static_buffer(ptr);
+        } else {
+            free(ptr);
+        }
+    }
+    
+    xSemaphoreGive(worker->done);
+    vTaskDelete(NULL);
+}
+
+// ops/s รวมของ num_tasks tasks (0 = สร้าง task ไม่ได้)
+static float run_contention_round(bool use_static, int num_tasks, size_t size, uint32_t* failures) {
+    contention_worker_t workers[CONTENTION_MAX_TASKS];
+    TaskHandle_t handles[CONTENTION_MAX_TASKS];
+    SemaphoreHandle_t done = xSemaphoreCreateCounting(CONTENTION_MAX_TASKS, 0);
+    if (!done) return 0;
+    
+    int created = 0;
+    for (int i = 0; i < num_tasks; i++) {
+        workers[i] = (contention_worker_t){use_static, size, 0, done};
+        if (xTaskCreatePinnedToCore(contention_worker_task, "Contend", 2048, &workers[i],
+                                    uxTaskPriorityGet(NULL), &handles[i], i % portNUM_PROCESSORS) != pdPASS) {
+            break;
+        }
+        created++;
+    }
+    
+    uint64_t start_time = esp_timer_get_time();
+    for (int i = 0; i < created; i++) {
+        xTaskNotifyGive(handles[i]);
+    }
+    for (int i = 0; i < created; i++) {
+        xSemaphoreTake(done, portMAX_DELAY);
+    }
+    uint64_t elapsed = esp_timer_get_time() - start_time;
+    
+    vSemaphoreDelete(done);
+    *failures = 0;
+    for (int i = 0; i < created; i++) {
+        *failures += workers[i].failures;
+    }
+    if (created < num_tasks || elapsed == 0) return 0;
+    return (float)created * CONTENTION_ITERATIONS * 2 * 1e6f / elapsed;
+}
+
+// Aligned allocator เดิม (pad size + alignment + pointer ทุก call) เก็บไว้เป็น baseline
+// ตัด LED delay 50 ms ออกเพื่อวัดเฉพาะ allocator
+static void* legacy_aligned_malloc(size_t size, size_t alignment) {
+    void* raw_ptr = malloc(size + alignment + sizeof(void*));
+    if (!raw_ptr) return NULL;
+    
+    uintptr_t aligned_addr = ALIGN_UP((uintptr_t)raw_ptr + sizeof(void*), alignment);
+    ((void**)aligned_addr)[-1] = raw_ptr;
+    return (void*)aligned_addr;
+}
+
+static void legacy_aligned_free(void* aligned_ptr) {
+    if (aligned_ptr) free(((void**)aligned_ptr)[-1]);
+}
+
+// wasted = bytes ที่จองเกินขนาดที่ขอ (legacy: padding + block ของ heap, slab: ส่วนเกินของ size class)
+static void run_aligned_workload(const char* name, bool power_of_two) {
+    uint64_t legacy_time = 0, slab_time = 0;
+    uint64_t requested = 0, legacy_waste = 0, slab_waste = 0;
+    uint32_t seed = 12345;   // ลำดับขนาด/alignment เดียวกันทั้งสอง allocator
+    
+    for (int i = 0; i < ALIGNED_BENCH_ITERATIONS; i++) {
+        seed = seed * 1103515245 + 12345;
+        size_t size = power_of_two ? (size_t)64 << ((seed >> 16) % 6)    // 64..2048 bytes
+                                   : 16 + (seed >> 16) % 2032;           // 16..2047 bytes
+        size_t alignment = 16 << ((seed >> 8) % 3);                      // 16/32/64
+        requested += size;
+        
+        uint64_t start = esp_timer_get_time();
+        void* ptr = legacy_aligned_malloc(size, alignment);
+        size_t usable = ptr ? heap_caps_get_allocated_size(((void**)ptr)[-1]) : size;
+        legacy_aligned_free(ptr);
+        legacy_time += esp_timer_get_time() - start;
+        legacy_waste += usable - size;
+        
+        start = esp_timer_get_time();
+        ptr = aligned_malloc(size, alignment);
+        usable = ptr ? aligned_usable_size(ptr) : size;
+        aligned_free(ptr);
+        slab_time += esp_timer_get_time() - start;
+        slab_waste += usable - size;
+    }
+    
+    ESP_LOGI(TAG, "  %-12s legacy pad %.3f μs/op, %.1f%% wasted | aligned slab %.3f μs/op, %.1f%% wasted",
+             name, (float)legacy_time / ALIGNED_BENCH_ITERATIONS, 100.0f * legacy_waste / requested,
+             (float)slab_time / ALIGNED_BENCH_ITERATIONS, 100.0f * slab_waste / requested);
+}
+
+void benchmark_aligned_allocators(void) {
+    ESP_LOGI(TAG, "Aligned Allocator Benchmark (%d allocs, 16/32/64 align):", ALIGNED_BENCH_ITERATIONS);
+    run_aligned_workload("16-2047 B", false);
+    run_aligned_workload("2^n buffers", true);
 }
 
 // Memory allocation benchmark
@@ -402,17 +1130,29 @@ void benchmark_allocation_strategies(void) {
     
     uint64_t static_time = esp_timer_get_time() - start_time;
     
-    ESP_LOGI(TAG, "Allocation Benchmark (%d iterations, %d bytes):", iterations, test_size);
+    ESP_LOGI(TAG, "Allocation Benchmark (%d iterations, %d bytes):", iterations, (int)test_size);
     ESP_LOGI(TAG, "  malloc/free: %llu μs (%.2f μs per operation)", 
-             malloc_time, (float)malloc_time / (iterations * 2));
+             (unsigned long long)malloc_time, (float)malloc_time / (iterations * 2));
     ESP_LOGI(TAG, "  static pool: %llu μs (%.2f μs per operation)", 
-             static_time, (float)static_time / (iterations * 2));
+             (unsigned long long)static_time, (float)static_time / (iterations * 2));
     
     if (static_time < malloc_time) {
         ESP_LOGI(TAG, "  Static is %.2fx faster!", (float)malloc_time / static_time);
         opt_stats.allocation_time_saved += (malloc_time - static_time);
     }
     
+    // Benchmark 1b: contention — 1, 2, 4 tasks alloc/free พร้อมกัน
+    ESP_LOGI(TAG, "Contention Benchmark (%d pairs per task):", CONTENTION_ITERATIONS);
+    for (int num_tasks = 1; num_tasks <= CONTENTION_MAX_TASKS; num_tasks *= 2) {
+        uint32_t malloc_failures, static_failures;
+        float malloc_ops = run_contention_round(false, num_tasks, test_size, &malloc_failures);
+        float static_ops = run_contention_round(true, num_tasks, test_size, &static_failures);
+        
+        ESP_LOGI(TAG, "  %d task(s): malloc %.0f ops/s | static bitmap %.0f ops/s (%.2fx)%s",
+                 num_tasks, malloc_ops, static_ops, malloc_ops > 0 ? static_ops / malloc_ops : 0.0f,
+                 (malloc_failures + static_failures) ? " ⚠️ failures" : "");
+    }
+    
     // Benchmark 2: aligned vs unaligned allocation
     start_time = esp_timer_get_time();
     
@@ -439,40 +1179,193 @@ void benchmark_allocation_strategies(void) {
     uint64_t aligned_time = esp_timer_get_time() - start_time;
     
     ESP_LOGI(TAG, "Alignment Benchmark:");
-    ESP_LOGI(TAG, "  Unaligned: %llu μs", unaligned_time);
-    ESP_LOGI(TAG, "  Aligned:   %llu μs", aligned_time);
+    ESP_LOGI(TAG, "  Unaligned: %llu μs", (unsigned long long)unaligned_time);
+    ESP_LOGI(TAG, "  Aligned:   %llu μs", (unsigned long long)aligned_time);
+    
+    benchmark_aligned_allocators();
     
     ESP_LOGI(TAG, "═══════════════════════════════════════");
 }
 
+// ====== Static task arena ======
+#if TASK_ARENA_RECLAIM
+// idle hook: ตอนนี้ prvDeleteTCB ของ core นี้จบแล้ว slot ที่ retire ไว้ใช้ซ้ำได้
+static bool task_arena_idle_hook(void) {
+    int core = xPortGetCoreID();
+    for (int c = 0; c < TASK_STACK_CLASSES; c++) {
+        uint32_t retired = atomic_exchange(&task_stack_classes[c].retired[core], 0);
+        if (retired) {
+            atomic_fetch_and(&task_stack_classes[c].bitmap, ~retired);
+            atomic_fetch_add(&task_arena_reclaimed, __builtin_popcount(retired));
+        }
+    }
+    return true;
+}
+
+static void task_arena_retire(void* tcb) {
+    uintptr_t offset = (uintptr_t)tcb - (uintptr_t)task_tcbs;
+    if (offset >= sizeof(task_tcbs)) return;   // task ที่สร้างจาก heap
+    
+    int slot = offset / sizeof(StaticTask_t);
+    for (int c = TASK_STACK_CLASSES - 1; c >= 0; c--) {
+        task_stack_class_t* cls = &task_stack_classes[c];
+        if (slot >= cls->first_slot) {
+            atomic_fetch_or(&cls->retired[xPortGetCoreID()], 1U << (slot - cls->first_slot));
+            atomic_fetch_sub(&task_arena_live, 1);
+            return;
+        }
+    }
+}
+
+// เรียกโดย kernel ก่อน TCB ถูกทิ้ง (idle task หรือ task ที่สั่งลบ)
+#if CONFIG_FREERTOS_TASK_PRE_DELETION_HOOK
+void vTaskPreDeletionHook(void* pxTCB) {
+    task_arena_retire(pxTCB);
+}
+#else
+void vPortCleanUpTCB(void* pxTCB) {
+    task_arena_retire(pxTCB);
+}
+#endif
+#endif
+
+bool static_task_arena_init(void) {
+    uint16_t first_slot = 0;
+    
+    for (int c = 0; c < TASK_STACK_CLASSES; c++) {
+        task_stack_class_t* cls = &task_stack_classes[c];
+        size_t bytes = (size_t)cls->stack_depth * cls->slot_count * sizeof(StackType_t);
+        
+        if (!cls->stacks) {
+            cls->stacks = heap_caps_malloc(bytes, cls->caps);
+            if (!cls->stacks && cls->caps != TASK_ARENA_INTERNAL_CAPS) {
+                cls->stacks = heap_caps_malloc(bytes, TASK_ARENA_INTERNAL_CAPS);   // ไม่มี PSRAM
+            }
+            if (!cls->stacks) {
+                ESP_LOGE(TAG, "Failed to reserve %d bytes for %lu-byte task stacks", (int)bytes, (unsigned long)cls->stack_depth);
+                return false;
+            }
+        }
+        cls->first_slot = first_slot;
+        first_slot += cls->slot_count;
+        atomic_store(&cls->bitmap, 0);
+    }
+    
+    if (first_slot > TASK_ARENA_SLOTS) {
+        ESP_LOGE(TAG, "Task arena needs %d TCBs, TASK_ARENA_SLOTS is %d", first_slot, TASK_ARENA_SLOTS);
+        return false;
+    }
+    
+#if TASK_ARENA_RECLAIM
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        if (esp_register_freertos_idle_hook_for_cpu(task_arena_idle_hook, core) != ESP_OK) return false;
+    }
+#else
+    ESP_LOGW(TAG, "⚠️ Task deletion hook disabled: static task slots are never reclaimed");
+#endif
+    return true;
+}
+
+// ใช้ class เล็กสุดที่ stack พอ ถ้าเต็มขยับไป class ใหญ่ขึ้น (NULL = arena เต็ม)
+TaskHandle_t create_static_task_with_stack(TaskFunction_t task_function, const char* name,
+                                           uint32_t stack_depth, UBaseType_t priority, void* parameters) {
+    for (int c = 0; c < TASK_STACK_CLASSES; c++) {
+        task_stack_class_t* cls = &task_stack_classes[c];
+        if (cls->stack_depth < stack_depth || !cls->stacks) continue;
+        
+        uint32_t previous;
+        int bit = bitmap_claim(&cls->bitmap, (uint32_t)(((uint64_t)1 << cls->slot_count) - 1), &previous);
+        if (bit < 0) continue;
+        
+        TaskHandle_t task_handle = xTaskCreateStatic(task_function, name, cls->stack_depth, parameters, priority,
+                                                     cls->stacks + (size_t)bit * cls->stack_depth,
+                                                     &task_tcbs[cls->first_slot + bit]);
+        if (!task_handle) {
+            atomic_fetch_and(&cls->bitmap, ~(1U << bit));
+            return NULL;
+        }
+        atomic_fetch_add(&task_arena_live, 1);
+        __atomic_fetch_add(&opt_stats.static_allocations, 1, __ATOMIC_RELAXED);
+        return task_handle;
+    }
+    return NULL;
+}
+
 // Static task creation demonstration
 BaseType_t create_static_task(TaskFunction_t task_function, const char* name, 
                              UBaseType_t priority, void* parameters) {
-    if (next_task_slot >= MAX_TASKS) {
-        ESP_LOGE(TAG, "No more static task slots available");
-        return pdFAIL;
-    }
-    
-    TaskHandle_t task_handle = xTaskCreateStatic(
-        task_function,
-        name,
-        TASK_STACK_SIZE,
-        parameters,
-        priority,
-        task_stacks[next_task_slot],
-        &task_buffers[next_task_slot]
-    );
+    TaskHandle_t task_handle = create_static_task_with_stack(task_function, name, TASK_STACK_SIZE,
+                                                             priority, parameters);
     
     if (task_handle) {
-        ESP_LOGI(TAG, "✅ Created static task '%s' in slot %d", name, next_task_slot);
-        next_task_slot++;
+        ESP_LOGI(TAG, "✅ Created static task '%s' (%u live in arena)", name, atomic_load(&task_arena_live));
         return pdPASS;
     } else {
-        ESP_LOGE(TAG, "❌ Failed to create static task '%s'", name);
+        ESP_LOGE(TAG, "❌ Failed to create static task '%s' (arena full)", name);
         return pdFAIL;
     }
 }
 
+// Task creation benchmark: short-lived workers ผ่าน xTaskCreate (heap) เทียบกับ static arena
+static void task_bench_worker(void *pvParameters) {
+    xSemaphoreGive((SemaphoreHandle_t)pvParameters);
+    vTaskDelete(NULL);
+}
+
+static void run_task_creation_round(bool use_arena, SemaphoreHandle_t done,
+                                    float* create_us, size_t* heap_dip, int* failures) {
+    size_t start_free = esp_get_free_heap_size();
+    size_t lowest_free = start_free;
+    uint64_t total_us = 0;
+    int created = 0;
+    *failures = 0;
+    
+    for (int i = 0; i < TASK_BENCH_WORKERS; i++) {
+        uint64_t start = esp_timer_get_time();
+        bool ok;
+        if (use_arena) {
+            ok = create_static_task_with_stack(task_bench_worker, "Worker", TASK_BENCH_STACK,
+                                               uxTaskPriorityGet(NULL), done) != NULL;
+        } else {
+            ok = xTaskCreate(task_bench_worker, "Worker", TASK_BENCH_STACK, done,
+                             uxTaskPriorityGet(NULL), NULL) == pdPASS;
+        }
+        total_us += esp_timer_get_time() - start;
+        
+        if (ok) {
+            created++;
+            xSemaphoreTake(done, portMAX_DELAY);
+            size_t free_now = esp_get_free_heap_size();
+            if (free_now < lowest_free) lowest_free = free_now;
+        } else {
+            (*failures)++;
+        }
+        vTaskDelay(1);   // ให้ idle task เก็บกวาด task ที่ลบตัวเอง (คืน heap / slot)
+    }
+    
+    *create_us = created ? (float)total_us / created : 0;
+    *heap_dip = start_free - lowest_free;
+}
+
+void benchmark_task_creation(void) {
+    SemaphoreHandle_t done = xSemaphoreCreateBinary();
+    if (!done) return;
+    
+    float dynamic_us, arena_us;
+    size_t dynamic_dip, arena_dip;
+    int dynamic_failures, arena_failures;
+    run_task_creation_round(false, done, &dynamic_us, &dynamic_dip, &dynamic_failures);
+    run_task_creation_round(true, done, &arena_us, &arena_dip, &arena_failures);
+    vSemaphoreDelete(done);
+    
+    ESP_LOGI(TAG, "\n🧵 Task Creation Benchmark (%d short-lived workers, %d-byte stacks):",
+             TASK_BENCH_WORKERS, TASK_BENCH_STACK);
+    ESP_LOGI(TAG, "  xTaskCreate:  %.1f μs/create, heap dip %d bytes, %d failures",
+             dynamic_us, (int)dynamic_dip, dynamic_failures);
+    ESP_LOGI(TAG, "  static arena: %.1f μs/create, heap dip %d bytes, %d failures (%u slots reclaimed)",
+             arena_us, (int)arena_dip, arena_failures, atomic_load(&task_arena_reclaimed));
+}
+
 // Test tasks
 void optimization_test_task(void *pvParameters) {
     ESP_LOGI(TAG, "🧪 Optimization test task started");
@@ -559,13 +1452,13 @@ void optimization_monitor_task(void *pvParameters) {
         vTaskDelay(pdMS_TO_TICKS(15000)); // Monitor every 15 seconds
         
         ESP_LOGI(TAG, "\n📈 ═══ OPTIMIZATION STATISTICS ═══");
-        ESP_LOGI(TAG, "Static Allocations:      %d", opt_stats.static_allocations);
-        ESP_LOGI(TAG, "Dynamic Allocations:     %d", opt_stats.dynamic_allocations);
-        ESP_LOGI(TAG, "Alignment Optimizations: %d", opt_stats.alignment_optimizations);
-        ESP_LOGI(TAG, "Packing Optimizations:   %d", opt_stats.packing_optimizations);
+        ESP_LOGI(TAG, "Static Allocations:      %d", (int)opt_stats.static_allocations);
+        ESP_LOGI(TAG, "Dynamic Allocations:     %d", (int)opt_stats.dynamic_allocations);
+        ESP_LOGI(TAG, "Alignment Optimizations: %d", (int)opt_stats.alignment_optimizations);
+        ESP_LOGI(TAG, "Packing Optimizations:   %d", (int)opt_stats.packing_optimizations);
         ESP_LOGI(TAG, "Memory Saved:            %d bytes (%.1f KB)", 
-                 opt_stats.memory_saved_bytes, opt_stats.memory_saved_bytes / 1024.0);
-        ESP_LOGI(TAG, "Time Saved:              %llu μs", opt_stats.allocation_time_saved);
+                 (int)opt_stats.memory_saved_bytes, opt_stats.memory_saved_bytes / 1024.0);
+        ESP_LOGI(TAG, "Time Saved:              %llu μs", (unsigned long long)opt_stats.allocation_time_saved);
         
         // Update LED based on savings
         if (opt_stats.memory_saved_bytes > 1024) {
@@ -576,10 +1469,10 @@ void optimization_monitor_task(void *pvParameters) {
         
         // Print heap status
         ESP_LOGI(TAG, "\nHeap Status:");
-        ESP_LOGI(TAG, "  Free: %d bytes", esp_get_free_heap_size());
-        ESP_LOGI(TAG, "  Min Free: %d bytes", esp_get_minimum_free_heap_size());
+        ESP_LOGI(TAG, "  Free: %lu bytes", (unsigned long)esp_get_free_heap_size());
+        ESP_LOGI(TAG, "  Min Free: %lu bytes", (unsigned long)esp_get_minimum_free_heap_size());
         
-        ESP_LOGI(TAG, "System uptime: %llu ms", esp_timer_get_time() / 1000);
+        ESP_LOGI(TAG, "System uptime: %llu ms", (unsigned long long)(esp_timer_get_time() / 1000));
         ESP_LOGI(TAG, "═══════════════════════════════════════\n");
     }
 }
@@ -601,10 +1494,9 @@ void app_main(void) {
     gpio_set_level(LED_MEMORY_SAVING, 0);
     gpio_set_level(LED_OPTIMIZATION, 0);
     
-    // Create mutex for static buffer management
-    static_buffer_mutex = xSemaphoreCreateMutex();
-    if (!static_buffer_mutex) {
-        ESP_LOGE(TAG, "Failed to create static buffer mutex!");
+    // Static buffer bitmap + aligned slabs + task arena
+    if (!static_buffers_init() || !aligned_slabs_init() || !static_task_arena_init()) {
+        ESP_LOGE(TAG, "Failed to initialize static memory system!");
         return;
     }
     
@@ -620,11 +1512,16 @@ void app_main(void) {
     ESP_LOGI(TAG, "Static buffers: %d × %d bytes = %d KB total",
              STATIC_BUFFER_COUNT, STATIC_BUFFER_SIZE,
              (STATIC_BUFFER_COUNT * STATIC_BUFFER_SIZE) / 1024);
-    ESP_LOGI(TAG, "Task stacks: %d × %d bytes = %d KB total",
-             MAX_TASKS, TASK_STACK_SIZE * sizeof(StackType_t),
-             (MAX_TASKS * TASK_STACK_SIZE * sizeof(StackType_t)) / 1024);
+    for (int c = 0; c < TASK_STACK_CLASSES; c++) {
+        const task_stack_class_t* cls = &task_stack_classes[c];
+        ESP_LOGI(TAG, "Task stacks: %d × %d bytes = %d KB at %p",
+                 (int)cls->slot_count, (int)(cls->stack_depth * sizeof(StackType_t)),
+                 (int)((cls->slot_count * cls->stack_depth * sizeof(StackType_t)) / 1024), cls->stacks);
+    }
     ESP_LOGI(TAG, "═══════════════════════════════════════");
     
+    benchmark_task_creation();
+    
     // Create tasks using static allocation
     ESP_LOGI(TAG, "Creating optimization test tasks...");
     
@@ -647,7 +1544,7 @@ void app_main(void) {
     ESP_LOGI(TAG, "\n🔧 Optimization Features:");
     ESP_LOGI(TAG, "  • Static vs Dynamic Allocation Comparison");
     ESP_LOGI(TAG, "  • Memory Alignment Optimization");
-    ESP_LOGI(TAG, "  • Struct Packing Optimization");
+    ESP_LOGI(TAG, "  • Struct Packing Optimization (AoS vs SoA layouts)");
     ESP_LOGI(TAG, "  • Memory Access Pattern Analysis");
     ESP_LOGI(TAG, "  • Allocation Performance Benchmarking");
     ESP_LOGI(TAG, "  • Memory Region Analysis");
@@ -0,0 +1,342 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "esp_cpu.h"
+
+static const char *TAG = "ALLOC_BENCH";
+
+// ====== Benchmark configuration ======
+// trace ใช้ 4 B/op + sample 4 B/op — บน target RAM จำกัดจึงสั้นกว่า
+#if CONFIG_IDF_TARGET_LINUX
+#define BENCH_TRACE_OPS         200000
+#else
+#define BENCH_TRACE_OPS         8000
+#endif
+#define BENCH_SEED              0x9E3779B9U  // seed คงที่: ทุก allocator / ทุก version ได้ trace เดียวกัน
+#define BENCH_WARMUP_ROUNDS     1            // replay ทิ้งก่อนวัด (ให้ pool โต slab / heap อุ่นเครื่อง)
+#define BENCH_MAX_SLOTS         64           // live allocations สูงสุดของทุก workload
+#define BENCH_CALIBRATE_US      20000        // ช่วงเทียบ CPU cycles กับ esp_timer
+
+// Output: บรรทัดผลลัพธ์ออก stdout ตรง ๆ (ไม่ผ่าน ESP_LOG) ให้ script เก็บไปเทียบข้าม version
+#define BENCH_FORMAT_CSV        0
+#define BENCH_FORMAT_JSON       1            // JSON Lines: หนึ่ง object ต่อบรรทัด
+#ifndef BENCH_OUTPUT_FORMAT
+#define BENCH_OUTPUT_FORMAT     BENCH_FORMAT_CSV
+#endif
+#define BENCH_SCHEMA_VERSION    1            // เพิ่มเมื่อเปลี่ยนคอลัมน์/ความหมายของ field
+
+// ====== Allocators under test (lab1-3 ไม่มี header แยก) ======
+// lab1: heap_management.c
+bool heap_tracking_init(void);
+void* tracked_malloc(size_t size, uint32_t caps, const char* description);
+void tracked_free(void* ptr, const char* description);
+#define TRACKED_MAX_LIVE        512          // = MAX_ALLOCATIONS ของ lab1 (ค่าบน target)
+
+// lab2: memory_pools.c
+bool memory_pools_init(void);
+void* smart_pool_malloc(size_t size);
+bool smart_pool_free(void* ptr);
+
+// lab3: memory_optimization.c
+bool static_buffers_init(void);
+void* allocate_static_buffer(void);
+void free_static_buffer(void* buffer);
+#define STATIC_BUFFER_BYTES     4096         // = STATIC_BUFFER_SIZE ของ lab3
+#define STATIC_BUFFER_SLOTS     8            // = STATIC_BUFFER_COUNT ของ lab3
+
+typedef struct {
+    const char* name;
+    size_t max_size;                // request ใหญ่สุดที่รับได้
+    int max_live;                   // allocation ค้างพร้อมกันได้สูงสุด
+    void* (*alloc)(size_t size);
+    void (*free)(void* ptr);
+} bench_allocator_t;
+
+static void* bench_pool_alloc(size_t size) { return smart_pool_malloc(size); }
+static void  bench_pool_free(void* ptr)    { smart_pool_free(ptr); }
+
+static void* bench_static_alloc(size_t size) { (void)size; return allocate_static_buffer(); }
+static void  bench_static_free(void* ptr)    { free_static_buffer(ptr); }
+
+static void* bench_heap_alloc(size_t size) { return heap_caps_malloc(size, MALLOC_CAP_DEFAULT | MALLOC_CAP_8BIT); }
+static void  bench_heap_free(void* ptr)    { heap_caps_free(ptr); }
+
+static void* bench_tracked_alloc(size_t size) { return tracked_malloc(size, MALLOC_CAP_DEFAULT, "Bench"); }
+static void  bench_tracked_free(void* ptr)    { tracked_free(ptr, "Bench"); }
+
+static const bench_allocator_t allocators[] = {
+    {"pool",          4096,                BENCH_MAX_SLOTS,     bench_pool_alloc,    bench_pool_free},
+    {"static_buffer", STATIC_BUFFER_BYTES, STATIC_BUFFER_SLOTS, bench_static_alloc,  bench_static_free},
+    {"heap_caps",     SIZE_MAX,            BENCH_MAX_SLOTS,     bench_heap_alloc,    bench_heap_free},
+    {"tracked_heap",  SIZE_MAX,            TRACKED_MAX_LIVE,    bench_tracked_alloc, bench_tracked_free},
+};
+#define ALLOCATOR_COUNT (sizeof(allocators) / sizeof(allocators[0]))
+
+// ====== Workloads (size distribution + lifetime) ======
+typedef enum {
+    LIFETIME_RANDOM,   // สุ่ม slot: ว่างก็ alloc, มีของก็ free (อายุกระจายแบบ geometric)
+    LIFETIME_LIFO,     // alloc เต็ม burst แล้ว free ย้อนกลับ (stack-like)
+    LIFETIME_FIFO,     // alloc เต็ม burst แล้ว free ตามลำดับเดิม (queue-like)
+} bench_lifetime_t;
+
+typedef struct {
+    const char* name;
+    const uint16_t* sizes;          // สุ่มแบบ uniform จากตาราง (ใส่ค่าซ้ำเพื่อถ่วงน้ำหนัก)
+    int size_count;
+    int live;                       // จำนวน slot (<= BENCH_MAX_SLOTS)
+    bench_lifetime_t lifetime;
+} bench_workload_t;
+
+static const uint16_t sizes_small[] = {16, 24, 32, 40, 48, 56, 64};
+static const uint16_t sizes_mixed[] = {32, 32, 32, 32, 128, 128, 128, 512, 512, 2048};  // 40/30/20/10 %
+static const uint16_t sizes_wide[]  = {16, 24, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024};  // log-uniform
+
+#define SIZES(t) t, (int)(sizeof(t) / sizeof(t[0]))
+static const bench_workload_t workloads[] = {
+    {"churn_small",  SIZES(sizes_small), 1,               LIFETIME_RANDOM},
+    {"steady_mixed", SIZES(sizes_mixed), 8,               LIFETIME_RANDOM},
+    {"burst_lifo",   SIZES(sizes_mixed), 8,               LIFETIME_LIFO},
+    {"burst_fifo",   SIZES(sizes_mixed), 8,               LIFETIME_FIFO},
+    {"steady_wide",  SIZES(sizes_wide),  BENCH_MAX_SLOTS, LIFETIME_RANDOM},
+};
+#define WORKLOAD_COUNT (sizeof(workloads) / sizeof(workloads[0]))
+
+typedef struct {
+    uint16_t size;                  // 0 = free
+    uint8_t slot;
+    uint8_t reserved;
+} bench_op_t;
+
+typedef struct {
+    uint32_t allocs, frees, failures;
+    int64_t elapsed_us;
+    uint32_t alloc_ns[4], free_ns[4];   // p50, p99, p99.9, max
+} bench_result_t;
+
+static bench_op_t* trace;           // BENCH_TRACE_OPS + BENCH_MAX_SLOTS (เผื่อ free ปิดท้าย)
+static size_t trace_len;
+static uint32_t* samples;           // alloc cycles เติมจากหน้า, free cycles เติมจากท้าย
+static double ns_per_cycle;
+
+// ====== Trace generation (deterministic) ======
+static uint32_t rng_state;
+
+static inline uint32_t bench_rand(void) {
+    // xorshift32: เร็วและให้ลำดับเดิมทุกครั้งบนทุก platform
+    uint32_t x = rng_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return rng_state = x;
+}
+
+static size_t workload_max_size(const bench_workload_t* w) {
+    size_t max_size = 0;
+    for (int i = 0; i < w->size_count; i++) {
+        if (w->sizes[i] > max_size) max_size = w->sizes[i];
+    }
+    return max_size;
+}
+
+static size_t build_trace(const bench_workload_t* w, bench_op_t* ops, size_t max_ops) {
+    bool live[BENCH_MAX_SLOTS] = {false};
+    size_t n = 0;
+    rng_state = BENCH_SEED;
+
+    if (w->lifetime == LIFETIME_RANDOM) {
+        while (n < max_ops) {
+            int slot = bench_rand() % w->live;
+            uint16_t size = live[slot] ? 0 : w->sizes[bench_rand() % w->size_count];
+            ops[n++] = (bench_op_t){size, (uint8_t)slot, 0};
+            live[slot] = !live[slot];
+        }
+        // ปิดท้ายด้วย free ที่เหลือ (เกิน max_ops ได้ไม่เกิน live): จบ trace แล้ว allocator ว่างเหมือนตอนเริ่ม
+        for (int slot = 0; slot < w->live; slot++) {
+            if (live[slot]) ops[n++] = (bench_op_t){0, (uint8_t)slot, 0};
+        }
+    } else {
+        while (n + 2 * w->live <= max_ops) {
+            for (int slot = 0; slot < w->live; slot++) {
+                ops[n++] = (bench_op_t){w->sizes[bench_rand() % w->size_count], (uint8_t)slot, 0};
+            }
+            for (int i = 0; i < w->live; i++) {
+                int slot = (w->lifetime == LIFETIME_LIFO) ? w->live - 1 - i : i;
+                ops[n++] = (bench_op_t){0, (uint8_t)slot, 0};
+            }
+        }
+    }
+    return n;
+}
+
+// ====== Replay ======
+static void replay(const bench_allocator_t* a, bench_result_t* r, bool record) {
+    void* slots[BENCH_MAX_SLOTS] = {NULL};
+    uint32_t* alloc_tail = samples;
+    uint32_t* free_head = samples + trace_len;
+
+    memset(r, 0, sizeof(*r));
+    int64_t start = esp_timer_get_time();
+
+    for (size_t i = 0; i < trace_len; i++) {
+        const bench_op_t op = trace[i];
+        if (op.size) {
+            uint32_t t0 = esp_cpu_get_cycle_count();
+            void* ptr = a->alloc(op.size);
+            uint32_t dt = esp_cpu_get_cycle_count() - t0;
+            if (!ptr) {
+                r->failures++;
+                continue;
+            }
+            ((volatile uint8_t*)ptr)[0] = op.slot;  // แตะ memory จริง (นอกช่วงจับเวลา)
+            slots[op.slot] = ptr;
+            r->allocs++;
+            if (record) *alloc_tail++ = dt;
+        } else {
+            void* ptr = slots[op.slot];
+            if (!ptr) continue;  // alloc คู่กันล้มเหลว
+            slots[op.slot] = NULL;
+            uint32_t t0 = esp_cpu_get_cycle_count();
+            a->free(ptr);
+            uint32_t dt = esp_cpu_get_cycle_count() - t0;
+            r->frees++;
+            if (record) *--free_head = dt;
+        }
+    }
+
+    r->elapsed_us = esp_timer_get_time() - start;
+}
+
+// ====== Statistics ======
+static int cmp_u32(const void* a, const void* b) {
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+static void summarize(uint32_t* v, size_t n, uint32_t out_ns[4]) {
+    static const double quantiles[3] = {0.50, 0.99, 0.999};
+    if (n == 0) {
+        memset(out_ns, 0, 4 * sizeof(uint32_t));
+        return;
+    }
+    qsort(v, n, sizeof(uint32_t), cmp_u32);  // เรียงทั้งชุด: percentile แม่นตรง ไม่ใช่ histogram
+    for (int q = 0; q < 3; q++) {
+        size_t idx = (size_t)(quantiles[q] * n);
+        if (idx >= n) idx = n - 1;
+        out_ns[q] = (uint32_t)(v[idx] * ns_per_cycle + 0.5);
+    }
+    out_ns[3] = (uint32_t)(v[n - 1] * ns_per_cycle + 0.5);
+}
+
+static double calibrate_ns_per_cycle(void) {
+    // CPU cycle counter ละเอียดกว่า esp_timer มาก แต่ความถี่ต่างกันตาม target/host จึงเทียบจริงก่อน
+    int64_t t0 = esp_timer_get_time();
+    uint32_t c0 = esp_cpu_get_cycle_count();
+    while (esp_timer_get_time() - t0 < BENCH_CALIBRATE_US) {
+    }
+    uint32_t cycles = esp_cpu_get_cycle_count() - c0;
+    int64_t us = esp_timer_get_time() - t0;
+    return cycles ? (us * 1000.0) / cycles : 1.0;
+}
+
+// ====== Output ======
+static void print_header(void) {
+#if BENCH_OUTPUT_FORMAT == BENCH_FORMAT_CSV
+    printf("schema,target,seed,allocator,workload,ops,allocs,frees,failures,elapsed_us,ops_per_sec,"
+           "alloc_p50_ns,alloc_p99_ns,alloc_p999_ns,alloc_max_ns,"
+           "free_p50_ns,free_p99_ns,free_p999_ns,free_max_ns\n");
+#endif
+}
+
+static void print_result(const bench_allocator_t* a, const bench_workload_t* w, const bench_result_t* r) {
+    uint32_t ops = r->allocs + r->frees;
+    double ops_per_sec = r->elapsed_us > 0 ? ops * 1e6 / r->elapsed_us : 0.0;
+#if BENCH_OUTPUT_FORMAT == BENCH_FORMAT_CSV
+    printf("%d,%s,%lu,%s,%s,%lu,%lu,%lu,%lu,%lld,%.0f,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu\n",
+           BENCH_SCHEMA_VERSION, CONFIG_IDF_TARGET, (unsigned long)BENCH_SEED, a->name, w->name,
+           (unsigned long)ops, (unsigned long)r->allocs, (unsigned long)r->frees,
+           (unsigned long)r->failures, (long long)r->elapsed_us, ops_per_sec,
+           (unsigned long)r->alloc_ns[0], (unsigned long)r->alloc_ns[1],
+           (unsigned long)r->alloc_ns[2], (unsigned long)r->alloc_ns[3],
+           (unsigned long)r->free_ns[0], (unsigned long)r->free_ns[1],
+           (unsigned long)r->free_ns[2], (unsigned long)r->free_ns[3]);
+#else
+    printf("{\"schema\":%d,\"target\":\"%s\",\"seed\":%lu,\"allocator\":\"%s\",\"workload\":\"%s\","
+           "\"ops\":%lu,\"allocs\":%lu,\"frees\":%lu,\"failures\":%lu,\"elapsed_us\":%lld,\"ops_per_sec\":%.0f,"
+           "\"alloc_ns\":{\"p50\":%lu,\"p99\":%lu,\"p999\":%lu,\"max\":%lu},"
+           "\"free_ns\":{\"p50\":%lu,\"p99\":%lu,\"p999\":%lu,\"max\":%lu}}\n",
+           BENCH_SCHEMA_VERSION, CONFIG_IDF_TARGET, (unsigned long)BENCH_SEED, a->name, w->name,
+           (unsigned long)ops, (unsigned long)r->allocs, (unsigned long)r->frees,
+           (unsigned long)r->failures, (long long)r->elapsed_us, ops_per_sec,
+           (unsigned long)r->alloc_ns[0], (unsigned long)r->alloc_ns[1],
+           (unsigned long)r->alloc_ns[2], (unsigned long)r->alloc_ns[3],
+           (unsigned long)r->free_ns[0], (unsigned long)r->free_ns[1],
+           (unsigned long)r->free_ns[2], (unsigned long)r->free_ns[3]);
+#endif
+}
+
+// ====== Runner ======
+static void run_benchmarks(void) {
+    print_header();
+
+    for (size_t wi = 0; wi < WORKLOAD_COUNT; wi++) {
+        const bench_workload_t* w = &workloads[wi];
+        trace_len = build_trace(w, trace, BENCH_TRACE_OPS);
+
+        for (size_t ai = 0; ai < ALLOCATOR_COUNT; ai++) {
+            const bench_allocator_t* a = &allocators[ai];
+            if (workload_max_size(w) > a->max_size || w->live > a->max_live) {
+                ESP_LOGI(TAG, "⏭️ Skip %s on %s (size/live limit)", w->name, a->name);
+                continue;
+            }
+
+            bench_result_t r;
+            for (int round = 0; round < BENCH_WARMUP_ROUNDS; round++) replay(a, &r, false);
+            replay(a, &r, true);
+
+            summarize(samples, r.allocs, r.alloc_ns);
+            summarize(samples + trace_len - r.frees, r.frees, r.free_ns);
+            print_result(a, w, &r);
+        }
+    }
+    fflush(stdout);
+}
+
+// ====== app_main ======
+void app_main(void) {
+    ESP_LOGI(TAG, "🚀 Allocator Benchmark Harness Starting...");
+
+    if (!heap_tracking_init() || !memory_pools_init() || !static_buffers_init()) {
+        ESP_LOGE(TAG, "Allocator init failed!");
+        return;
+    }
+
+    trace = heap_caps_malloc((BENCH_TRACE_OPS + BENCH_MAX_SLOTS) * sizeof(bench_op_t), MALLOC_CAP_DEFAULT);
+    samples = heap_caps_malloc((BENCH_TRACE_OPS + BENCH_MAX_SLOTS) * sizeof(uint32_t), MALLOC_CAP_DEFAULT);
+    if (!trace || !samples) {
+        ESP_LOGE(TAG, "Failed to allocate trace buffers!");
+        return;
+    }
+
+    ns_per_cycle = calibrate_ns_per_cycle();
+    ESP_LOGI(TAG, "Trace: %d ops/workload, seed 0x%08lX, %.3f ns/cycle",
+             BENCH_TRACE_OPS, (unsigned long)BENCH_SEED, ns_per_cycle);
+    ESP_LOGI(TAG, "%d workloads × %d allocators", (int)WORKLOAD_COUNT, (int)ALLOCATOR_COUNT);
+
+    run_benchmarks();
+
+    heap_caps_free(samples);
+    heap_caps_free(trace);
+    ESP_LOGI(TAG, "✅ Benchmark complete");
+
+#if CONFIG_IDF_TARGET_LINUX
+    // FreeRTOS POSIX port ไม่จบ process เองเมื่อ app_main return
+    exit(0);
+#endif
+}
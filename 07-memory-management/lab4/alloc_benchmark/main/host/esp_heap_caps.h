@@ -0,0 +1,49 @@
+#pragma once
+// Host stub ของ esp_heap_caps.h สำหรับ linux target: ทุก caps ใช้ heap ของ host
+// ฟังก์ชันสถิติคืน 0 (host ไม่มี region แยก internal/SPIRAM)
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <malloc.h>
+
+#define MALLOC_CAP_EXEC         (1 << 0)
+#define MALLOC_CAP_32BIT        (1 << 1)
+#define MALLOC_CAP_8BIT         (1 << 2)
+#define MALLOC_CAP_DMA          (1 << 3)
+#define MALLOC_CAP_SPIRAM       (1 << 10)
+#define MALLOC_CAP_INTERNAL     (1 << 11)
+#define MALLOC_CAP_DEFAULT      (1 << 12)
+
+static inline void* heap_caps_malloc(size_t size, uint32_t caps) {
+    (void)caps;
+    return malloc(size);
+}
+
+static inline void* heap_caps_calloc(size_t n, size_t size, uint32_t caps) {
+    (void)caps;
+    return calloc(n, size);
+}
+
+static inline void* heap_caps_realloc(void* ptr, size_t size, uint32_t caps) {
+    (void)caps;
+    return realloc(ptr, size);
+}
+
+static inline void* heap_caps_aligned_alloc(size_t alignment, size_t size, uint32_t caps) {
+    (void)caps;
+    void* ptr = NULL;
+    if (alignment < sizeof(void*)) alignment = sizeof(void*);
+    return posix_memalign(&ptr, alignment, size) == 0 ? ptr : NULL;
+}
+
+static inline void heap_caps_free(void* ptr) { free(ptr); }
+static inline void heap_caps_aligned_free(void* ptr) { free(ptr); }
+static inline size_t heap_caps_get_allocated_size(void* ptr) { return malloc_usable_size(ptr); }
+
+static inline size_t heap_caps_get_free_size(uint32_t caps) { (void)caps; return 0; }
+static inline size_t heap_caps_get_total_size(uint32_t caps) { (void)caps; return 0; }
+static inline size_t heap_caps_get_largest_free_block(uint32_t caps) { (void)caps; return 0; }
+static inline size_t heap_caps_get_minimum_free_size(uint32_t caps) { (void)caps; return 0; }
+static inline void heap_caps_print_heap_info(uint32_t caps) { (void)caps; }
+static inline bool heap_caps_check_integrity_all(bool print_errors) { (void)print_errors; return true; }